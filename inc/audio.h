@@ -0,0 +1,43 @@
+#pragma once
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#define AUDIO_SAMPLE_RATE       48000
+#define AUDIO_BUFFER_SAMPLES    512
+#define AUDIO_TONE_FREQUENCY    440
+#define AUDIO_AMPLITUDE         4000
+// Enough for one period of the tone up to 192 kHz
+#define AUDIO_MAX_WAVE_LENGTH   512
+
+typedef struct audio_s audio_t;
+
+/*
+ * Square wave beeper driven by the sound timer.
+ *
+ * The emulation thread only flips the playing flag. The SDL callback reads it,
+ * copies samples out of a wave table built once at init and advances the audio clock,
+ * without allocating or locking.
+ */
+struct audio_s {
+    // SDL_AudioDeviceID, 0 when no device is open
+    uint32_t    device;
+    int         sample_rate;
+    int         buffer_samples;
+    int16_t     wave[AUDIO_MAX_WAVE_LENGTH];
+    int         wave_length;
+    // Callback side position in the wave table
+    int         phase;
+    atomic_bool playing;
+
+    // Audio clock, published by the callback under a sequence counter
+    atomic_uint clock_sequence;
+    atomic_long played_samples;
+    atomic_long callback_time;
+};
+
+bool init_audio(audio_t *audio);
+void set_audio_playing(audio_t *audio, bool playing);
+long int get_audio_time(void *audio);
+void destroy_audio(audio_t *audio);
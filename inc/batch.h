@@ -0,0 +1,74 @@
+#pragma once
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+
+#include "chip8_engine.h"
+#include "clock.h"
+#include "triple_buffer.h"
+#include "audio.h"
+#include "rom_pack.h"
+#include "trace.h"
+#include "metrics.h"
+#include "perf_counters.h"
+#include "verify.h"
+
+typedef struct batch_s batch_t;
+typedef struct batch_worker_s batch_worker_t;
+
+// A worker thread emulates the instances in [first, last)
+struct batch_worker_s {
+    pthread_t   thread;
+    batch_t     *batch;
+    int         first;
+    int         last;
+};
+
+/*
+ * Many engines emulated at FREQUENCY frames per second by a pool of worker threads.
+ * Every instance publishes its completed frames through its own triple buffer,
+ * so readers never block the workers.
+ * Input flows the other way through an atomic bitmask shared by all instances.
+ */
+struct batch_s {
+    chip8_engine_t  *engines;
+    triple_buffer_t *frames;
+    // One per instance once set_batch_trace is called, NULL until then
+    trace_t         *traces;
+    batch_worker_t  *workers;
+    int             instances;
+    int             threads;
+    atomic_bool     running;
+    // Bit k is set while key k is down, sampled by the workers once per frame
+    atomic_uint_least16_t keys;
+    // Trace every executed instruction / register state on the worker threads
+    bool            disas;
+    bool            dump_regs;
+    // Beeper following the sound timer of the first instance, NULL when muted
+    audio_t         *audio;
+    // Pace the workers on the audio device clock instead of the monotonic clock
+    bool            audio_clock;
+    // Counters updated by the workers once per frame, NULL when not collected
+    metrics_t       *metrics;
+    // Hardware counters of every worker merged on stop, NULL when not counted
+    perf_report_t   *perf;
+    // One per instance once set_batch_verify is called, NULL until then
+    verifier_t      *verifiers;
+    // Keys of frames [0, script_frames) replacing the live keys, NULL when none, see read_explore_input
+    const uint16_t  *script;
+    uint64_t        script_frames;
+};
+
+bool init_batch(batch_t *batch, const char **roms, int roms_count, const rom_pack_t *pack, int instances, int threads);
+bool set_batch_execution_engine(batch_t *batch, execution_engine_t execution_engine);
+void set_batch_instructions_per_frame(batch_t *batch, int instructions_per_frame);
+void set_batch_quirk_profile(batch_t *batch, quirk_profile_t quirk_profile);
+bool warm_batch(batch_t *batch, const char *index_path);
+bool set_batch_trace(batch_t *batch, const char *filepath, uint64_t capacity, const trace_filter_t *filter);
+bool set_batch_verify(batch_t *batch, uint64_t interval);
+int count_batch_divergences(const batch_t *batch);
+bool start_batch(batch_t *batch);
+void stop_batch(batch_t *batch);
+void set_batch_keys(batch_t *batch, uint16_t keys);
+void destroy_batch(batch_t *batch);
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "chip8_engine.h"
+#include "sha1.h"
+
+#define MAX_BLOCK_SUCCESSORS 2
+
+// Sidecar file of a ROM listing its basic blocks, see write_block_index
+#define BLOCK_INDEX_HEADER "chip8-blocks 1"
+
+typedef struct basic_block_s basic_block_t;
+typedef struct cfg_s cfg_t;
+typedef enum address_flag_e address_flag_t;
+
+enum address_flag_e {
+    // An instruction reached from the entry point starts here
+    CODE_ADDRESS            = 1 << 0,
+    // First instruction of a basic block
+    BLOCK_LEADER            = 1 << 1,
+    CALL_TARGET             = 1 << 2,
+    // Byte of an instruction, data when a ROM byte has none of the flags
+    CODE_BYTE               = 1 << 3,
+};
+
+// Instructions [start, end) run in sequence, only the last one branches
+struct basic_block_s {
+    uint16_t start;
+    uint16_t end;
+    uint16_t successors[MAX_BLOCK_SUCCESSORS];
+    uint8_t successors_count;
+    // Ends with JMP V0, nnn : successors are unknown
+    bool indirect;
+};
+
+// Control flow graph of a ROM, addresses as loaded at INITIAL_PROGRAM_COUNTER
+struct cfg_s {
+    uint8_t memory[MEMORY_SIZE];
+    uint16_t end;
+    uint8_t flags[MEMORY_SIZE];
+    basic_block_t *blocks;
+    int blocks_count;
+};
+
+bool build_cfg(cfg_t *cfg, const uint8_t *rom, size_t size);
+void print_cfg(const cfg_t *cfg);
+void print_coverage(const cfg_t *cfg, const uint64_t hits[MEMORY_SIZE]);
+void destroy_cfg(cfg_t *cfg);
+
+bool write_block_index(const cfg_t *cfg, const uint8_t sha1[SHA1_SIZE], const char *filepath);
+bool read_block_index(cfg_t *cfg, uint8_t sha1[SHA1_SIZE], const char *filepath);
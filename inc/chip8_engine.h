@@ -1,8 +1,12 @@
 #pragma once
 
+#include <stdbool.h>
 #include <stdint.h>
 
-#include "clock.h"
+#include "latency.h"
+#include "op_codes.h"
+#include "quirks.h"
+#include "rom_database.h"
 
 #define CHIP8_WINDOW_WIDTH    64
 #define CHIP8_WINDOW_HEIGHT   32
@@ -15,6 +19,22 @@
 #define FONT_SIZE                   80
 #define KEY_SIZE                    16
 #define FREQUENCY                   60
+// Instructions executed between two timer ticks, one tick per frame at FREQUENCY
+#define DEFAULT_INSTRUCTIONS_PER_FRAME 10
+// Longest instruction sequence dispatched as a single fused handler
+#define MAX_FUSED_INSTRUCTIONS      3
+
+// Addresses wrap around memory, as the 12 bits addresses of the VIP do
+#define MEMORY_ADDRESS(a)           ((a) & (MEMORY_SIZE - 1))
+// The stack pointer wraps around the stack as well
+#define STACK_INDEX(sp)             ((sp) & (STACK_SIZE - 1))
+
+// Memory then screen are split in pages, the unit shared and copied on write between forks
+#define CHIP8_PAGE_SHIFT            8
+#define CHIP8_PAGE_SIZE             (1 << CHIP8_PAGE_SHIFT)
+#define MEMORY_PAGES                (MEMORY_SIZE / CHIP8_PAGE_SIZE)
+#define SCREEN_PAGES                (CHIP8_WINDOW_WIDTH * CHIP8_WINDOW_HEIGHT / CHIP8_PAGE_SIZE)
+#define CHIP8_PAGES                 (MEMORY_PAGES + SCREEN_PAGES)
 
 #define WINDOW_SCALE 10
 
@@ -22,42 +42,245 @@
 #define WINDOW_HEIGHT   (CHIP8_WINDOW_HEIGHT *  WINDOW_SCALE)
 
 typedef struct chip8_engine_s chip8_engine_t;
-typedef uint8_t display_buffer_t[WINDOW_WIDTH * WINDOW_HEIGHT];
+typedef struct predecoded_s predecoded_t;
+typedef struct chip8_timer_s chip8_timer_t;
+typedef struct chip8_page_s chip8_page_t;
+// Pages shared by forks, see fork.h
+typedef struct chip8_pool_s chip8_pool_t;
+// Execution trace, see trace.h
+typedef struct trace_s trace_t;
+// Execution profile, see profiler.h
+typedef struct profiler_s profiler_t;
+typedef enum execution_engine_e execution_engine_t;
+typedef enum fusion_e fusion_t;
+typedef void (*instruction_handler_t)(chip8_engine_t *, const instruction_t *);
+// Called by run_chip8_frame after every dispatch, with the address it ran
+typedef void (*chip8_dispatch_hook_t)(chip8_engine_t *, uint16_t pc, void *context);
+// One RGB332 byte per logical pixel, scaled up to the window by the renderer
+typedef uint8_t display_buffer_t[CHIP8_WINDOW_WIDTH * CHIP8_WINDOW_HEIGHT];
+
+enum execution_engine_e {
+    // Decode every instruction and dispatch it through instructions_executors
+    REFERENCE_ENGINE,
+    // Decode each address once and dispatch to handlers specialized on their operands
+    PREDECODED_ENGINE,
+    // Predecoded, with common instruction sequences dispatched as a single handler
+    FUSED_ENGINE,
+    EXECUTION_ENGINES_SIZE
+};
+
+#define DEFAULT_EXECUTION_ENGINE FUSED_ENGINE
+
+// Instruction sequences recognized by the fused engine, see fusion.c
+enum fusion_e {
+    NO_FUSION,
+    // FX07, 3XKK, 1NNN - Wait for the delay timer
+    TIMER_WAIT,
+    // 6XKK, 6YKK, DXYN - Draw a sprite at fixed coordinates
+    SPRITE_SETUP,
+    // ANNN, DXYN - Draw the sprite stored at nnn
+    INDEXED_SPRITE,
+    // 7XKK, 3XKK - Increment a loop counter and test its end
+    LOOP_COUNTER,
+    FUSIONS_SIZE
+};
+
+/*
+ * Timer counting down once every cycles_per_tick instructions.
+ * Stored as its value at a cycle stamp and only brought up to date when accessed.
+ */
+struct chip8_timer_s {
+    uint8_t value;
+    uint64_t stamp;
+};
+
+struct chip8_page_s {
+    uint8_t bytes[CHIP8_PAGE_SIZE];
+    // Engines referencing the page, written in place only when 1
+    uint32_t refs;
+    // Next free page of the pool
+    chip8_page_t *next;
+};
+
+// Instruction decoded once, with the handler picked for it
+struct predecoded_s {
+    // NULL until the address is decoded, or once its memory has been written
+    instruction_handler_t handler;
+    instruction_t instruction;
+    // Fused engine only : sequence starting here, if any
+    uint8_t fusion;
+};
 
 struct chip8_engine_s {
-    // 4KB RAM
-    uint8_t memory[MEMORY_SIZE];
+    // 4KB RAM then the screen, one byte per pixel, read and written through the functions below
+    chip8_page_t *pages[CHIP8_PAGES];
     // 8 bits V registers
     uint8_t v[V_REGISTERS_SIZE];
     // 16 bits I register
     uint16_t i;
     // 8 bits delay register timer
-    uint8_t delay;
+    chip8_timer_t delay;
     // 8 bits sound register timer
-    uint8_t sound;
+    chip8_timer_t sound;
     // Stack is an array of 16 16 bits values
     uint16_t stack[STACK_SIZE];
     // 8 bits stack pointer
     uint8_t sp;
     // 16 bits program counter
     uint16_t pc;
+    // Number of instructions executed
+    uint64_t cycles;
+    // Timers tick on multiples of this cycle count
+    uint64_t cycles_per_tick;
     // Size of loaded program
     uint16_t prog_size;
+    // SHA-1 of the loaded program
+    uint8_t sha1[SHA1_SIZE];
+    // Entry of the loaded program in the ROM database, NULL when unknown
+    const rom_entry_t *rom;
+    // Address of a loop waiting for the delay timer, fast forwarded by skip_idle_loop, 0 for none
+    uint16_t idle_loop;
 
-    display_buffer_t screen;
+    // Zobrist hashes of memory and screen, kept up to date by write_memory and write_pixel, see hash_chip8_state
+    uint64_t memory_hash;
+    uint64_t screen_hash;
 
-    chip8_clock_t clock;
+    // Bit k is set while key k is down
+    uint16_t keyboard;
 
-    uint8_t keyboard[KEY_SIZE];
+    // State of the random generator of RAND, seeded from random() by init_chip8_engine
+    uint32_t rng;
 
     bool draw_flag;
+
+    // Input latency instrumentation, NULL when disabled
+    latency_probe_t *latency;
+    // Executed instructions recorder, NULL when disabled
+    trace_t *trace;
+    // Executed instructions counters, NULL when disabled
+    profiler_t *profiler;
+
+    quirk_profile_t quirk_profile;
+    // Executors of the quirk profile, indexed by op code
+    const instruction_handler_t *executors;
+
+    execution_engine_t execution_engine;
+    // Predecoded engines only : one entry per address
+    predecoded_t *predecoded;
+    // Fused engine only : dispatches of each fused handler
+    uint64_t fusion_hits[FUSIONS_SIZE];
+
+    // Forks only : pool of their pages, NULL for an engine using its own pages
+    chip8_pool_t *pool;
+
+    // Must stay last, chip8_fork copies the state before it
+    chip8_page_t own_pages[CHIP8_PAGES];
 };
 
+extern const char *execution_engines_strings[EXECUTION_ENGINES_SIZE + 1];
+
 void init_chip8_engine(chip8_engine_t *engine);
-void chip8_check_counters(chip8_engine_t *e);
+bool set_execution_engine(chip8_engine_t *engine, execution_engine_t execution_engine);
+void set_quirk_profile(chip8_engine_t *engine, quirk_profile_t quirk_profile);
+void destroy_chip8_engine(chip8_engine_t *engine);
+void invalidate_predecoded(chip8_engine_t *engine, uint16_t address, uint16_t size);
+void warm_predecoded(chip8_engine_t *engine, uint16_t start, uint16_t end);
 void update_chip8_engine(chip8_engine_t *e, bool disas);
+void skip_idle_loop(chip8_engine_t *e);
+uint64_t run_chip8_frame(chip8_engine_t *e, bool disas, chip8_dispatch_hook_t hook, void *context);
+void copy_chip8_engine(chip8_engine_t *copy, const chip8_engine_t *e);
+void load_chip8_memory(chip8_engine_t *e, uint16_t address, const uint8_t *data, uint16_t size);
+void copy_memory(const chip8_engine_t *e, uint8_t memory[MEMORY_SIZE]);
+void copy_screen(const chip8_engine_t *e, display_buffer_t buf);
+void clear_screen(chip8_engine_t *e);
+void copy_shared_page(chip8_engine_t *e, int page);
+uint64_t hash_chip8_state(const chip8_engine_t *e);
 void chip8_dump_registers(const chip8_engine_t *e);
 
+// Value of the timer at the current cycle
+static inline uint8_t get_timer(const chip8_engine_t *e, const chip8_timer_t *t)
+{
+    uint64_t ticks = e->cycles / e->cycles_per_tick - t->stamp / e->cycles_per_tick;
+
+    return ticks < t->value ? t->value - ticks : 0;
+}
+
+static inline void set_timer(const chip8_engine_t *e, chip8_timer_t *t, uint8_t value)
+{
+    t->value = value;
+    t->stamp = e->cycles;
+}
+
+/*
+ * Key of a byte value at a position, memory addresses then screen pixels, 0 for a zero byte
+ * so that zeroed memory and a clear screen hash to 0. Computed rather than tabulated,
+ * a table for every value of every address would take 8MB.
+ */
+static inline uint64_t get_zobrist_key(uint32_t position, uint8_t value)
+{
+    uint64_t z = ((uint64_t)position << 8 | value) + 0x9e3779b97f4a7c15ULL;
+
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+
+    return value ? z ^ (z >> 31) : 0;
+}
+
+static inline uint8_t read_memory(const chip8_engine_t *e, uint16_t address)
+{
+    return e->pages[address >> CHIP8_PAGE_SHIFT]->bytes[address & (CHIP8_PAGE_SIZE - 1)];
+}
+
+// Both bytes of the instruction at address, the second one wraps around to address 0 after the last address
+static inline void fetch_instruction(const chip8_engine_t *e, uint16_t address, instruction_t *i)
+{
+    decode_instruction((uint16_t)read_memory(e, address) << 8 | read_memory(e, MEMORY_ADDRESS(address + 1)), i);
+
+    i->op_code = op_codes_table[i->instruction];
+}
+
+// Rows never straddle pages
+static inline const uint8_t *get_screen_row(const chip8_engine_t *e, int y)
+{
+    uint32_t position = MEMORY_SIZE + y * CHIP8_WINDOW_WIDTH;
+
+    return &e->pages[position >> CHIP8_PAGE_SHIFT]->bytes[position & (CHIP8_PAGE_SIZE - 1)];
+}
+
+static inline uint8_t get_screen_pixel(const chip8_engine_t *e, int x, int y)
+{
+    return get_screen_row(e, y)[x];
+}
+
+/*
+ * Byte at position, memory addresses then screen pixels, updating the Zobrist hash.
+ * A page shared with forks is copied before its first write.
+ */
+static inline void write_position(chip8_engine_t *e, uint32_t position, uint8_t value, uint64_t *hash)
+{
+    int page = position >> CHIP8_PAGE_SHIFT;
+    uint8_t *byte;
+
+    if (e->pages[page]->refs > 1)
+        copy_shared_page(e, page);
+
+    byte = &e->pages[page]->bytes[position & (CHIP8_PAGE_SIZE - 1)];
+    *hash ^= get_zobrist_key(position, *byte) ^ get_zobrist_key(position, value);
+    *byte = value;
+}
+
+// Every write to memory goes through here
+static inline void write_memory(chip8_engine_t *e, uint16_t address, uint8_t value)
+{
+    write_position(e, address, value, &e->memory_hash);
+}
+
+// Every write to the screen goes through here
+static inline void write_pixel(chip8_engine_t *e, int x, int y, uint8_t color)
+{
+    write_position(e, MEMORY_SIZE + y * CHIP8_WINDOW_WIDTH + x, color, &e->screen_hash);
+}
+
 void clear_display_buffer(display_buffer_t buf);
 uint8_t get_pixel(display_buffer_t buf, int x, int y);
 void draw_pixel(display_buffer_t buf, int x, int y, uint8_t color);
\ No newline at end of file
@@ -12,6 +12,25 @@
 #define US_TO_MS(t) ((t) / 1000L)
 
 typedef struct timeval chip8_clock_t;
+typedef struct chip8_pacer_s chip8_pacer_t;
+
+// Wakes a loop up at a fixed frequency, on the monotonic clock unless another time source is set
+struct chip8_pacer_s {
+    // Deadline of the next tick in microseconds
+    long int next_tick;
+    // Period between two ticks in microseconds
+    long int period;
+    // Ticks given up by wait_pacer when too late to catch up
+    uint64_t skipped_ticks;
+    // Optional time source in microseconds, called with context
+    long int (*get_time)(void *context);
+    void *context;
+};
 
 void reset_clock(chip8_clock_t *clock);
 long int get_elapsed(const chip8_clock_t *clock);
+
+long int get_monotonic_time(void);
+void init_pacer(chip8_pacer_t *pacer, long int frequency);
+void set_pacer_time_source(chip8_pacer_t *pacer, long int (*get_time)(void *), void *context);
+void wait_pacer(chip8_pacer_t *pacer);
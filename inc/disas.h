@@ -2,8 +2,76 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <stddef.h>
 
 #include "op_codes.h"
+#include "sha1.h"
 
-void disas(const uint8_t *buf, uint16_t pc, bool debug);
-void print_instruction(uint16_t pc, const instruction_t *i);
\ No newline at end of file
+// Longest output of a single instruction in any format, ROM name excluded
+#define MAX_DISAS_RECORD_SIZE 512
+
+#define DISAS_ROM_MAGIC "C8DS"
+
+typedef enum disas_format_e disas_format_t;
+typedef struct disas_options_s disas_options_t;
+typedef struct disas_rom_s disas_rom_t;
+typedef struct disas_buffer_s disas_buffer_t;
+typedef struct disas_rom_header_s disas_rom_header_t;
+typedef struct disas_record_s disas_record_t;
+
+enum disas_format_e {
+    // One line per instruction : address, word, mnemonic and operands
+    TEXT_FORMAT,
+    // One JSON object per instruction and per line
+    JSON_FORMAT,
+    // A disas_rom_header_t then one disas_record_t per instruction, for each ROM
+    BINARY_FORMAT,
+    DISAS_FORMATS_SIZE
+};
+
+struct disas_options_s {
+    disas_format_t format;
+    // Text format : dump the fields of every instruction
+    bool debug;
+    // Text format : start the listing of every ROM with its name
+    bool named;
+    // Only count the op codes, write no listing
+    bool histogram_only;
+};
+
+struct disas_rom_s {
+    const char *name;
+    const uint8_t *content;
+    size_t size;
+    uint8_t sha1[SHA1_SIZE];
+};
+
+// Output of a whole ROM, formatted in memory then written at once
+struct disas_buffer_s {
+    char *data;
+    size_t size;
+    size_t capacity;
+};
+
+// Binary format, integers in host byte order like the ROM pack
+struct disas_rom_header_s {
+    char magic[4];
+    uint8_t sha1[SHA1_SIZE];
+    uint32_t instructions_count;
+};
+
+struct disas_record_s {
+    uint16_t pc;
+    uint16_t instruction;
+    uint8_t op_code;
+    uint8_t reserved;
+};
+
+extern const char *disas_formats_strings[DISAS_FORMATS_SIZE + 1];
+
+size_t format_instruction(char *buf, uint16_t pc, const instruction_t *i);
+void print_instruction(uint16_t pc, const instruction_t *i);
+bool disas_rom(disas_buffer_t *buf, const disas_rom_t *rom, const disas_options_t *options, uint64_t histogram[OP_CODES_SIZE]);
+bool write_disas_buffer(disas_buffer_t *buf, int fd);
+void destroy_disas_buffer(disas_buffer_t *buf);
+bool write_opcode_histogram(const uint64_t histogram[OP_CODES_SIZE], disas_format_t format, int fd);
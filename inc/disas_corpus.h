@@ -0,0 +1,47 @@
+#pragma once
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+
+#include "disas.h"
+#include "rom_pack.h"
+
+typedef struct disas_corpus_s disas_corpus_t;
+typedef struct disas_output_s disas_output_t;
+
+// Formatted ROM waiting for its turn to be written
+struct disas_output_s {
+    disas_buffer_t  buf;
+    bool            done;
+    bool            failed;
+};
+
+/*
+ * Many ROMs disassembled by a pool of worker threads.
+ * Each worker formats a whole ROM in its own buffer and leaves it to be written in turn,
+ * so the output follows the order of the ROMs whatever the thread count.
+ * The worker finding the ROM of the turn done writes it along with every done ROM after it,
+ * the others go on with the next ROM, so a slow ROM holds back the output but no worker.
+ */
+struct disas_corpus_s {
+    const char      **roms;
+    int             roms_count;
+    // ROMs are names or SHA-1 of ROMs in the pack when not NULL
+    const rom_pack_t *pack;
+    disas_options_t options;
+    int             fd;
+    // Next ROM to hand out to a worker
+    atomic_int      next_rom;
+    pthread_mutex_t lock;
+    // Guarded by lock : output of every ROM, next ROM to write, whether a worker is writing,
+    // failure of any ROM, merged op code counts
+    disas_output_t  *outputs;
+    int             turn;
+    bool            writing;
+    bool            failed;
+    uint64_t        histogram[OP_CODES_SIZE];
+};
+
+bool load_disas_rom(const rom_pack_t *pack, const char *name, disas_rom_t *rom, uint8_t **buf);
+bool disas_corpus(disas_corpus_t *corpus, int threads);
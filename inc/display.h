@@ -3,26 +3,39 @@
 #include <SDL2/SDL.h>
 #include "chip8_engine.h"
 #include "clock.h"
+#include "triple_buffer.h"
+#include "metrics.h"
+
+// Characters typed for the keys 0x0 through 0xf
+#define DEFAULT_KEY_BINDINGS "x123azeqsdwc4rfv"
 
 typedef struct display_s display_t;
-typedef struct display_event_s display_event_t;
 
 struct display_s {
     SDL_Window      *window;
     SDL_Renderer    *renderer;
     SDL_Texture     *texture;
-    chip8_clock_t   framerate_clock;
     chip8_clock_t   cap_clock;
-    int             frame_counter;
-    bool            log_framerate;
-};
-
-struct display_event_s {
-    uint8_t key;
-    bool    key_pressed;
+    // Presents and input events are counted when not NULL
+    metrics_t       *metrics;
+    // Video wall only : CPU side copy of the texture atlas, one tile per instance
+    uint8_t         *atlas;
+    int             columns;
+    int             rows;
+    // Chip8 key bound to each scancode, KEY_SIZE when unbound
+    uint8_t         keys_map[SDL_NUM_SCANCODES];
+    // Monotonic times in microseconds of the last key event and of the last present
+    long int        key_event_time;
+    long int        present_time;
+    // Id of the last frame presented by render_latest_frame
+    uint64_t        presented_frame;
 };
 
-bool init_display(display_t *display, bool log_framerate);
-bool poll_event(display_t *display, display_event_t *event);
+bool init_display(display_t *display);
+bool init_wall_display(display_t *display, int instances);
+bool set_key_bindings(display_t *display, const char *bindings);
+bool poll_keys(display_t *display, uint16_t *keys);
 bool render(display_t *display, display_buffer_t *buf);
-void destroy_display(display_t *display);
\ No newline at end of file
+bool render_latest_frame(display_t *display, triple_buffer_t *frames);
+bool render_wall(display_t *display, triple_buffer_t *frames, int instances);
+void destroy_display(display_t *display);
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "chip8_engine.h"
+#include "sha1.h"
+
+#define DEFAULT_EXPLORE_TIME        10
+// Snapshots kept by every worker thread
+#define DEFAULT_EXPLORE_CORPUS      256
+// Frames run from a snapshot before looking for something new
+#define MAX_EXPLORE_RUN_FRAMES      120
+// Distinct screens remembered, a power of two
+#define EXPLORE_SCREENS_SIZE        (1 << 20)
+#define EXPLORE_SCREENS_PROBES      32
+
+#define EXPLORE_INPUT_MAGIC         "C8IN"
+#define EXPLORE_INPUT_EXTENSION     ".c8in"
+
+typedef struct explorer_s explorer_t;
+typedef struct explore_input_header_s explore_input_header_t;
+typedef struct explore_input_s explore_input_t;
+
+/*
+ * Input file written by explore, replayed by interpret --replay.
+ * Integers are in host byte order like the ROM pack. The header holds everything a replay needs
+ * to run the same instructions, then come frames_count key masks, one per frame,
+ * indexed by cycles / instructions_per_frame at the start of the frame.
+ */
+struct explore_input_header_s {
+    char magic[4];
+    uint8_t sha1[SHA1_SIZE];
+    uint32_t rng;
+    uint32_t instructions_per_frame;
+    uint8_t quirk_profile;
+    uint8_t reserved[3];
+    uint32_t frames_count;
+};
+
+struct explore_input_s {
+    explore_input_header_t header;
+    uint16_t *keys;
+};
+
+/*
+ * Search of key sequences reaching new addresses or new screens, from the power-on state of root.
+ * Every worker thread keeps a corpus of snapshots of what was new, forks one of them, runs it
+ * with random keys and keeps the result when it found something new. Coverage and screens
+ * are shared so that the workers look for what none of them found yet.
+ */
+struct explorer_s {
+    const chip8_engine_t *root;
+    int threads;
+    int corpus_capacity;
+    // Input files reaching new addresses go there, none written when NULL
+    const char *inputs_path;
+    atomic_bool running;
+    // Set once an address was executed by any worker
+    atomic_uchar reached[MEMORY_SIZE];
+    // Open addressing set of the hashes of the screens seen, 0 for an empty entry
+    _Atomic uint64_t *screens;
+    atomic_uint_fast64_t screens_count;
+    atomic_uint_fast64_t frames;
+    atomic_uint_fast64_t snapshots;
+    atomic_uint_fast64_t inputs;
+    // Executions per address of all the workers, merged when they stop
+    pthread_mutex_t lock;
+    uint64_t hits[MEMORY_SIZE];
+    atomic_bool failed;
+};
+
+uint16_t generate_random_keys(uint32_t *state, uint16_t keys);
+
+bool init_explorer(explorer_t *explorer, const chip8_engine_t *root, int threads, int corpus_capacity, const char *inputs_path);
+bool run_explorer(explorer_t *explorer, int seconds);
+void destroy_explorer(explorer_t *explorer);
+
+bool read_explore_input(explore_input_t *input, const char *filepath);
+void destroy_explore_input(explore_input_t *input);
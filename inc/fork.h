@@ -0,0 +1,23 @@
+#pragma once
+
+#include <stdbool.h>
+
+#include "chip8_engine.h"
+
+/*
+ * Pages of the forks of a search, shared copy-on-write.
+ * Sized for capacity live forks, each referencing CHIP8_PAGES pages at most,
+ * so copying a shared page on write never runs out of pages.
+ * Not thread safe, the forks of a pool belong to a single thread.
+ */
+struct chip8_pool_s {
+    chip8_page_t *pages;
+    chip8_page_t *free;
+    int capacity;
+    int forks;
+};
+
+bool init_chip8_pool(chip8_pool_t *pool, int capacity);
+void destroy_chip8_pool(chip8_pool_t *pool);
+bool chip8_fork(chip8_pool_t *pool, chip8_engine_t *slot, const chip8_engine_t *e);
+void release_chip8_fork(chip8_engine_t *slot);
@@ -0,0 +1,9 @@
+#pragma once
+
+#include "chip8_engine.h"
+
+extern const char *fusions_strings[FUSIONS_SIZE + 1];
+extern const uint8_t fusions_lengths[FUSIONS_SIZE];
+
+void fuse_instructions(predecoded_t *p, int available);
+void print_fusions_report(const chip8_engine_t *engine);
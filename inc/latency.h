@@ -0,0 +1,70 @@
+#pragma once
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+// Histogram buckets are LATENCY_BUCKET_US wide, the last one collects everything above
+#define LATENCY_BUCKET_US   100
+#define LATENCY_BUCKETS     1000
+
+typedef enum latency_stage_e latency_stage_t;
+typedef enum latency_interval_e latency_interval_t;
+typedef struct latency_probe_s latency_probe_t;
+
+// Stages a key press goes through before it is visible, in order
+enum latency_stage_e {
+    // SDL key event received by the render thread
+    LATENCY_INPUT,
+    // New key state sampled by the emulation thread at the start of a frame
+    LATENCY_APPLIED,
+    // First SKIP_KEY, SKIPN_KEY or MOV_KEY executed with the new key state
+    LATENCY_OBSERVED,
+    // First framebuffer change after that
+    LATENCY_DRAWN,
+    // Frame holding the change handed to the render thread
+    LATENCY_PUBLISHED,
+    // SDL_RenderPresent of that frame returned
+    LATENCY_PRESENTED,
+    LATENCY_STAGES_SIZE
+};
+
+enum latency_interval_e {
+    INPUT_TO_OBSERVED,
+    OBSERVED_TO_DRAWN,
+    DRAWN_TO_PRESENTED,
+    INPUT_TO_PRESENTED,
+    LATENCY_INTERVALS_SIZE
+};
+
+/*
+ * Follows one key press at a time from the SDL event to the present that shows its effect.
+ * Each thread only stamps the stage it owns, the awaited stage acting as a handoff token.
+ * Histograms are only written by the render thread when a sample completes.
+ */
+struct latency_probe_s {
+    // Next stage to stamp, LATENCY_INPUT when no sample is in flight
+    atomic_int stage;
+    // Monotonic timestamps in microseconds of the sample in flight
+    atomic_long stamps[LATENCY_STAGES_SIZE];
+    // Id of the first published frame holding the change
+    atomic_uint_fast64_t frame_id;
+
+    uint32_t histograms[LATENCY_INTERVALS_SIZE][LATENCY_BUCKETS];
+    uint32_t samples;
+    // Samples abandoned because the ROM never reacted to them
+    uint32_t dropped;
+};
+
+void init_latency_probe(latency_probe_t *probe);
+void start_latency_sample(latency_probe_t *probe, long int input_time);
+void reach_latency_stage(latency_probe_t *probe, latency_stage_t stage);
+void publish_latency_frame(latency_probe_t *probe, uint64_t frame_id);
+void present_latency_frame(latency_probe_t *probe, uint64_t frame_id, long int present_time);
+void print_latency_report(const latency_probe_t *probe);
+
+// Cheap enough to sit in instruction handlers : a NULL probe is a disabled probe
+static inline void stamp_latency(latency_probe_t *probe, latency_stage_t stage)
+{
+    if (probe && atomic_load_explicit(&probe->stage, memory_order_relaxed) == (int)stage)
+        reach_latency_stage(probe, stage);
+}
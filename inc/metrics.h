@@ -0,0 +1,74 @@
+#pragma once
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+// Seconds between two exports by default
+#define DEFAULT_METRICS_INTERVAL    1
+// Upper bounds in microseconds of the frame time histogram buckets, the last bucket has none
+#define FRAME_TIME_BUCKETS_SIZE     10
+
+typedef enum metric_e metric_t;
+typedef struct metrics_s metrics_t;
+typedef struct metrics_exporter_s metrics_exporter_t;
+
+// Counters of the registry, all of them only ever grow
+enum metric_e {
+    INSTRUCTIONS_EXECUTED,
+    IDLE_SKIPPED_CYCLES,
+    FRAMES_EMULATED,
+    FRAMES_PRESENTED,
+    // Emulated frames published over a frame the render thread never read
+    FRAMES_DROPPED,
+    // Ticks the workers were so late they skipped them rather than catching up
+    PACER_SKIPS,
+    INPUT_EVENTS,
+    METRICS_SIZE
+};
+
+extern const char *metrics_strings[METRICS_SIZE];
+extern const long int frame_time_bounds[FRAME_TIME_BUCKETS_SIZE - 1];
+
+/*
+ * Counters shared by the worker threads and the render thread.
+ * They are only ever added to with relaxed atomics : a reader may see them a frame apart from each other,
+ * which is fine for rates, and no update ever orders or slows down the emulation.
+ */
+struct metrics_s {
+    atomic_uint_fast64_t counters[METRICS_SIZE];
+    // Time between two presents, non cumulative counts per bucket, see frame_time_bounds
+    atomic_uint_fast64_t frame_times[FRAME_TIME_BUCKETS_SIZE];
+    atomic_uint_fast64_t frame_time_sum;
+    int instances;
+    long int start_time;
+};
+
+/*
+ * Snapshots the registry every interval from the render thread :
+ * rewrites filepath in the Prometheus text format when set, and prints rates when log is set.
+ */
+struct metrics_exporter_s {
+    const char *filepath;
+    bool log;
+    long int interval;
+    long int next_export;
+    // Counters at the previous export, for rates
+    uint64_t previous[METRICS_SIZE];
+    long int previous_time;
+};
+
+void init_metrics(metrics_t *metrics, int instances);
+void add_frame_time(metrics_t *metrics, long int frame_time);
+void init_metrics_exporter(metrics_exporter_t *exporter, const char *filepath, int interval, bool log);
+bool export_metrics(metrics_exporter_t *exporter, const metrics_t *metrics, bool force);
+
+static inline void add_metric(metrics_t *m, metric_t metric, uint64_t value)
+{
+    atomic_fetch_add_explicit(&m->counters[metric], value, memory_order_relaxed);
+}
+
+static inline uint64_t get_metric(const metrics_t *m, metric_t metric)
+{
+    return atomic_load_explicit(&m->counters[metric], memory_order_relaxed);
+}
@@ -6,6 +6,8 @@ typedef enum op_code_e op_code_t;
 typedef struct instruction_s instruction_t;
 
 #define OP_CODES_SIZE 35
+// One entry per 16 bits instruction word
+#define OP_CODES_TABLE_SIZE 0x10000
 
 enum op_code_e {
     // CLEAR - Clear the display
@@ -92,5 +94,40 @@ struct instruction_s {
     op_code_t op_code;
 };
 
-void read_next_instruction(const uint8_t *buf, uint16_t pc, instruction_t *i);
-extern const char *op_codes_strings[OP_CODES_SIZE + 1];
\ No newline at end of file
+void classify_instruction_reference(instruction_t *i);
+extern const char *op_codes_strings[OP_CODES_SIZE + 1];
+// Generated at build time by tools/gen_op_codes_table.c, indexed by instruction word
+extern const uint8_t op_codes_table[OP_CODES_TABLE_SIZE];
+
+static inline void decode_instruction(uint16_t instruction, instruction_t *i)
+{
+    // http://devernay.free.fr/hacks/chip8/C8TECH10.HTM
+
+    i->instruction = instruction;
+
+    // u - A 4-bit value, the highest 4 bits of the instruction
+    i->u = (uint8_t)(i->instruction >> 12);
+
+    // nnn or addr - A 12-bit value, the lowest 12 bits of the instruction
+    i->nnn = i->instruction & 0x0fff;
+
+    // n or nibble - A 4-bit value, the lowest 4 bits of the instruction
+    i->n = i->instruction & 0x000f;
+
+    // x - A 4-bit value, the lower 4 bits of the high byte of the instruction
+    i->x = (i->instruction >> 8) & 0x000f;
+
+    // y - A 4-bit value, the upper 4 bits of the low byte of the instruction
+    i->y = (i->instruction >> 4) & 0x000f;
+
+    // kk or byte - An 8-bit value, the lowest 8 bits of the instruction
+    i->kk = i->instruction & 0x00ff;
+}
+
+static inline void read_next_instruction(const uint8_t *buf, uint16_t pc, instruction_t *i)
+{
+    // All instructions are 2 bytes long and are stored most-significant-byte first.
+    decode_instruction((uint16_t)buf[pc] << 8 | (uint16_t)buf[pc + 1], i);
+
+    i->op_code = op_codes_table[i->instruction];
+}
\ No newline at end of file
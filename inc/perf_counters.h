@@ -0,0 +1,56 @@
+#pragma once
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "chip8_engine.h"
+
+typedef enum perf_counter_e perf_counter_t;
+typedef struct perf_counters_s perf_counters_t;
+typedef struct perf_report_s perf_report_t;
+
+// Hardware events counted, in user space only
+enum perf_counter_e {
+    PERF_CYCLES,
+    PERF_INSTRUCTIONS,
+    PERF_BRANCH_MISSES,
+    PERF_L1D_MISSES,
+    PERF_COUNTERS_SIZE
+};
+
+extern const char *perf_counters_strings[PERF_COUNTERS_SIZE];
+
+/*
+ * Counters of the calling thread, opened as a single group so they are all scheduled together
+ * and their ratios stay meaningful when the PMU has to multiplex them.
+ * Counters the CPU does not support stay at -1, the cycles counter leads the group.
+ */
+struct perf_counters_s {
+    int fds[PERF_COUNTERS_SIZE];
+    // Hardware events and emulated work counted while enabled
+    uint64_t counts[PERF_COUNTERS_SIZE];
+    uint64_t instructions;
+    uint64_t frames;
+};
+
+// Counts of all threads merged, per execution engine
+struct perf_report_s {
+    pthread_mutex_t lock;
+    uint64_t counts[EXECUTION_ENGINES_SIZE][PERF_COUNTERS_SIZE];
+    bool supported[PERF_COUNTERS_SIZE];
+    uint64_t instructions[EXECUTION_ENGINES_SIZE];
+    uint64_t frames[EXECUTION_ENGINES_SIZE];
+    // Threads the counters could not be opened on
+    int failed_threads;
+};
+
+bool open_perf_counters(perf_counters_t *counters);
+void close_perf_counters(perf_counters_t *counters);
+void enable_perf_counters(perf_counters_t *counters);
+void disable_perf_counters(perf_counters_t *counters);
+bool read_perf_counters(perf_counters_t *counters);
+void init_perf_report(perf_report_t *report);
+void merge_perf_counters(perf_report_t *report, const perf_counters_t *counters, execution_engine_t execution_engine);
+void print_perf_report(const perf_report_t *report);
+void destroy_perf_report(perf_report_t *report);
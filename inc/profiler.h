@@ -0,0 +1,68 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "chip8_engine.h"
+
+// Addresses listed by the hot address report
+#define PROFILE_HOT_ADDRESSES   20
+// Distinct call stacks recorded, deeper calls are counted in their deepest recorded caller
+#define MAX_PROFILE_NODES       (1 << 16)
+#define PROFILE_ROOT            0
+#define PROFILE_NO_NODE         UINT32_MAX
+
+typedef struct profile_node_s profile_node_t;
+
+// A call stack : the subroutine at address called from the stack of parent
+struct profile_node_s {
+    uint16_t address;
+    uint32_t parent;
+    uint32_t first_child;
+    uint32_t next_sibling;
+    // Instructions executed with exactly this call stack
+    uint64_t cycles;
+    uint64_t calls;
+};
+
+/*
+ * Counts executed instructions per address and per op code,
+ * and per call stack by shadowing the CALL and RET of the ROM.
+ */
+struct profiler_s {
+    uint64_t addresses[MEMORY_SIZE];
+    uint64_t op_codes[OP_CODES_SIZE];
+    profile_node_t *nodes;
+    uint32_t nodes_count;
+    uint32_t nodes_capacity;
+    // Call stack of the instruction executing
+    uint32_t current;
+    // Calls not recorded once MAX_PROFILE_NODES is reached, their RET must not pop a node
+    uint32_t unrecorded_depth;
+};
+
+bool init_profiler(profiler_t *profiler);
+void destroy_profiler(profiler_t *profiler);
+void enter_profile_call(profiler_t *profiler, uint16_t address);
+void add_profile_iterations(profiler_t *profiler, uint16_t pc, const instruction_t *loop[], int length, uint64_t iterations);
+bool write_folded_stacks(const profiler_t *profiler, const char *filepath);
+void print_profile_report(const profiler_t *profiler, const chip8_engine_t *e);
+
+/*
+ * Count the instruction executed at pc, then follow the call stack as exec_call and exec_ret do.
+ * CALL and RET count in the stack of the caller and of the subroutine respectively.
+ */
+static inline void record_profile(profiler_t *p, uint16_t pc, const instruction_t *i)
+{
+    p->addresses[pc & (MEMORY_SIZE - 1)]++;
+    p->op_codes[i->op_code]++;
+    p->nodes[p->current].cycles++;
+
+    if (i->op_code == CALL)
+        enter_profile_call(p, i->nnn);
+    else if (i->op_code == RET && p->unrecorded_depth)
+        p->unrecorded_depth--;
+    // A RET without any shadowed CALL leaves the profile at the root
+    else if (i->op_code == RET && p->current != PROFILE_ROOT)
+        p->current = p->nodes[p->current].parent;
+}
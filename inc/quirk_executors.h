@@ -0,0 +1,7 @@
+#pragma once
+
+#include "instructions_executors.h"
+#include "quirks.h"
+
+// Executor of every op code, one table per quirk profile
+extern const instruction_handler_t executors_tables[QUIRK_PROFILES_SIZE][OP_CODES_SIZE];
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef enum quirk_profile_e quirk_profile_t;
+typedef struct quirks_s quirks_t;
+
+enum quirk_profile_e {
+    // Behavior this interpreter always had, following Cowgod's technical reference
+    MODERN_PROFILE,
+    // Original COSMAC VIP interpreter
+    VIP_PROFILE,
+    // CHIP-48 on the HP-48
+    CHIP48_PROFILE,
+    // SUPER-CHIP 1.1
+    SCHIP_PROFILE,
+    QUIRK_PROFILES_SIZE
+};
+
+#define DEFAULT_QUIRK_PROFILE MODERN_PROFILE
+
+// FX55 / FX65 : I is left at I + x + 1, at I + x, or unchanged
+#define I_INCREMENT_X_PLUS_ONE  1
+#define I_INCREMENT_X           0
+#define I_UNCHANGED             (-1)
+
+/*
+ * Quirks of each profile, in this order :
+ * shift_vy, i_increment, vf_reset, jump_vx, clip_sprites, display_wait
+ *
+ * They are expanded as compile time constants into the handlers of each profile,
+ * see quirk_executors.c, so selecting a profile costs no branch when executing.
+ */
+#define MODERN_QUIRKS   0, I_INCREMENT_X_PLUS_ONE,  0, 0, 0, 0
+#define VIP_QUIRKS      1, I_INCREMENT_X_PLUS_ONE,  1, 0, 1, 1
+#define CHIP48_QUIRKS   0, I_INCREMENT_X,           0, 1, 1, 0
+#define SCHIP_QUIRKS    0, I_UNCHANGED,             0, 1, 1, 0
+
+// Calls M(name, profile, quirks, ...) for every quirk profile
+#define FOR_EACH_QUIRK_PROFILE(M, ...)                      \
+    M(modern, MODERN_PROFILE, MODERN_QUIRKS, __VA_ARGS__)   \
+    M(vip, VIP_PROFILE, VIP_QUIRKS, __VA_ARGS__)            \
+    M(chip48, CHIP48_PROFILE, CHIP48_QUIRKS, __VA_ARGS__)   \
+    M(schip, SCHIP_PROFILE, SCHIP_QUIRKS, __VA_ARGS__)
+
+struct quirks_s {
+    // 8XY6 / 8XYE : shift Vy into Vx, rather than Vx in place
+    bool shift_vy;
+    // FX55 / FX65 : one of the I_INCREMENT_* or I_UNCHANGED values
+    int8_t i_increment;
+    // 8XY1 / 8XY2 / 8XY3 : reset VF after the logic operation
+    bool vf_reset;
+    // BNNN : jump to nnn + Vx, x being the highest nibble of nnn, rather than nnn + V0
+    bool jump_vx;
+    // DXYN : clip sprites at the edges of the screen rather than wrapping them around
+    bool clip_sprites;
+    // DXYN : wait for the start of a frame before drawing
+    bool display_wait;
+};
+
+extern const char *quirk_profiles_strings[QUIRK_PROFILES_SIZE + 1];
+extern const quirks_t quirk_profiles[QUIRK_PROFILES_SIZE];
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "quirks.h"
+#include "sha1.h"
+
+typedef struct rom_entry_s rom_entry_t;
+
+// Settings a ROM is known to run best with
+struct rom_entry_s {
+    uint8_t sha1[SHA1_SIZE];
+    const char *title;
+    int instructions_per_frame;
+    quirk_profile_t quirk_profile;
+    // Key bindings, see set_key_bindings, NULL for the default ones
+    const char *key_bindings;
+    // Address of a loop waiting for the delay timer, 0 when unknown
+    uint16_t idle_loop;
+};
+
+const rom_entry_t *get_rom_entry(const uint8_t sha1[SHA1_SIZE]);
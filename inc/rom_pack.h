@@ -0,0 +1,59 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "sha1.h"
+
+#define ROM_PACK_MAGIC      "C8PK"
+#define ROM_PACK_VERSION    1
+
+typedef struct rom_pack_header_s rom_pack_header_t;
+typedef struct packed_rom_s packed_rom_t;
+typedef struct packed_name_s packed_name_t;
+typedef struct rom_pack_s rom_pack_t;
+
+/*
+ * A ROM pack holds many ROMs in a single file, meant to be mapped once and read in place.
+ * All integers are in host byte order, a pack is not portable across endianness.
+ *
+ * header | roms[roms_count] | names[names_count] | name strings | contents
+ *
+ * Contents are deduplicated : every distinct ROM is stored once, in roms sorted by SHA-1,
+ * and all the file names it was packed from point to it from names, sorted by name.
+ */
+struct rom_pack_header_s {
+    char magic[4];
+    uint32_t version;
+    uint32_t roms_count;
+    uint32_t names_count;
+};
+
+struct packed_rom_s {
+    uint8_t sha1[SHA1_SIZE];
+    uint32_t size;
+    // From the start of the pack, contents are padded to an even size
+    uint32_t offset;
+};
+
+struct packed_name_s {
+    // From the start of the pack, to a NUL terminated string
+    uint32_t name_offset;
+    // Index in roms
+    uint32_t rom;
+};
+
+struct rom_pack_s {
+    const uint8_t *map;
+    size_t size;
+    const rom_pack_header_t *header;
+    const packed_rom_t *roms;
+    const packed_name_t *names;
+};
+
+bool write_rom_pack(const char *filepath, const char **roms, int roms_count);
+bool open_rom_pack(rom_pack_t *pack, const char *filepath);
+void close_rom_pack(rom_pack_t *pack);
+const packed_rom_t *find_packed_rom(const rom_pack_t *pack, const char *name_or_sha1);
+const uint8_t *get_packed_rom_content(const rom_pack_t *pack, const packed_rom_t *rom);
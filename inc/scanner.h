@@ -0,0 +1,78 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "chip8_engine.h"
+
+#define DEFAULT_SCAN_INSTANCES  256
+// Candidates listed by print_scan_candidates, the ones kept by most instances first
+#define MAX_SCAN_RESULTS        32
+
+typedef struct scanner_s scanner_t;
+typedef struct scan_step_s scan_step_t;
+typedef enum scan_filter_e scan_filter_t;
+typedef enum scan_step_kind_e scan_step_kind_t;
+
+// Bytes kept by a filter, comparing their value now with their value at the previous filter
+enum scan_filter_e {
+    EQUAL_FILTER,
+    CHANGED_FILTER,
+    UNCHANGED_FILTER,
+    INCREASED_FILTER,
+    DECREASED_FILTER,
+    SCAN_FILTERS_SIZE
+};
+
+enum scan_step_kind_e {
+    // Run frames holding the keys of every instance
+    FRAMES_STEP,
+    // Run frames with random keys, each instance its own, see generate_random_keys
+    RANDOM_STEP,
+    // Hold keys on every instance
+    KEYS_STEP,
+    FILTER_STEP,
+};
+
+/*
+ * One argument of the scan command : frames:N, random:N, keys:KEYS with KEYS the hexadecimal keys held
+ * or - for none, eq:VALUE or the name of a filter.
+ */
+struct scan_step_s {
+    scan_step_kind_t kind;
+    int frames;
+    uint16_t keys;
+    scan_filter_t filter;
+    uint8_t value;
+};
+
+/*
+ * Search of the memory bytes of many instances behaving as asked, such as a score increasing
+ * when a point is won and unchanged otherwise. Every byte of every instance is a candidate at first,
+ * each filter keeps the candidates matching it in their instance.
+ * Memories are saved side by side, so that a filter is a few vector operations over all the instances at once.
+ */
+struct scanner_s {
+    chip8_engine_t *engines;
+    int instances;
+    int threads;
+    // Per instance : state of its random keys and keys held
+    uint32_t *random;
+    uint16_t *keys;
+    // Memory of instance n at n * MEMORY_SIZE, as of the previous filter
+    uint8_t *snapshot;
+    // Memory being compared with the snapshot, then swapped with it
+    uint8_t *capture;
+    // 0xff while the byte of the instance is a candidate, 0 once filtered out
+    uint8_t *candidates;
+};
+
+extern const char *scan_filters_strings[SCAN_FILTERS_SIZE + 1];
+
+bool parse_scan_step(const char *str, scan_step_t *step);
+
+bool init_scanner(scanner_t *scanner, chip8_engine_t *engines, int instances, int threads);
+uint64_t run_scan_step(scanner_t *scanner, const scan_step_t *step);
+uint64_t count_scan_candidates(const scanner_t *scanner, uint32_t counts[MEMORY_SIZE]);
+void print_scan_candidates(const scanner_t *scanner);
+void destroy_scanner(scanner_t *scanner);
@@ -0,0 +1,10 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define SHA1_SIZE 20
+
+void compute_sha1(const uint8_t *data, size_t size, uint8_t digest[SHA1_SIZE]);
+bool parse_sha1(const char *str, uint8_t sha1[SHA1_SIZE]);
@@ -0,0 +1,5 @@
+#pragma once
+
+#include "instructions_executors.h"
+
+instruction_handler_t get_specialized_handler(const instruction_t *i, const quirks_t *quirks);
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "chip8_engine.h"
+#include "disas.h"
+
+#define TRACE_MAGIC             "C8TR"
+#define TRACE_VERSION           1
+// Records kept by default, the oldest are overwritten past this count
+#define DEFAULT_TRACE_CAPACITY  (1 << 20)
+
+// Register field of records changing Vx, see trace_registers, I, or no register at all
+#define TRACE_REGISTER_X        0
+#define TRACE_REGISTER_I        0x10
+#define TRACE_NO_REGISTER       0xff
+
+typedef struct trace_filter_s trace_filter_t;
+typedef struct trace_header_s trace_header_t;
+typedef struct trace_record_s trace_record_t;
+
+// Executed instructions recorded : pc in [low, high] and op code bit set in op_codes
+struct trace_filter_s {
+    uint16_t low;
+    uint16_t high;
+    uint64_t op_codes;
+};
+
+/*
+ * A trace file is a header followed by a ring of capacity records, in host byte order.
+ * Record n is at index n % capacity, the last min(head, capacity) records are the valid ones.
+ */
+struct trace_header_s {
+    char magic[4];
+    uint32_t version;
+    // Power of two
+    uint64_t capacity;
+    // Records written since the start
+    uint64_t head;
+    uint8_t sha1[SHA1_SIZE];
+    trace_filter_t filter;
+};
+
+struct trace_record_s {
+    uint64_t cycle;
+    uint16_t pc;
+    uint16_t instruction;
+    uint8_t op_code;
+    // Vx, TRACE_REGISTER_I or TRACE_NO_REGISTER
+    uint8_t reg;
+    // Value of reg once executed
+    uint16_t value;
+};
+
+struct trace_s {
+    trace_header_t *header;
+    trace_record_t *records;
+    size_t map_size;
+    uint64_t mask;
+    trace_filter_t filter;
+};
+
+// Register each op code writes, see record_trace
+extern const uint8_t trace_registers[OP_CODES_SIZE];
+
+bool init_trace(trace_t *trace, const char *filepath, uint64_t capacity, const trace_filter_t *filter, const uint8_t sha1[SHA1_SIZE]);
+bool open_trace(trace_t *trace, const char *filepath);
+void destroy_trace(trace_t *trace);
+uint64_t get_trace_first(const trace_t *trace);
+const trace_record_t *get_trace_record(const trace_t *trace, uint64_t n);
+size_t format_trace_record(char *buf, const trace_record_t *record, disas_format_t format);
+void init_trace_filter(trace_filter_t *filter);
+bool parse_trace_range(const char *str, uint16_t *low, uint16_t *high);
+bool parse_trace_op_codes(const char *str, uint64_t *op_codes);
+
+/*
+ * Append the instruction executed at cycle to the trace, with the register it wrote read from the engine.
+ * Within a fused sequence registers are read once the whole sequence is executed.
+ */
+static inline void record_trace(trace_t *t, const chip8_engine_t *e, uint64_t cycle, uint16_t pc, const instruction_t *i)
+{
+    if (pc < t->filter.low || pc > t->filter.high || !(t->filter.op_codes >> i->op_code & 1))
+        return;
+
+    trace_record_t *r = &t->records[t->header->head++ & t->mask];
+    uint8_t reg = trace_registers[i->op_code];
+
+    r->cycle = cycle;
+    r->pc = pc;
+    r->instruction = i->instruction;
+    r->op_code = i->op_code;
+
+    if (reg == TRACE_NO_REGISTER) {
+        r->reg = TRACE_NO_REGISTER;
+        r->value = 0;
+    } else if (reg == TRACE_REGISTER_I) {
+        r->reg = TRACE_REGISTER_I;
+        r->value = e->i;
+    } else {
+        r->reg = i->x;
+        r->value = e->v[i->x];
+    }
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "chip8_engine.h"
+
+typedef struct frame_s frame_t;
+typedef struct triple_buffer_s triple_buffer_t;
+
+struct frame_s {
+    display_buffer_t pixels;
+    // Monotonic id of the frame, assigned by the writer
+    uint64_t id;
+};
+
+/*
+ * Single producer / single consumer frame handoff.
+ *
+ * The writer always owns the back frame and the reader always owns the front frame.
+ * Publishing and reading swap them with the middle frame in a single atomic exchange,
+ * so neither side ever waits on the other and the reader only sees completed frames.
+ */
+struct triple_buffer_s {
+    frame_t frames[3];
+    // Index of the middle frame, ORed with TRIPLE_BUFFER_FRESH when it has not been read yet
+    atomic_uint_fast8_t middle;
+    // Writer side
+    uint8_t back;
+    uint64_t published;
+    // Frames published over a middle frame the reader never read
+    uint64_t overwritten;
+    // Reader side
+    uint8_t front;
+};
+
+void init_triple_buffer(triple_buffer_t *tb);
+frame_t *get_back_frame(triple_buffer_t *tb);
+void publish_back_frame(triple_buffer_t *tb);
+const frame_t *get_latest_frame(triple_buffer_t *tb, bool *fresh);
@@ -2,7 +2,10 @@
 
 #include <stddef.h>
 #include <stdint.h>
+#include <stdbool.h>
 
 uint8_t *read_file_offset(const char *filepath, int offset, size_t *prog_size, long max_size);
 bool load_file_to_memory(const char *filepath, uint8_t memory[], uint16_t *prog_size, long memory_size);
-uint8_t generate_random_byte();
\ No newline at end of file
+uint32_t generate_random(uint32_t *state);
+uint8_t generate_random_byte(uint32_t *state);
+bool parse_positive_int(const char *str, int *value);
\ No newline at end of file
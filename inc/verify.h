@@ -0,0 +1,50 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#include "chip8_engine.h"
+
+// Instructions between two comparisons by default
+#define DEFAULT_VERIFY_INTERVAL     10000
+// Differing memory addresses and screen rows listed by a divergence report
+#define MAX_VERIFY_DIFFERENCES      16
+
+typedef struct verifier_s verifier_t;
+typedef struct verify_keys_s verify_keys_t;
+
+// Keys of the frame starting at cycle
+struct verify_keys_s {
+    uint64_t cycle;
+    uint16_t keys;
+};
+
+/*
+ * Runs a reference engine in the shadow of a verified engine, up to the same cycle after every frame,
+ * and compares the hashes of their states every interval instructions.
+ * On a difference, the verified engine is replayed from the last state they agreed on, in lockstep with
+ * a reference engine, to the first dispatch after which they differ, and both states are dumped.
+ */
+struct verifier_s {
+    chip8_engine_t shadow;
+    // Verified engine, predecoded instructions included, when the states last agreed
+    chip8_engine_t checkpoint;
+    predecoded_t *checkpoint_predecoded;
+    uint64_t interval;
+    uint64_t next_check;
+    // Keys of the frames since the checkpoint, replayed with it
+    verify_keys_t *keys;
+    size_t keys_count;
+    size_t keys_capacity;
+    uint64_t checks;
+    // The verified engine fast forwards its idle loops, replays do the same
+    bool skip_idle;
+    bool diverged;
+    int instance;
+};
+
+bool init_verifier(verifier_t *verifier, const chip8_engine_t *e, uint64_t interval, int instance);
+void destroy_verifier(verifier_t *verifier);
+void start_verify_frame(verifier_t *verifier, const chip8_engine_t *e);
+void verify_frame(verifier_t *verifier, const chip8_engine_t *e);
@@ -0,0 +1,116 @@
+#include <SDL2/SDL.h>
+
+#include "audio.h"
+#include "clock.h"
+
+static void fill_audio(void *userdata, Uint8 *stream, int len)
+{
+    audio_t *a = userdata;
+    int16_t *samples = (int16_t *)stream;
+    int count = len / (int)sizeof(int16_t);
+    bool playing = atomic_load_explicit(&a->playing, memory_order_relaxed);
+
+    for (int s = 0; s < count; s++) {
+        // A stopped tone still ends its current period, cutting it mid-way clicks
+        if (!playing && !a->phase) {
+            memset(samples + s, 0, (count - s) * sizeof(int16_t));
+            break;
+        }
+
+        samples[s] = a->wave[a->phase];
+        if (++a->phase == a->wave_length)
+            a->phase = 0;
+    }
+
+    unsigned int sequence = atomic_load_explicit(&a->clock_sequence, memory_order_relaxed);
+
+    atomic_store_explicit(&a->clock_sequence, sequence + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&a->played_samples, atomic_load_explicit(&a->played_samples, memory_order_relaxed) + count, memory_order_relaxed);
+    atomic_store_explicit(&a->callback_time, get_monotonic_time(), memory_order_relaxed);
+    atomic_store_explicit(&a->clock_sequence, sequence + 2, memory_order_release);
+}
+
+bool init_audio(audio_t *a)
+{
+    SDL_AudioSpec wanted = {
+        .freq = AUDIO_SAMPLE_RATE,
+        .format = AUDIO_S16SYS,
+        .channels = 1,
+        .samples = AUDIO_BUFFER_SAMPLES,
+        .callback = &fill_audio,
+        .userdata = a
+    };
+    SDL_AudioSpec obtained;
+
+    a->device = 0;
+    a->phase = 0;
+    atomic_init(&a->playing, false);
+    atomic_init(&a->clock_sequence, 0);
+    atomic_init(&a->played_samples, 0);
+    atomic_init(&a->callback_time, get_monotonic_time());
+
+    if (SDL_InitSubSystem(SDL_INIT_AUDIO)) {
+        dprintf(2, "Error : unable to init SDL2 audio : %s\n", SDL_GetError());
+        return true;
+    }
+
+    a->device = SDL_OpenAudioDevice(NULL, 0, &wanted, &obtained, SDL_AUDIO_ALLOW_FREQUENCY_CHANGE);
+    if (!a->device) {
+        dprintf(2, "Error : unable to open audio device : %s\n", SDL_GetError());
+        return true;
+    }
+
+    a->sample_rate = obtained.freq;
+    a->buffer_samples = obtained.samples;
+    a->wave_length = obtained.freq / AUDIO_TONE_FREQUENCY;
+    if (a->wave_length > AUDIO_MAX_WAVE_LENGTH)
+        a->wave_length = AUDIO_MAX_WAVE_LENGTH;
+
+    for (int s = 0; s < a->wave_length; s++)
+        a->wave[s] = s < a->wave_length / 2 ? AUDIO_AMPLITUDE : -AUDIO_AMPLITUDE;
+
+    SDL_PauseAudioDevice(a->device, 0);
+
+    return false;
+}
+
+void set_audio_playing(audio_t *a, bool playing)
+{
+    atomic_store_explicit(&a->playing, playing, memory_order_relaxed);
+}
+
+/*
+ * Microseconds of audio consumed by the device.
+ * The callback only runs once per buffer, so the time elapsed since then is added,
+ * capped to one buffer to keep the clock monotonic.
+ */
+long int get_audio_time(void *audio)
+{
+    audio_t *a = audio;
+    unsigned int sequence;
+    long int samples;
+    long int callback_time;
+
+    do {
+        sequence = atomic_load_explicit(&a->clock_sequence, memory_order_acquire);
+        samples = atomic_load_explicit(&a->played_samples, memory_order_relaxed);
+        callback_time = atomic_load_explicit(&a->callback_time, memory_order_relaxed);
+        atomic_thread_fence(memory_order_acquire);
+    } while (sequence & 1 || sequence != atomic_load_explicit(&a->clock_sequence, memory_order_relaxed));
+
+    long int since_callback = get_monotonic_time() - callback_time;
+    long int buffer_time = S_TO_US((long int)a->buffer_samples) / a->sample_rate;
+
+    if (since_callback > buffer_time)
+        since_callback = buffer_time;
+
+    return S_TO_US(samples) / a->sample_rate + since_callback;
+}
+
+void destroy_audio(audio_t *a)
+{
+    if (a->device)
+        SDL_CloseAudioDevice(a->device);
+    a->device = 0;
+}
@@ -0,0 +1,362 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "batch.h"
+#include "cfg.h"
+#include "utils.h"
+
+// Load the ROM file, or the ROM of the pack with this name or SHA-1 when pack is not NULL
+static bool load_instance_rom(chip8_engine_t *e, const rom_pack_t *pack, const char *rom)
+{
+    const packed_rom_t *packed;
+
+    if (!pack) {
+        uint8_t content[MAX_PROG_SIZE];
+
+        if (load_file_to_memory(rom, content, &e->prog_size, MAX_PROG_SIZE))
+            return true;
+
+        load_chip8_memory(e, INITIAL_PROGRAM_COUNTER, content, e->prog_size);
+        compute_sha1(content, e->prog_size, e->sha1);
+        e->rom = get_rom_entry(e->sha1);
+        return false;
+    }
+
+    packed = find_packed_rom(pack, rom);
+    if (!packed) {
+        dprintf(2, "%s : no such ROM in the pack\n", rom);
+        return true;
+    }
+
+    load_chip8_memory(e, INITIAL_PROGRAM_COUNTER, get_packed_rom_content(pack, packed), packed->size);
+    e->prog_size = packed->size;
+    memcpy(e->sha1, packed->sha1, SHA1_SIZE);
+    e->rom = get_rom_entry(e->sha1);
+
+    return false;
+}
+
+/*
+ * Instances cycle through the given ROMs, files or names in pack when it is not NULL.
+ * Each is tuned from the ROM database when its ROM is known.
+ */
+bool init_batch(batch_t *b, const char **roms, int roms_count, const rom_pack_t *pack, int instances, int threads)
+{
+    memset(b, 0, sizeof(batch_t));
+
+    if (threads > instances)
+        threads = instances;
+
+    b->engines = calloc(instances, sizeof(chip8_engine_t));
+    b->frames = calloc(instances, sizeof(triple_buffer_t));
+    b->workers = calloc(threads, sizeof(batch_worker_t));
+    if (!b->engines || !b->frames || !b->workers) {
+        dprintf(2, "calloc failed\n");
+        destroy_batch(b);
+        return true;
+    }
+
+    b->instances = instances;
+    b->threads = threads;
+    atomic_init(&b->running, false);
+    atomic_init(&b->keys, 0);
+
+    for (int n = 0; n < instances; n++) {
+        chip8_engine_t *e = &b->engines[n];
+
+        init_chip8_engine(e);
+        init_triple_buffer(&b->frames[n]);
+
+        if (load_instance_rom(e, pack, roms[n % roms_count])) {
+            destroy_batch(b);
+            return true;
+        }
+
+        if (e->rom) {
+            e->cycles_per_tick = e->rom->instructions_per_frame;
+            e->idle_loop = e->rom->idle_loop;
+            set_quirk_profile(e, e->rom->quirk_profile);
+        }
+    }
+
+    for (int t = 0; t < threads; t++) {
+        b->workers[t].batch = b;
+        b->workers[t].first = t * instances / threads;
+        b->workers[t].last = (t + 1) * instances / threads;
+    }
+
+    return false;
+}
+
+static void dump_registers(chip8_engine_t *e, uint16_t pc, void *context)
+{
+    (void)pc;
+    (void)context;
+    chip8_dump_registers(e);
+}
+
+// Counts of the frame are added to the counters of the worker, see metrics_t
+static void run_instance_frame(batch_t *b, int n, uint64_t counters[METRICS_SIZE])
+{
+    chip8_engine_t *e = &b->engines[n];
+    uint64_t frame_start = e->cycles;
+    uint64_t overwritten = b->frames[n].overwritten;
+
+    // The probe hands the sample over once the new key state is visible to this thread
+    stamp_latency(e->latency, LATENCY_APPLIED);
+    e->keyboard = atomic_load_explicit(&b->keys, memory_order_relaxed);
+    if (b->script && e->cycles / e->cycles_per_tick < b->script_frames)
+        e->keyboard = b->script[e->cycles / e->cycles_per_tick];
+    if (b->verifiers)
+        start_verify_frame(&b->verifiers[n], e);
+
+    counters[IDLE_SKIPPED_CYCLES] += run_chip8_frame(e, b->disas, b->dump_regs ? &dump_registers : NULL, NULL);
+
+    counters[INSTRUCTIONS_EXECUTED] += e->cycles - frame_start;
+    counters[FRAMES_EMULATED]++;
+
+    if (b->verifiers)
+        verify_frame(&b->verifiers[n], e);
+
+    if (n == 0 && b->audio)
+        set_audio_playing(b->audio, get_timer(e, &e->sound) > 0);
+
+    if (!e->draw_flag)
+        return;
+
+    copy_screen(e, get_back_frame(&b->frames[n])->pixels);
+    publish_back_frame(&b->frames[n]);
+    counters[FRAMES_DROPPED] += b->frames[n].overwritten - overwritten;
+    e->draw_flag = false;
+
+    if (e->latency)
+        publish_latency_frame(e->latency, b->frames[n].published);
+}
+
+static void *run_worker(void *arg)
+{
+    batch_worker_t *w = arg;
+    batch_t *b = w->batch;
+    chip8_pacer_t pacer;
+
+    perf_counters_t perf;
+    bool counting = false;
+
+    init_pacer(&pacer, FREQUENCY);
+    if (b->audio && b->audio_clock)
+        set_pacer_time_source(&pacer, &get_audio_time, b->audio);
+
+    // Counters are per thread, so they are opened by the thread they count
+    if (b->perf)
+        counting = !open_perf_counters(&perf);
+
+    while (atomic_load_explicit(&b->running, memory_order_relaxed)) {
+        uint64_t counters[METRICS_SIZE] = {0};
+        uint64_t skipped_ticks = pacer.skipped_ticks;
+
+        // Only around the execution loop, neither the pacer nor the exports are counted
+        if (counting)
+            enable_perf_counters(&perf);
+
+        for (int n = w->first; n < w->last; n++)
+            run_instance_frame(b, n, counters);
+
+        if (counting) {
+            disable_perf_counters(&perf);
+            perf.instructions += counters[INSTRUCTIONS_EXECUTED] - counters[IDLE_SKIPPED_CYCLES];
+            perf.frames += counters[FRAMES_EMULATED];
+        }
+
+        wait_pacer(&pacer);
+        counters[PACER_SKIPS] = pacer.skipped_ticks - skipped_ticks;
+
+        // Once per worker frame rather than per instance, instances would all share the same cache lines
+        for (int k = 0; b->metrics && k < METRICS_SIZE; k++)
+            if (counters[k])
+                add_metric(b->metrics, k, counters[k]);
+    }
+
+    // Instances of a batch all run the same execution engine
+    if (b->perf) {
+        if (counting && read_perf_counters(&perf))
+            close_perf_counters(&perf);
+        merge_perf_counters(b->perf, &perf, b->engines[w->first].execution_engine);
+        close_perf_counters(&perf);
+    }
+
+    return NULL;
+}
+
+bool set_batch_execution_engine(batch_t *b, execution_engine_t execution_engine)
+{
+    for (int n = 0; n < b->instances; n++)
+        if (set_execution_engine(&b->engines[n], execution_engine))
+            return true;
+
+    return false;
+}
+
+// Timers tick once per frame, so this is also the number of cycles per timer tick
+void set_batch_instructions_per_frame(batch_t *b, int instructions_per_frame)
+{
+    for (int n = 0; n < b->instances; n++)
+        b->engines[n].cycles_per_tick = instructions_per_frame;
+}
+
+void set_batch_quirk_profile(batch_t *b, quirk_profile_t quirk_profile)
+{
+    for (int n = 0; n < b->instances; n++)
+        set_quirk_profile(&b->engines[n], quirk_profile);
+}
+
+/*
+ * Predecode the basic blocks listed in the block index, see write_block_index,
+ * in every instance running the ROM it was built from.
+ * Must follow the choice of execution engine and quirk profile, which reset the predecoded instructions.
+ */
+bool warm_batch(batch_t *b, const char *index_path)
+{
+    cfg_t *index = malloc(sizeof(cfg_t));
+    uint8_t sha1[SHA1_SIZE];
+    int warmed = 0;
+
+    if (!index) {
+        dprintf(2, "malloc failed\n");
+        return true;
+    }
+
+    if (read_block_index(index, sha1, index_path)) {
+        free(index);
+        return true;
+    }
+
+    for (int n = 0; n < b->instances; n++) {
+        chip8_engine_t *e = &b->engines[n];
+
+        if (memcmp(e->sha1, sha1, SHA1_SIZE))
+            continue;
+
+        for (int block = 0; block < index->blocks_count; block++)
+            warm_predecoded(e, index->blocks[block].start, index->blocks[block].end);
+        warmed++;
+    }
+
+    if (!warmed)
+        dprintf(2, "Warning : %s : built from another ROM\n", index_path);
+
+    destroy_cfg(index);
+    free(index);
+
+    return false;
+}
+
+/*
+ * Record the instructions executed by every instance, to filepath when there is a single instance,
+ * to filepath.n for instance n otherwise.
+ */
+bool set_batch_trace(batch_t *b, const char *filepath, uint64_t capacity, const trace_filter_t *filter)
+{
+    size_t size = strlen(filepath) + 16;
+    char path[size];
+
+    b->traces = calloc(b->instances, sizeof(trace_t));
+    if (!b->traces) {
+        dprintf(2, "calloc failed\n");
+        return true;
+    }
+
+    for (int n = 0; n < b->instances; n++) {
+        if (b->instances == 1)
+            snprintf(path, size, "%s", filepath);
+        else
+            snprintf(path, size, "%s.%d", filepath, n);
+
+        if (init_trace(&b->traces[n], path, capacity, filter, b->engines[n].sha1))
+            return true;
+
+        b->engines[n].trace = &b->traces[n];
+    }
+
+    return false;
+}
+
+/*
+ * Run a reference engine in the shadow of every instance, comparing their states every interval instructions.
+ * Call once the engines, the disas option and the traces are set up, the shadows start from their current state.
+ */
+bool set_batch_verify(batch_t *b, uint64_t interval)
+{
+    b->verifiers = calloc(b->instances, sizeof(verifier_t));
+    if (!b->verifiers) {
+        dprintf(2, "calloc failed\n");
+        return true;
+    }
+
+    for (int n = 0; n < b->instances; n++) {
+        if (init_verifier(&b->verifiers[n], &b->engines[n], interval, n))
+            return true;
+        b->verifiers[n].skip_idle = !b->disas && !b->engines[n].trace;
+    }
+
+    return false;
+}
+
+int count_batch_divergences(const batch_t *b)
+{
+    int diverged = 0;
+
+    for (int n = 0; b->verifiers && n < b->instances; n++)
+        diverged += b->verifiers[n].diverged;
+
+    return diverged;
+}
+
+bool start_batch(batch_t *b)
+{
+    atomic_store(&b->running, true);
+
+    for (int t = 0; t < b->threads; t++) {
+        int err = pthread_create(&b->workers[t].thread, NULL, &run_worker, &b->workers[t]);
+
+        if (err) {
+            dprintf(2, "unable to start worker thread : %s\n", strerror(err));
+            b->threads = t;
+            stop_batch(b);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void stop_batch(batch_t *b)
+{
+    atomic_store(&b->running, false);
+
+    for (int t = 0; t < b->threads; t++)
+        pthread_join(b->workers[t].thread, NULL);
+}
+
+void set_batch_keys(batch_t *b, uint16_t keys)
+{
+    atomic_store_explicit(&b->keys, keys, memory_order_relaxed);
+}
+
+void destroy_batch(batch_t *b)
+{
+    for (int n = 0; b->engines && n < b->instances; n++)
+        destroy_chip8_engine(&b->engines[n]);
+
+    for (int n = 0; b->traces && n < b->instances; n++)
+        destroy_trace(&b->traces[n]);
+
+    for (int n = 0; b->verifiers && n < b->instances; n++)
+        destroy_verifier(&b->verifiers[n]);
+
+    free(b->traces);
+    free(b->verifiers);
+    free(b->engines);
+    free(b->frames);
+    free(b->workers);
+}
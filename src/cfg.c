@@ -0,0 +1,394 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cfg.h"
+#include "disas.h"
+
+/*
+ * Recursive traversal disassembler.
+ *
+ * Starting from the entry point, instructions are decoded along every path the program can take,
+ * so bytes never reached, sprites and other data, are not mistaken for code.
+ * Instructions with successors other than the next one end a basic block, and their targets start one.
+ */
+
+static bool is_in_rom(const cfg_t *cfg, uint16_t address)
+{
+    return address >= INITIAL_PROGRAM_COUNTER && address + 1 < cfg->end + (cfg->end & 1);
+}
+
+/*
+ * Successors of the instruction at pc other than pc + 2 by falling through.
+ * Returns true when the instruction ends a basic block.
+ */
+static bool get_branches(const instruction_t *i, uint16_t pc, uint16_t successors[MAX_BLOCK_SUCCESSORS], uint8_t *count)
+{
+    *count = 0;
+
+    switch (i->op_code) {
+        case JMP_NNN:
+            successors[(*count)++] = i->nnn;
+            return true;
+        case CALL:
+            // The subroutine is a separate graph, the call returns to the next instruction
+            successors[(*count)++] = pc + 2;
+            return true;
+        case SKIP_X_KK:
+        case SKIPN_X_KK:
+        case SKIP_X_Y:
+        case SKIPN_X_Y:
+        case SKIP_KEY:
+        case SKIPN_KEY:
+            successors[(*count)++] = pc + 2;
+            successors[(*count)++] = pc + 4;
+            return true;
+        case RET:
+        case JMP_V0_NNN:
+            return true;
+        default:
+            return false;
+    }
+}
+
+static void push_address(cfg_t *cfg, uint16_t *stack, int *stack_size, uint16_t address, uint8_t flags)
+{
+    if (!is_in_rom(cfg, address))
+        return;
+
+    if (!(cfg->flags[address] & BLOCK_LEADER))
+        stack[(*stack_size)++] = address;
+
+    cfg->flags[address] |= BLOCK_LEADER | flags;
+}
+
+static void trace_code(cfg_t *cfg)
+{
+    // Every address is pushed at most once, when it becomes a leader
+    uint16_t stack[MEMORY_SIZE];
+    int stack_size = 0;
+
+    push_address(cfg, stack, &stack_size, INITIAL_PROGRAM_COUNTER, 0);
+
+    while (stack_size) {
+        uint16_t pc = stack[--stack_size];
+
+        for (; is_in_rom(cfg, pc) && !(cfg->flags[pc] & CODE_ADDRESS); pc += 2) {
+            instruction_t i;
+            uint16_t successors[MAX_BLOCK_SUCCESSORS];
+            uint8_t count;
+
+            read_next_instruction(cfg->memory, pc, &i);
+            cfg->flags[pc] |= CODE_ADDRESS | CODE_BYTE;
+            cfg->flags[pc + 1] |= CODE_BYTE;
+
+            if (i.op_code == CALL)
+                push_address(cfg, stack, &stack_size, i.nnn, CALL_TARGET);
+
+            if (get_branches(&i, pc, successors, &count)) {
+                for (uint8_t s = 0; s < count; s++)
+                    push_address(cfg, stack, &stack_size, successors[s], 0);
+                break;
+            }
+        }
+
+        /*
+         * Stopping on code already traced means falling into the leader its trace started from,
+         * blocks are split on leaders so nothing else is needed.
+         */
+    }
+}
+
+static bool split_blocks(cfg_t *cfg)
+{
+    int capacity = 0;
+
+    for (uint16_t a = INITIAL_PROGRAM_COUNTER; a < cfg->end; a++)
+        capacity += (cfg->flags[a] & BLOCK_LEADER) != 0;
+
+    cfg->blocks = calloc(capacity ? capacity : 1, sizeof(basic_block_t));
+    if (!cfg->blocks) {
+        dprintf(2, "calloc failed\n");
+        return true;
+    }
+
+    for (uint16_t a = INITIAL_PROGRAM_COUNTER; a < cfg->end; a++) {
+        if (!(cfg->flags[a] & BLOCK_LEADER) || !(cfg->flags[a] & CODE_ADDRESS))
+            continue;
+
+        basic_block_t *block = &cfg->blocks[cfg->blocks_count++];
+        uint16_t pc = a;
+
+        block->start = a;
+
+        for (;;) {
+            instruction_t i;
+
+            read_next_instruction(cfg->memory, pc, &i);
+
+            if (get_branches(&i, pc, block->successors, &block->successors_count)) {
+                block->indirect = i.op_code == JMP_V0_NNN;
+                break;
+            }
+
+            // Falls through into another block, or out of the ROM
+            if (!is_in_rom(cfg, pc + 2) || cfg->flags[pc + 2] & BLOCK_LEADER || !(cfg->flags[pc + 2] & CODE_ADDRESS)) {
+                block->successors[block->successors_count++] = pc + 2;
+                break;
+            }
+
+            pc += 2;
+        }
+
+        block->end = pc + 2;
+    }
+
+    return false;
+}
+
+/*
+ * Build the control flow graph of the ROM, as loaded at INITIAL_PROGRAM_COUNTER.
+ */
+bool build_cfg(cfg_t *cfg, const uint8_t *rom, size_t size)
+{
+    memset(cfg, 0, sizeof(cfg_t));
+
+    if (size > MAX_PROG_SIZE) {
+        dprintf(2, "to large ROM. Memory size is %d, ROM size is %zu.\n", MAX_PROG_SIZE, size);
+        return true;
+    }
+
+    memcpy(cfg->memory + INITIAL_PROGRAM_COUNTER, rom, size);
+    cfg->end = INITIAL_PROGRAM_COUNTER + size;
+
+    trace_code(cfg);
+
+    return split_blocks(cfg);
+}
+
+void destroy_cfg(cfg_t *cfg)
+{
+    free(cfg->blocks);
+    cfg->blocks = NULL;
+    cfg->blocks_count = 0;
+}
+
+static void print_label(const cfg_t *cfg, uint16_t address)
+{
+    if (!is_in_rom(cfg, address))
+        printf("%04x (outside the ROM)", address);
+    else if (cfg->flags[address] & CALL_TARGET)
+        printf("sub_%04x", address);
+    else
+        printf("block_%04x", address);
+}
+
+static void print_data(const cfg_t *cfg, uint16_t start, uint16_t end)
+{
+    printf("\ndata_%04x: %d bytes", start, end - start);
+
+    for (uint16_t a = start; a < end; a++) {
+        if ((a - start) % 16 == 0)
+            printf("\n%04x", a);
+        printf(" %02x", cfg->memory[a]);
+    }
+
+    printf("\n");
+}
+
+/*
+ * Print every basic block with its label, instructions and successors,
+ * then the ROM bytes that are not part of any instruction.
+ */
+void print_cfg(const cfg_t *cfg)
+{
+    int calls = 0;
+    int data = 0;
+
+    for (uint16_t a = INITIAL_PROGRAM_COUNTER; a < cfg->end; a++) {
+        calls += (cfg->flags[a] & CALL_TARGET) != 0;
+        data += !(cfg->flags[a] & CODE_BYTE);
+    }
+
+    printf("; %d basic blocks, %d subroutines, %d bytes of data\n", cfg->blocks_count, calls, data);
+
+    for (int b = 0; b < cfg->blocks_count; b++) {
+        const basic_block_t *block = &cfg->blocks[b];
+
+        printf("\n");
+        print_label(cfg, block->start);
+        printf(":\n");
+
+        for (uint16_t pc = block->start; pc < block->end; pc += 2) {
+            instruction_t i;
+
+            read_next_instruction(cfg->memory, pc, &i);
+            print_instruction(pc, &i);
+        }
+
+        printf("    ->");
+        if (block->indirect)
+            printf(" (indirect)");
+        for (uint8_t s = 0; s < block->successors_count; s++) {
+            printf(s ? ", " : " ");
+            print_label(cfg, block->successors[s]);
+        }
+        if (!block->indirect && !block->successors_count)
+            printf(" (return)");
+        printf("\n");
+    }
+
+    for (uint16_t a = INITIAL_PROGRAM_COUNTER; a < cfg->end;) {
+        uint16_t start = a;
+
+        if (cfg->flags[a] & CODE_BYTE) {
+            a++;
+            continue;
+        }
+
+        while (a < cfg->end && !(cfg->flags[a] & CODE_BYTE))
+            a++;
+
+        print_data(cfg, start, a);
+    }
+}
+
+/*
+ * Disassembly of the graph with the executions of every instruction, "-" when never executed,
+ * then the executed addresses the graph misses, reached through indirect jumps or self-modifying code.
+ */
+void print_coverage(const cfg_t *cfg, const uint64_t hits[MEMORY_SIZE])
+{
+    int instructions = 0;
+    int reached = 0;
+    int outside = 0;
+
+    for (int b = 0; b < cfg->blocks_count; b++) {
+        for (uint16_t pc = cfg->blocks[b].start; pc < cfg->blocks[b].end; pc += 2) {
+            instructions++;
+            reached += hits[pc] != 0;
+        }
+    }
+
+    printf("; %d of %d instructions reached (%.1f%%)\n", reached, instructions,
+           instructions ? 100.0 * reached / instructions : 0.0);
+
+    for (int b = 0; b < cfg->blocks_count; b++) {
+        const basic_block_t *block = &cfg->blocks[b];
+
+        printf("\n");
+        print_label(cfg, block->start);
+        printf(hits[block->start] ? ":\n" : ": never reached\n");
+
+        for (uint16_t pc = block->start; pc < block->end; pc += 2) {
+            char line[MAX_DISAS_RECORD_SIZE];
+            instruction_t i;
+
+            read_next_instruction(cfg->memory, pc, &i);
+            if (hits[pc])
+                printf("%14lu  ", (unsigned long)hits[pc]);
+            else
+                printf("%14s  ", "-");
+            fwrite(line, 1, format_instruction(line, pc, &i), stdout);
+        }
+    }
+
+    for (int a = 0; a < MEMORY_SIZE; a++) {
+        if (!hits[a] || cfg->flags[a] & CODE_ADDRESS)
+            continue;
+
+        if (!outside++)
+            printf("\nReached outside the graph\n");
+        printf("%14lu  %04x\n", (unsigned long)hits[a], a);
+    }
+}
+
+/*
+ * Save the basic blocks of the graph, as a header line with the SHA-1 of the ROM
+ * then one "start end" line per block, in hexadecimal.
+ */
+bool write_block_index(const cfg_t *cfg, const uint8_t sha1[SHA1_SIZE], const char *filepath)
+{
+    FILE *file = fopen(filepath, "w");
+
+    if (!file) {
+        dprintf(2, "%s : %s\n", filepath, strerror(errno));
+        return true;
+    }
+
+    fprintf(file, "%s ", BLOCK_INDEX_HEADER);
+    for (int j = 0; j < SHA1_SIZE; j++)
+        fprintf(file, "%02x", sha1[j]);
+    fprintf(file, "\n");
+
+    for (int b = 0; b < cfg->blocks_count; b++)
+        fprintf(file, "%04x %04x\n", cfg->blocks[b].start, cfg->blocks[b].end);
+
+    if (fclose(file)) {
+        dprintf(2, "%s : %s\n", filepath, strerror(errno));
+        return true;
+    }
+
+    return false;
+}
+
+/*
+ * Load the basic blocks saved by write_block_index into cfg, only their bounds are known.
+ * sha1 is set to the hash of the ROM they belong to.
+ */
+bool read_block_index(cfg_t *cfg, uint8_t sha1[SHA1_SIZE], const char *filepath)
+{
+    FILE *file = fopen(filepath, "r");
+    char header[sizeof(BLOCK_INDEX_HEADER) + SHA1_SIZE * 2 + 2] = "";
+    unsigned int start;
+    unsigned int end;
+    int capacity = 16;
+
+    memset(cfg, 0, sizeof(cfg_t));
+
+    if (!file) {
+        dprintf(2, "%s : %s\n", filepath, strerror(errno));
+        return true;
+    }
+
+    if (fgets(header, sizeof(header), file))
+        header[strcspn(header, "\n")] = '\0';
+
+    if (strncmp(header, BLOCK_INDEX_HEADER " ", sizeof(BLOCK_INDEX_HEADER))
+        || parse_sha1(header + sizeof(BLOCK_INDEX_HEADER), sha1)) {
+        dprintf(2, "%s : not a block index\n", filepath);
+        fclose(file);
+        return true;
+    }
+
+    cfg->blocks = malloc(capacity * sizeof(basic_block_t));
+
+    while (cfg->blocks && fscanf(file, "%x %x", &start, &end) == 2) {
+        if (start < INITIAL_PROGRAM_COUNTER || end > MEMORY_SIZE || start >= end)
+            continue;
+
+        if (cfg->blocks_count == capacity) {
+            basic_block_t *blocks = realloc(cfg->blocks, (capacity *= 2) * sizeof(basic_block_t));
+
+            if (!blocks) {
+                free(cfg->blocks);
+                cfg->blocks = NULL;
+                break;
+            }
+            cfg->blocks = blocks;
+        }
+
+        cfg->blocks[cfg->blocks_count++] = (basic_block_t){.start = start, .end = end};
+    }
+
+    fclose(file);
+
+    if (!cfg->blocks) {
+        dprintf(2, "malloc failed\n");
+        cfg->blocks_count = 0;
+        return true;
+    }
+
+    return false;
+}
@@ -1,12 +1,17 @@
+#include <stddef.h>
 #include <string.h>
 #include <stdio.h>
+#include <stdlib.h>
 
 #include "chip8_engine.h"
 #include "op_codes.h"
-#include "instructions_executors.h"
+#include "quirk_executors.h"
+#include "specialized_executors.h"
+#include "fusion.h"
 #include "disas.h"
+#include "trace.h"
+#include "profiler.h"
 
-#define MAX_TICKS_PER_CYCLE ((long int)(1000000L / FREQUENCY))
 
 static const uint8_t chip8_fontset[FONT_SIZE] =
 {
@@ -28,82 +33,316 @@ static const uint8_t chip8_fontset[FONT_SIZE] =
     0xF0, 0x80, 0xF0, 0x80, 0x80  // F
 };
 
-static void (*const instructions_executors[OP_CODES_SIZE])(chip8_engine_t *, const instruction_t *) = {
-        &exec_clear,        // CLEAR
-        &exec_ret,          // RET
-        &exec_jmp_nnn,      // JMP_NNN
-        &exec_call,         // CALL
-        &exec_skip_x_kk,    // SKIP_X_KK
-        &exec_skipn_x_kk,   // SKIPN_X_KK
-        &exec_skip_x_y,     // SKIP_X_Y
-        &exec_mvi_x_kk,     // MVI_X_KK
-        &exec_add_x_kk,     // ADD_X_KK
-        &exec_mov_x_y,      // MOV_X_Y
-        &exec_or,           // OR
-        &exec_and,          // AND
-        &exec_xor,          // XOR
-        &exec_add_x_y,      // ADD_X_Y
-        &exec_sub,          // SUB
-        &exec_shr,          // SHR
-        &exec_subn,         // SUBN
-        &exec_shl,          // SHL
-        &exec_skipn_x_y,    // SKIPN_X_Y
-        &exec_mvi_i_nnn,    // MVI_I_NNN
-        &exec_jmp_v0_nnn,   // JMP_V0_NNN
-        &exec_rand,         // RAND
-        &exec_disp,         // DISP
-        &exec_skip_key,     // SKIP_KEY
-        &exec_skipn_key,    // SKIPN_KEY
-        &exec_mov_x_delay,  // MOV_X_DELAY
-        &exec_mov_key,      // MOV_KEY
-        &exec_mov_delay_x,  // MOV_DELAY_X
-        &exec_mov_sound,    // MOV_SOUND
-        &exec_add_i_x,      // ADD_I_X
-        &exec_sprite_pos,   // SPRITE_POS
-        &exec_movbcd,       // MOVBCD
-        &exec_movm_i_x,     // MOVM_I_X
-        &exec_movm_x_i,     // MOVM_X_I
-        &exec_unknown,
+const char *execution_engines_strings[EXECUTION_ENGINES_SIZE + 1] = {
+        "reference",
+        "predecoded",
+        "fused",
+        NULL
 };
 
 void init_chip8_engine(chip8_engine_t *engine)
 {
     memset(engine, 0, sizeof(chip8_engine_t));
+    for (int page = 0; page < CHIP8_PAGES; page++) {
+        engine->own_pages[page].refs = 1;
+        engine->pages[page] = &engine->own_pages[page];
+    }
+
     engine->pc = INITIAL_PROGRAM_COUNTER;
-    memcpy(engine->memory, chip8_fontset, FONT_SIZE * sizeof(uint8_t));
+    engine->cycles_per_tick = DEFAULT_INSTRUCTIONS_PER_FRAME;
+    load_chip8_memory(engine, 0, chip8_fontset, FONT_SIZE);
+    engine->rng = (uint32_t)random() | 1;
+
+    set_quirk_profile(engine, DEFAULT_QUIRK_PROFILE);
+}
+
+void set_quirk_profile(chip8_engine_t *e, quirk_profile_t quirk_profile)
+{
+    e->quirk_profile = quirk_profile;
+    e->executors = executors_tables[quirk_profile];
 
-    reset_clock(&engine->clock);
+    // Predecoded handlers were picked for the previous profile
+    if (e->predecoded)
+        memset(e->predecoded, 0, MEMORY_SIZE * sizeof(predecoded_t));
 }
 
-void chip8_check_counters(chip8_engine_t *e)
+bool set_execution_engine(chip8_engine_t *e, execution_engine_t execution_engine)
 {
-    if (get_elapsed(&e->clock) < MAX_TICKS_PER_CYCLE)
+    free(e->predecoded);
+    e->predecoded = NULL;
+    e->execution_engine = execution_engine;
+
+    if (execution_engine == REFERENCE_ENGINE)
+        return false;
+
+    e->predecoded = calloc(MEMORY_SIZE, sizeof(predecoded_t));
+    if (!e->predecoded) {
+        dprintf(2, "calloc failed\n");
+        e->execution_engine = REFERENCE_ENGINE;
+        return true;
+    }
+
+    return false;
+}
+
+void destroy_chip8_engine(chip8_engine_t *e)
+{
+    free(e->predecoded);
+    e->predecoded = NULL;
+}
+
+/*
+ * Forget the predecoded instructions overlapping [address, address + size), wrapping around memory.
+ * Instructions start up to one byte before address, fused sequences further back.
+ */
+void invalidate_predecoded(chip8_engine_t *e, uint16_t address, uint16_t size)
+{
+    if (!e->predecoded)
         return;
 
-    reset_clock(&e->clock);
+    for (int k = -(MAX_FUSED_INSTRUCTIONS * 2 - 1); k < size; k++)
+        e->predecoded[MEMORY_ADDRESS(address + k)].handler = NULL;
+}
+
+static void predecode_instruction(chip8_engine_t *e, uint16_t address)
+{
+    predecoded_t *p = &e->predecoded[address];
+    int available = 1;
+
+    fetch_instruction(e, address, &p->instruction);
+
+    p->fusion = NO_FUSION;
+    p->handler = get_specialized_handler(&p->instruction, &quirk_profiles[e->quirk_profile]);
+    if (!p->handler)
+        p->handler = e->executors[p->instruction.op_code];
+
+    if (e->execution_engine != FUSED_ENGINE)
+        return;
 
-    if (e->delay)
-        e->delay--;
+    // Fused handlers read the instructions that follow from their own entries
+    for (; available < MAX_FUSED_INSTRUCTIONS && address + available * 2 < MEMORY_SIZE - 1; available++) {
+        predecoded_t *next = &e->predecoded[address + available * 2];
 
-    if (e->sound) {
-        e->sound--;
-        if (!e->sound)
-            printf("BEEEEEP!\n");
+        if (!next->handler)
+            fetch_instruction(e, address + available * 2, &next->instruction);
     }
+
+    fuse_instructions(p, available);
+}
+
+/*
+ * Decode the instructions in [start, end) ahead of their first execution,
+ * from the basic blocks of a block index. Nothing to do without a predecoded engine.
+ */
+void warm_predecoded(chip8_engine_t *e, uint16_t start, uint16_t end)
+{
+    if (!e->predecoded)
+        return;
+
+    for (uint16_t address = start; address < end && address < MEMORY_SIZE - 1; address += 2)
+        if (!e->predecoded[address].handler)
+            predecode_instruction(e, address);
 }
 
+/*
+ * Handlers run with cycles counting the instructions before theirs, timers read at that cycle.
+ * Fused handlers account for the instructions they execute after the first one.
+ */
 void update_chip8_engine(chip8_engine_t *e, bool disas)
 {
-    chip8_check_counters(e);
+    uint64_t cycle = e->cycles;
+    // Jumps past the end of memory wrap around
+    uint16_t pc = e->pc = MEMORY_ADDRESS(e->pc);
+
+    // The last byte of memory cannot start a predecoded instruction
+    if (e->predecoded && pc < MEMORY_SIZE - 1) {
+        predecoded_t *p = &e->predecoded[pc];
+
+        if (!p->handler)
+            predecode_instruction(e, pc);
+
+        if (disas)
+            for (int k = 0; k < fusions_lengths[p->fusion]; k++)
+                print_instruction(pc + k * 2, &p[k * 2].instruction);
+
+        p->handler(e, &p->instruction);
+        e->cycles++;
+
+        // A fused sequence executes a prefix of its instructions, one per cycle
+        if (e->trace)
+            for (uint64_t k = 0; k < e->cycles - cycle && k < fusions_lengths[p->fusion]; k++)
+                record_trace(e->trace, e, cycle + k, pc + k * 2, &p[k * 2].instruction);
+        if (e->profiler)
+            for (uint64_t k = 0; k < e->cycles - cycle && k < fusions_lengths[p->fusion]; k++)
+                record_profile(e->profiler, pc + k * 2, &p[k * 2].instruction);
+        return;
+    }
 
     instruction_t i;
 
-    read_next_instruction(e->memory, e->pc, &i);
+    fetch_instruction(e, pc, &i);
 
     if (disas)
-        print_instruction(e->pc, &i);
+        print_instruction(pc, &i);
+
+    e->executors[i.op_code](e, &i);
+    e->cycles++;
+
+    if (e->trace)
+        record_trace(e->trace, e, cycle, pc, &i);
+    if (e->profiler)
+        record_profile(e->profiler, pc, &i);
+}
+
+/*
+ * Fast forward a loop waiting for the delay timer, FX07 - 3XKK - 1NNN jumping back to the FX07,
+ * to the next timer tick. Until then, every iteration reads the same delay and changes nothing else.
+ * Does nothing when pc is not at such a loop, or when the loop ends on this iteration.
+ */
+void skip_idle_loop(chip8_engine_t *e)
+{
+    instruction_t read;
+    instruction_t test;
+    instruction_t jump;
+
+    if (e->pc > MEMORY_SIZE - 6)
+        return;
+
+    fetch_instruction(e, e->pc, &read);
+    fetch_instruction(e, e->pc + 2, &test);
+    fetch_instruction(e, e->pc + 4, &jump);
+
+    if (read.op_code != MOV_X_DELAY || test.op_code != SKIP_X_KK || jump.op_code != JMP_NNN || jump.nnn != e->pc)
+        return;
+
+    uint8_t delay = get_timer(e, &e->delay);
+    uint8_t tested = test.x == read.x ? delay : e->v[test.x];
+
+    if (tested == test.kk)
+        return;
+
+    // Iterations starting before the tick, the last one may end after it
+    uint64_t next_tick = (e->cycles / e->cycles_per_tick + 1) * e->cycles_per_tick;
+    uint64_t iterations = (next_tick - e->cycles + 2) / 3;
+
+    e->cycles += iterations * 3;
+    e->v[read.x] = delay;
+
+    if (e->profiler)
+        add_profile_iterations(e->profiler, e->pc, (const instruction_t *[]){&read, &test, &jump}, 3, iterations);
+}
+
+/*
+ * Run the engine to the end of its frame, the next timer tick. Frames end on a cycle count rather than
+ * a dispatch count, as fused dispatches run several instructions and may end a few cycles past the tick.
+ * Idle loops are skipped unless every instruction is disassembled or traced. hook is called after every dispatch when not NULL.
+ * Returns the cycles skipped in idle loops.
+ */
+uint64_t run_chip8_frame(chip8_engine_t *e, bool disas, chip8_dispatch_hook_t hook, void *context)
+{
+    uint64_t frame_end = (e->cycles / e->cycles_per_tick + 1) * e->cycles_per_tick;
+    uint64_t skipped = 0;
+
+    while (e->cycles < frame_end) {
+        uint16_t pc = MEMORY_ADDRESS(e->pc);
+
+        update_chip8_engine(e, disas);
+        if (hook)
+            hook(e, pc, context);
+
+        if (e->pc == e->idle_loop && !disas && !e->trace) {
+            uint64_t cycles = e->cycles;
+
+            skip_idle_loop(e);
+            skipped += e->cycles - cycles;
+        }
+    }
+
+    return skipped;
+}
+
+#define FNV_OFFSET_BASIS    0xcbf29ce484222325ULL
+#define FNV_PRIME           0x100000001b3ULL
+
+static uint64_t hash_bytes(uint64_t hash, const void *buf, size_t size)
+{
+    const uint8_t *bytes = buf;
+
+    for (size_t k = 0; k < size; k++)
+        hash = (hash ^ bytes[k]) * FNV_PRIME;
+
+    return hash;
+}
+
+/*
+ * Copy of e using its own pages, whatever e uses. copy must not be a fork,
+ * other pointers like predecoded are copied as they are.
+ */
+void copy_chip8_engine(chip8_engine_t *copy, const chip8_engine_t *e)
+{
+    memcpy(copy, e, offsetof(chip8_engine_t, own_pages));
+    copy->pool = NULL;
+
+    for (int page = 0; page < CHIP8_PAGES; page++) {
+        memcpy(copy->own_pages[page].bytes, e->pages[page]->bytes, CHIP8_PAGE_SIZE);
+        copy->own_pages[page].refs = 1;
+        copy->pages[page] = &copy->own_pages[page];
+    }
+}
+
+// Write size bytes at address, wrapping around memory
+void load_chip8_memory(chip8_engine_t *e, uint16_t address, const uint8_t *data, uint16_t size)
+{
+    for (uint16_t k = 0; k < size; k++)
+        write_memory(e, MEMORY_ADDRESS(address + k), data[k]);
+}
+
+void copy_memory(const chip8_engine_t *e, uint8_t memory[MEMORY_SIZE])
+{
+    for (int page = 0; page < MEMORY_PAGES; page++)
+        memcpy(memory + page * CHIP8_PAGE_SIZE, e->pages[page]->bytes, CHIP8_PAGE_SIZE);
+}
+
+void copy_screen(const chip8_engine_t *e, display_buffer_t buf)
+{
+    for (int page = 0; page < SCREEN_PAGES; page++)
+        memcpy(buf + page * CHIP8_PAGE_SIZE, e->pages[MEMORY_PAGES + page]->bytes, CHIP8_PAGE_SIZE);
+}
+
+void clear_screen(chip8_engine_t *e)
+{
+    for (int page = MEMORY_PAGES; page < CHIP8_PAGES; page++) {
+        if (e->pages[page]->refs > 1)
+            copy_shared_page(e, page);
+        memset(e->pages[page]->bytes, 0, CHIP8_PAGE_SIZE);
+    }
+
+    e->screen_hash = 0;
+}
+
+/*
+ * Hash of the architectural state : registers, timers as read at the current cycle, stack, memory and screen.
+ * Every engine reaches the same state, whatever the way it runs the instructions.
+ * Of the cycle count, only the position within the timer tick is hashed, as it is all the future depends on :
+ * the same state reached at another cycle hashes the same, so searches and rewinds can tell it was seen.
+ * Memory and screen come from their running hashes, only the few bytes of registers and stack are hashed here,
+ * so the cost does not depend on the size of the state.
+ */
+uint64_t hash_chip8_state(const chip8_engine_t *e)
+{
+    uint8_t timers[2] = {get_timer(e, &e->delay), get_timer(e, &e->sound)};
+    uint64_t tick_phase = e->cycles % e->cycles_per_tick;
+    uint64_t hash = FNV_OFFSET_BASIS;
+
+    hash = hash_bytes(hash, e->v, sizeof(e->v));
+    hash = hash_bytes(hash, &e->i, sizeof(e->i));
+    hash = hash_bytes(hash, &e->pc, sizeof(e->pc));
+    hash = hash_bytes(hash, &e->sp, sizeof(e->sp));
+    hash = hash_bytes(hash, timers, sizeof(timers));
+    hash = hash_bytes(hash, &tick_phase, sizeof(tick_phase));
+    hash = hash_bytes(hash, e->stack, sizeof(e->stack));
 
-    instructions_executors[i.op_code](e, &i);
+    return hash ^ e->memory_hash ^ e->screen_hash;
 }
 
 void chip8_dump_registers(const chip8_engine_t *e) {
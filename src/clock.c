@@ -1,5 +1,11 @@
+#include <time.h>
+#include <errno.h>
+
 #include "clock.h"
 
+// Number of late ticks after which the pacer stops catching up and restarts from now
+#define MAX_PACER_LATE_TICKS 4
+
 void reset_clock(chip8_clock_t *clock)
 {
     gettimeofday(clock, 0);
@@ -11,4 +17,73 @@ long int get_elapsed(const chip8_clock_t *clock)
 
     gettimeofday(&now, 0);
     return S_TO_US(now.tv_sec - clock->tv_sec) + (now.tv_usec - clock->tv_usec);
-}
\ No newline at end of file
+}
+
+long int get_monotonic_time(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return S_TO_US(now.tv_sec) + now.tv_nsec / 1000L;
+}
+
+static long int get_pacer_time(const chip8_pacer_t *pacer)
+{
+    if (pacer->get_time)
+        return pacer->get_time(pacer->context);
+
+    return get_monotonic_time();
+}
+
+static void sleep_until(long int deadline)
+{
+    struct timespec ts = {
+        .tv_sec = US_TO_S(deadline),
+        .tv_nsec = (deadline % S_TO_US(1)) * 1000L
+    };
+
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR);
+}
+
+void init_pacer(chip8_pacer_t *pacer, long int frequency)
+{
+    pacer->period = S_TO_US(1) / frequency;
+    pacer->get_time = NULL;
+    pacer->context = NULL;
+    pacer->skipped_ticks = 0;
+    pacer->next_tick = get_monotonic_time() + pacer->period;
+}
+
+void set_pacer_time_source(chip8_pacer_t *pacer, long int (*get_time)(void *), void *context)
+{
+    pacer->get_time = get_time;
+    pacer->context = context;
+    pacer->next_tick = get_pacer_time(pacer) + pacer->period;
+}
+
+void wait_pacer(chip8_pacer_t *pacer)
+{
+    long int now = get_pacer_time(pacer);
+
+    if (now - pacer->next_tick > MAX_PACER_LATE_TICKS * pacer->period) {
+        pacer->skipped_ticks += (now - pacer->next_tick) / pacer->period;
+        pacer->next_tick = now + pacer->period;
+        return;
+    }
+
+    if (!pacer->get_time) {
+        if (now < pacer->next_tick)
+            sleep_until(pacer->next_tick);
+    } else {
+        // Other time sources drift from the monotonic clock, so their deadline is checked again after sleeping.
+        // A stalled source must not hang the caller : give up after a few periods.
+        for (int late = 0; now < pacer->next_tick && late < MAX_PACER_LATE_TICKS; late++) {
+            long int remaining = pacer->next_tick - now;
+
+            sleep_until(get_monotonic_time() + (remaining < pacer->period ? remaining : pacer->period));
+            now = get_pacer_time(pacer);
+        }
+    }
+
+    pacer->next_tick += pacer->period;
+}
@@ -1,131 +1,177 @@
+#include <errno.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 #include <stdbool.h>
 
+#include "chip8_engine.h"
+#include "disas.h"
 #include "op_codes.h"
 
-#define BUF_SIZE 32
+/*
+ * Instructions are formatted by hand straight into a buffer holding the output of a whole ROM,
+ * which is then written at once : no stdio call per instruction.
+ */
 
-static const char bit_to_char[2] = {
-        '0',
-        '1'
+#define PUT_LITERAL(p, s) put_string(p, s, sizeof(s) - 1)
+
+const char *disas_formats_strings[DISAS_FORMATS_SIZE + 1] = {
+        "text",
+        "json",
+        "binary",
+        NULL
 };
 
-static void byte_to_binary(uint8_t v, char buf[9])
-{
-    for (int i = 0; i < 8; i ++)
-        buf[i] = bit_to_char[(v >> i & 1)];
+static const char hex_digits[16] = "0123456789abcdef";
 
-    buf[8] = '\0';
-}
+// Bits of every nibble, least significant first
+static const char nibble_to_binary[16][4] = {
+        {'0', '0', '0', '0'}, {'1', '0', '0', '0'}, {'0', '1', '0', '0'}, {'1', '1', '0', '0'},
+        {'0', '0', '1', '0'}, {'1', '0', '1', '0'}, {'0', '1', '1', '0'}, {'1', '1', '1', '0'},
+        {'0', '0', '0', '1'}, {'1', '0', '0', '1'}, {'0', '1', '0', '1'}, {'1', '1', '0', '1'},
+        {'0', '0', '1', '1'}, {'1', '0', '1', '1'}, {'0', '1', '1', '1'}, {'1', '1', '1', '1'},
+};
 
-static void short_to_binary(uint16_t v, char buf[17])
+static char *put_string(char *p, const char *s, size_t len)
 {
-    for (int i = 0; i < 16; i ++)
-        buf[i] = bit_to_char[(v >> i & 1)];
-
-    buf[16] = '\0';
+    memcpy(p, s, len);
+    return p + len;
 }
 
-static void print_debug(instruction_t ins) {
-    char byte_buf[9];
-    char short_buf[17];
-
-    short_to_binary(ins.op_code, short_buf);
-    printf("op_code | hex = [%04x], bin = [%s]\n", ins.op_code, short_buf);
-
-    byte_to_binary(ins.u, byte_buf);
-    printf("u       | hex = [%04x], bin = [%s]\n", ins.u, byte_buf);
+static char *put_hex(char *p, unsigned int v, int digits)
+{
+    for (int d = digits - 1; d >= 0; d--)
+        *p++ = hex_digits[v >> (d * 4) & 0xf];
 
-    short_to_binary(ins.nnn, short_buf);
-    printf("nnn     | hex = [%04x], bin = [%s]\n", ins.nnn, short_buf);
+    return p;
+}
 
-    byte_to_binary(ins.x, byte_buf);
-    printf("x       | hex = [%04x], bin = [%s]\n", ins.x, byte_buf);
+// Binary digits of v, least significant first
+static char *put_binary(char *p, uint16_t v, int bits)
+{
+    for (int b = 0; b < bits; b += 4)
+        p = put_string(p, nibble_to_binary[v >> b & 0xf], 4);
 
-    byte_to_binary(ins.y, byte_buf);
-    printf("y       | hex = [%04x], bin = [%s]\n", ins.y, byte_buf);
+    return p;
+}
 
-    byte_to_binary(ins.n, byte_buf);
-    printf("n       | hex = [%04x], bin = [%s]\n", ins.n, byte_buf);
+static char *put_register(char *p, uint8_t x)
+{
+    *p++ = 'v';
+    *p++ = hex_digits[x & 0xf];
+    return p;
+}
 
-    byte_to_binary(ins.kk, byte_buf);
-    printf("kk      | hex = [%04x], bin = [%s]\n", ins.kk, byte_buf);
+static char *put_debug_field(char *p, const char *name, uint16_t v, int bits)
+{
+    p = put_string(p, name, 8);
+    p = PUT_LITERAL(p, "| hex = [");
+    p = put_hex(p, v, 4);
+    p = PUT_LITERAL(p, "], bin = [");
+    p = put_binary(p, v, bits);
+    return PUT_LITERAL(p, "]\n");
+}
 
-    printf("\n============================================================================\n\n");
+static char *put_debug(char *p, const instruction_t *i)
+{
+    p = put_debug_field(p, "op_code ", i->op_code, 16);
+    p = put_debug_field(p, "u       ", i->u, 8);
+    p = put_debug_field(p, "nnn     ", i->nnn, 16);
+    p = put_debug_field(p, "x       ", i->x, 8);
+    p = put_debug_field(p, "y       ", i->y, 8);
+    p = put_debug_field(p, "n       ", i->n, 8);
+    p = put_debug_field(p, "kk      ", i->kk, 8);
+
+    return PUT_LITERAL(p, "\n============================================================================\n\n");
 }
 
-static void no_param(const instruction_t *i, char buf[BUF_SIZE])
+static char *no_param(const instruction_t *i, char *p)
 {
     (void)i;
-    (void)buf;
+    return p;
 }
 
-static void param_nnn(const instruction_t *i, char buf[BUF_SIZE])
+static char *param_nnn(const instruction_t *i, char *p)
 {
-    sprintf(buf, "%03x", i->nnn);
+    return put_hex(p, i->nnn, 3);
 }
 
-static void params_x_kk(const instruction_t *i, char buf[BUF_SIZE])
+static char *params_x_kk(const instruction_t *i, char *p)
 {
-    sprintf(buf, "v%01x, %02x", i->x, i->kk);
+    p = put_register(p, i->x);
+    p = PUT_LITERAL(p, ", ");
+    return put_hex(p, i->kk, 2);
 }
 
-static void params_x_y(const instruction_t *i, char buf[BUF_SIZE])
+static char *params_x_y(const instruction_t *i, char *p)
 {
-    sprintf(buf, "v%01x, v%01x", i->x, i->y);
+    p = put_register(p, i->x);
+    p = PUT_LITERAL(p, ", ");
+    return put_register(p, i->y);
 }
 
-static void params_x_y_n(const instruction_t *i, char buf[BUF_SIZE])
+static char *params_x_y_n(const instruction_t *i, char *p)
 {
-    sprintf(buf, "v%01x, v%01x, %01x", i->x, i->y, i->n);
+    p = params_x_y(i, p);
+    p = PUT_LITERAL(p, ", ");
+    return put_hex(p, i->n, 1);
 }
 
-static void param_x(const instruction_t *i, char buf[BUF_SIZE])
+static char *param_x(const instruction_t *i, char *p)
 {
-    sprintf(buf, "v%01x", i->x);
+    return put_register(p, i->x);
 }
 
-static void params_i_nnn(const instruction_t *i, char buf[BUF_SIZE])
+static char *params_i_nnn(const instruction_t *i, char *p)
 {
-    sprintf(buf, "I, %03x", i->nnn);
+    p = PUT_LITERAL(p, "I, ");
+    return put_hex(p, i->nnn, 3);
 }
 
-static void params_v0_nnn(const instruction_t *i, char buf[BUF_SIZE])
+static char *params_v0_nnn(const instruction_t *i, char *p)
 {
-    sprintf(buf, "v0, %03x", i->nnn);
+    p = PUT_LITERAL(p, "v0, ");
+    return put_hex(p, i->nnn, 3);
 }
 
-static void params_x_delay(const instruction_t *i, char buf[BUF_SIZE])
+static char *params_x_delay(const instruction_t *i, char *p)
 {
-    sprintf(buf, "v%01x, DELAY", i->x);
+    p = put_register(p, i->x);
+    return PUT_LITERAL(p, ", DELAY");
 }
 
-static void params_x_key(const instruction_t *i, char buf[BUF_SIZE])
+static char *params_x_key(const instruction_t *i, char *p)
 {
-    sprintf(buf, "v%01x, KEY", i->x);
+    p = put_register(p, i->x);
+    return PUT_LITERAL(p, ", KEY");
 }
 
-static void params_delay_x(const instruction_t *i, char buf[BUF_SIZE])
+static char *params_delay_x(const instruction_t *i, char *p)
 {
-    sprintf(buf, "DELAY, v%01x", i->x);
+    p = PUT_LITERAL(p, "DELAY, ");
+    return put_register(p, i->x);
 }
 
-static void params_sound_x(const instruction_t *i, char buf[BUF_SIZE])
+static char *params_sound_x(const instruction_t *i, char *p)
 {
-    sprintf(buf, "SOUND, v%01x", i->x);
+    p = PUT_LITERAL(p, "SOUND, ");
+    return put_register(p, i->x);
 }
 
-static void params_i_x(const instruction_t *i, char buf[BUF_SIZE])
+static char *params_i_x(const instruction_t *i, char *p)
 {
-    sprintf(buf, "I, v%01x", i->x);
+    p = PUT_LITERAL(p, "I, ");
+    return put_register(p, i->x);
 }
 
-static void params_x_i(const instruction_t *i, char buf[BUF_SIZE])
+static char *params_x_i(const instruction_t *i, char *p)
 {
-    sprintf(buf, "v%01x, I", i->x);
+    p = put_register(p, i->x);
+    return PUT_LITERAL(p, ", I");
 }
 
-static void (*const params_functions[OP_CODES_SIZE])(const instruction_t *, char buf[BUF_SIZE]) = {
+static char *(*const params_functions[OP_CODES_SIZE])(const instruction_t *, char *) = {
     // CLEAR
     &no_param,
     // RET
@@ -198,28 +244,243 @@ static void (*const params_functions[OP_CODES_SIZE])(const instruction_t *, char
     &no_param
 };
 
+static char *put_text(char *p, uint16_t pc, const instruction_t *i)
+{
+    const char *mnemonic = op_codes_strings[i->op_code];
+
+    p = put_hex(p, pc, 4);
+    *p++ = ' ';
+    p = put_hex(p, i->instruction, 4);
+    *p++ = ' ';
+    p = put_string(p, mnemonic, strlen(mnemonic));
+    *p++ = ' ';
+    p = params_functions[i->op_code](i, p);
+    *p++ = '\n';
+
+    return p;
+}
+
+static char *put_json(char *p, const char *name, size_t name_size, uint16_t pc, const instruction_t *i)
+{
+    const char *mnemonic = op_codes_strings[i->op_code];
+
+    p = PUT_LITERAL(p, "{\"rom\":\"");
+    p = put_string(p, name, name_size);
+    p = PUT_LITERAL(p, "\",\"pc\":\"");
+    p = put_hex(p, pc, 4);
+    p = PUT_LITERAL(p, "\",\"instruction\":\"");
+    p = put_hex(p, i->instruction, 4);
+    p = PUT_LITERAL(p, "\",\"op\":\"");
+    p = put_string(p, mnemonic, strlen(mnemonic));
+    p = PUT_LITERAL(p, "\",\"operands\":\"");
+    p = params_functions[i->op_code](i, p);
+    return PUT_LITERAL(p, "\"}\n");
+}
+
+// name as the content of a JSON string, into a buffer the caller frees
+static char *escape_json_string(const char *name, size_t *size)
+{
+    char *escaped = malloc(strlen(name) * 6 + 1);
+    char *p = escaped;
+
+    if (!escaped) {
+        dprintf(2, "malloc failed\n");
+        return NULL;
+    }
+
+    for (; *name; name++) {
+        unsigned char c = *name;
+
+        if (c == '"' || c == '\\') {
+            *p++ = '\\';
+            *p++ = c;
+        } else if (c < 0x20) {
+            p = PUT_LITERAL(p, "\\u00");
+            p = put_hex(p, c, 2);
+        } else
+            *p++ = c;
+    }
+
+    *size = p - escaped;
+    return escaped;
+}
+
+static bool reserve_disas_buffer(disas_buffer_t *buf, size_t size)
+{
+    size_t capacity = buf->capacity ? buf->capacity : 64 * 1024;
+    char *data;
+
+    if (buf->size + size <= buf->capacity)
+        return false;
+
+    while (capacity < buf->size + size)
+        capacity *= 2;
+
+    data = realloc(buf->data, capacity);
+    if (!data) {
+        dprintf(2, "realloc failed\n");
+        return true;
+    }
+
+    buf->data = data;
+    buf->capacity = capacity;
+    return false;
+}
+
+// Text line of the instruction at pc, not NUL terminated, buf holds at least MAX_DISAS_RECORD_SIZE bytes
+size_t format_instruction(char *buf, uint16_t pc, const instruction_t *i)
+{
+    return put_text(buf, pc, i) - buf;
+}
+
 void print_instruction(uint16_t pc, const instruction_t *i)
 {
-    char instruction_params[BUF_SIZE] = {'\0'};
+    char line[MAX_DISAS_RECORD_SIZE];
+
+    fwrite(line, 1, format_instruction(line, pc, i), stdout);
+}
+
+/*
+ * Disassemble every 2 bytes of the ROM, as loaded at INITIAL_PROGRAM_COUNTER, appending to buf.
+ * Op codes are counted into histogram.
+ */
+bool disas_rom(disas_buffer_t *buf, const disas_rom_t *rom, const disas_options_t *options, uint64_t histogram[OP_CODES_SIZE])
+{
+    size_t name_size = 0;
+    char *name = NULL;
+    instruction_t i;
+
+    if (!options->histogram_only && options->format == JSON_FORMAT && !(name = escape_json_string(rom->name, &name_size)))
+        return true;
+
+    if (reserve_disas_buffer(buf, MAX_DISAS_RECORD_SIZE + strlen(rom->name))) {
+        free(name);
+        return true;
+    }
+
+    if (!options->histogram_only && options->format == BINARY_FORMAT) {
+        disas_rom_header_t header = {.instructions_count = (rom->size + 1) / 2};
+
+        memcpy(header.magic, DISAS_ROM_MAGIC, sizeof(header.magic));
+        memcpy(header.sha1, rom->sha1, SHA1_SIZE);
+        memcpy(buf->data + buf->size, &header, sizeof(header));
+        buf->size += sizeof(header);
+    }
+
+    if (!options->histogram_only && options->format == TEXT_FORMAT && options->named) {
+        char *p = buf->data + buf->size;
+
+        p = PUT_LITERAL(p, "; ");
+        p = put_string(p, rom->name, strlen(rom->name));
+        *p++ = '\n';
+        buf->size = p - buf->data;
+    }
+
+    for (size_t offset = 0; offset < rom->size; offset += 2) {
+        // An odd sized ROM ends with half an instruction
+        uint16_t word = rom->content[offset] << 8 | (offset + 1 < rom->size ? rom->content[offset + 1] : 0);
+        uint16_t pc = INITIAL_PROGRAM_COUNTER + offset;
+
+        decode_instruction(word, &i);
+        i.op_code = op_codes_table[word];
+        histogram[i.op_code]++;
+
+        if (options->histogram_only)
+            continue;
+
+        if (reserve_disas_buffer(buf, MAX_DISAS_RECORD_SIZE + name_size)) {
+            free(name);
+            return true;
+        }
+
+        char *p = buf->data + buf->size;
+
+        switch (options->format) {
+            case TEXT_FORMAT:
+                p = put_text(p, pc, &i);
+                if (options->debug)
+                    p = put_debug(p, &i);
+                break;
+            case JSON_FORMAT:
+                p = put_json(p, name, name_size, pc, &i);
+                break;
+            default: {
+                disas_record_t record = {.pc = pc, .instruction = word, .op_code = i.op_code};
+
+                p = put_string(p, (const char *)&record, sizeof(record));
+                break;
+            }
+        }
+
+        buf->size = p - buf->data;
+    }
+
+    free(name);
+    return false;
+}
+
+// Write the content of buf to fd and empty it
+bool write_disas_buffer(disas_buffer_t *buf, int fd)
+{
+    const char *p = buf->data;
+    size_t size = buf->size;
+
+    buf->size = 0;
+
+    while (size) {
+        ssize_t written = write(fd, p, size);
 
-    params_functions[i->op_code](i, instruction_params);
+        if (written == -1) {
+            if (errno == EINTR)
+                continue;
+            dprintf(2, "write : %s\n", strerror(errno));
+            return true;
+        }
 
-    printf(
-            "%04hx %04x %s %s\n",
-            pc,
-            i->instruction,
-            op_codes_strings[i->op_code],
-            instruction_params
-    );
+        p += written;
+        size -= written;
+    }
+
+    return false;
 }
 
-void disas(const uint8_t *buf, uint16_t pc, bool debug)
+void destroy_disas_buffer(disas_buffer_t *buf)
 {
-    instruction_t instruction;
+    free(buf->data);
+    memset(buf, 0, sizeof(disas_buffer_t));
+}
 
-    read_next_instruction(buf, pc, &instruction);
-    print_instruction(pc, &instruction);
+/*
+ * Text : one line per op code with its count and share of all instructions.
+ * JSON : an array of objects with the op code, its mnemonic and its count.
+ * Binary : the OP_CODES_SIZE counts as 64 bits integers, in op code order.
+ */
+bool write_opcode_histogram(const uint64_t histogram[OP_CODES_SIZE], disas_format_t format, int fd)
+{
+    uint64_t total = 0;
 
-    if (debug)
-        print_debug(instruction);
-}
\ No newline at end of file
+    for (int op = 0; op < OP_CODES_SIZE; op++)
+        total += histogram[op];
+
+    if (format == BINARY_FORMAT) {
+        disas_buffer_t buf = {.data = (char *)histogram, .size = OP_CODES_SIZE * sizeof(uint64_t)};
+
+        return write_disas_buffer(&buf, fd);
+    }
+
+    if (format == JSON_FORMAT) {
+        for (int op = 0; op < OP_CODES_SIZE; op++)
+            dprintf(fd, "%s{\"op\":%d,\"mnemonic\":\"%s\",\"count\":%lu}", op ? "," : "[",
+                    op, op_codes_strings[op], (unsigned long)histogram[op]);
+        dprintf(fd, "]\n");
+        return false;
+    }
+
+    // Several op codes share a mnemonic, the op code index tells them apart
+    for (int op = 0; op < OP_CODES_SIZE; op++)
+        dprintf(fd, "%2d %-12s %12lu %6.2f%%\n", op, op_codes_strings[op], (unsigned long)histogram[op],
+                total ? 100.0 * histogram[op] / total : 0.0);
+    dprintf(fd, "   %-12s %12lu\n", "total", (unsigned long)total);
+
+    return false;
+}
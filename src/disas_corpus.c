@@ -0,0 +1,147 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "disas_corpus.h"
+#include "chip8_engine.h"
+#include "utils.h"
+
+// Load the ROM file, or the ROM of the pack when it is not NULL, buf is set to the content to free
+bool load_disas_rom(const rom_pack_t *pack, const char *name, disas_rom_t *rom, uint8_t **buf)
+{
+    const packed_rom_t *packed;
+
+    rom->name = name;
+    *buf = NULL;
+
+    if (!pack) {
+        if (!(*buf = read_file_offset(name, 0, &rom->size, MAX_PROG_SIZE)))
+            return true;
+
+        rom->content = *buf;
+        compute_sha1(rom->content, rom->size, rom->sha1);
+        return false;
+    }
+
+    if (!(packed = find_packed_rom(pack, name))) {
+        dprintf(2, "%s : no such ROM in the pack\n", name);
+        return true;
+    }
+
+    rom->content = get_packed_rom_content(pack, packed);
+    rom->size = packed->size;
+    memcpy(rom->sha1, packed->sha1, SHA1_SIZE);
+    return false;
+}
+
+/*
+ * Leave the output of ROM n to be written in turn, buf is then empty.
+ * Unless another worker is writing, write every done output from the turn on.
+ */
+static void write_in_turn(disas_corpus_t *c, int n, disas_buffer_t *buf, bool failed)
+{
+    pthread_mutex_lock(&c->lock);
+    c->outputs[n] = (disas_output_t){.buf = *buf, .done = true, .failed = failed};
+    *buf = (disas_buffer_t){.data = NULL};
+
+    if (c->writing) {
+        pthread_mutex_unlock(&c->lock);
+        return;
+    }
+
+    c->writing = true;
+    while (c->turn < c->roms_count && c->outputs[c->turn].done) {
+        disas_output_t *output = &c->outputs[c->turn];
+
+        // Only the writing worker touches a done output, no lock needed
+        pthread_mutex_unlock(&c->lock);
+        failed = output->failed || write_disas_buffer(&output->buf, c->fd);
+        destroy_disas_buffer(&output->buf);
+
+        pthread_mutex_lock(&c->lock);
+        c->failed |= failed;
+        c->turn++;
+    }
+    c->writing = false;
+    pthread_mutex_unlock(&c->lock);
+}
+
+static void *run_disas_worker(void *arg)
+{
+    disas_corpus_t *c = arg;
+    disas_buffer_t buf = {.data = NULL};
+    uint64_t histogram[OP_CODES_SIZE] = {0};
+    int n;
+
+    while ((n = atomic_fetch_add(&c->next_rom, 1)) < c->roms_count) {
+        disas_rom_t rom;
+        uint8_t *content;
+        bool failed = load_disas_rom(c->pack, c->roms[n], &rom, &content);
+
+        if (!failed)
+            failed = disas_rom(&buf, &rom, &c->options, histogram);
+
+        free(content);
+        write_in_turn(c, n, &buf, failed);
+    }
+
+    pthread_mutex_lock(&c->lock);
+    for (int op = 0; op < OP_CODES_SIZE; op++)
+        c->histogram[op] += histogram[op];
+    pthread_mutex_unlock(&c->lock);
+
+    destroy_disas_buffer(&buf);
+    return NULL;
+}
+
+/*
+ * Disassemble the ROMs of the corpus to its fd on threads workers, counting their op codes in its histogram.
+ * A ROM that cannot be read is reported and skipped, the others are still written.
+ * Returns true when any of them failed.
+ */
+bool disas_corpus(disas_corpus_t *c, int threads)
+{
+    int started = 0;
+
+    if (threads > c->roms_count)
+        threads = c->roms_count;
+    if (threads < 1)
+        threads = 1;
+
+    pthread_t workers[threads];
+
+    c->outputs = calloc(c->roms_count, sizeof(disas_output_t));
+    if (!c->outputs && c->roms_count) {
+        dprintf(2, "calloc failed\n");
+        return true;
+    }
+
+    atomic_init(&c->next_rom, 0);
+    c->turn = 0;
+    c->writing = false;
+    c->failed = false;
+    memset(c->histogram, 0, sizeof(c->histogram));
+    pthread_mutex_init(&c->lock, NULL);
+
+    for (; started < threads; started++) {
+        int err = pthread_create(&workers[started], NULL, &run_disas_worker, c);
+
+        if (err) {
+            dprintf(2, "pthread_create : %s\n", strerror(err));
+            break;
+        }
+    }
+
+    // Without any worker, this thread does the work
+    if (!started)
+        run_disas_worker(c);
+
+    for (int t = 0; t < started; t++)
+        pthread_join(workers[t], NULL);
+
+    pthread_mutex_destroy(&c->lock);
+    free(c->outputs);
+    c->outputs = NULL;
+
+    return c->failed;
+}
@@ -1,90 +1,168 @@
+#include <ctype.h>
+#include <stdlib.h>
+
 #include "display.h"
 
 #define WINDOW_TITLE "Chip8"
+#define WALL_WINDOW_TITLE "Chip8 - video wall"
 
 #define MAX_SCREEN_FPS              120
 #define MAX_SCREEN_TICKS_PER_FRAME  ((long int)(1000000L / MAX_SCREEN_FPS))
 
+// Widest window the video wall tries to fit its tiles in
+#define MAX_WALL_WIDTH              1280
+
 static bool sdl_error(const char *message)
 {
     dprintf(2, "Error : %s : %s\n", message, SDL_GetError());
     return true;
 }
 
-bool init_display(display_t *d, bool log_framerate)
+static bool create_window(display_t *d, const char *title, int width, int height, Uint32 renderer_flags)
 {
     if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_EVENTS))
         return sdl_error("unable to init SDL2");
 
     d->window = SDL_CreateWindow(
-        WINDOW_TITLE,
+        title,
         SDL_WINDOWPOS_CENTERED,
         SDL_WINDOWPOS_CENTERED,
-        WINDOW_WIDTH,
-        WINDOW_HEIGHT,
+        width,
+        height,
         SDL_WINDOW_SHOWN
     );
     if (!d->window) return sdl_error("unable to create window");
 
-    d->renderer = SDL_CreateRenderer(d->window, -1, SDL_RENDERER_ACCELERATED);
+    d->renderer = SDL_CreateRenderer(d->window, -1, renderer_flags);
     if (!d->renderer) return sdl_error("unable to create renderer");
 
+    if (set_key_bindings(d, DEFAULT_KEY_BINDINGS))
+        return true;
+
+    d->atlas = NULL;
+    d->metrics = NULL;
+    d->key_event_time = 0;
+    d->present_time = 0;
+    d->presented_frame = 0;
+
+    memset(&d->cap_clock, 0, sizeof(chip8_clock_t));
+
+    return false;
+}
+
+bool init_display(display_t *d)
+{
+    if (create_window(d, WINDOW_TITLE, WINDOW_WIDTH, WINDOW_HEIGHT, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC))
+        return true;
+
+    // The texture holds logical pixels, the renderer scales it up to the window
     d->texture = SDL_CreateTexture(
         d->renderer,
         SDL_PIXELFORMAT_RGB332,
         SDL_TEXTUREACCESS_STATIC,
-        WINDOW_WIDTH,
-        WINDOW_HEIGHT
+        CHIP8_WINDOW_WIDTH,
+        CHIP8_WINDOW_HEIGHT
     );
     if (!d->texture) return sdl_error("unable to create texture");
 
+    d->columns = 1;
+    d->rows = 1;
+
+    return false;
+}
+
+bool init_wall_display(display_t *d, int instances)
+{
+    int columns = 1;
+
+    while (columns * columns < instances)
+        columns++;
+
+    int rows = (instances + columns - 1) / columns;
+    int tile_scale = MAX_WALL_WIDTH / (columns * CHIP8_WINDOW_WIDTH);
 
-    d->frame_counter = 0;
-    d->log_framerate = log_framerate;
+    if (tile_scale < 1)
+        tile_scale = 1;
+    if (tile_scale > WINDOW_SCALE)
+        tile_scale = WINDOW_SCALE;
 
-    memset(&d->cap_clock, 0, sizeof(clock_t));
-    reset_clock(&d->framerate_clock);
+    if (create_window(
+            d,
+            WALL_WINDOW_TITLE,
+            columns * CHIP8_WINDOW_WIDTH * tile_scale,
+            rows * CHIP8_WINDOW_HEIGHT * tile_scale,
+            SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC
+    ))
+        return true;
+
+    d->texture = SDL_CreateTexture(
+        d->renderer,
+        SDL_PIXELFORMAT_RGB332,
+        SDL_TEXTUREACCESS_STREAMING,
+        columns * CHIP8_WINDOW_WIDTH,
+        rows * CHIP8_WINDOW_HEIGHT
+    );
+    if (!d->texture) return sdl_error("unable to create texture");
+
+    d->atlas = calloc((size_t)columns * rows, sizeof(display_buffer_t));
+    if (!d->atlas) {
+        dprintf(2, "calloc failed\n");
+        return true;
+    }
+
+    d->columns = columns;
+    d->rows = rows;
 
     return false;
 }
 
 /*
+ * Bindings list the characters typed for the keys 0x0 through 0xf.
+ * They are resolved once to scancodes for the current keyboard layout,
+ * so each key event is then a single table lookup.
+ * The default bindings follow this layout :
+ *
  *   1 2 3 4
  *   A Z E R
  *   Q S D F
  *   W X C V
  */
-static const SDL_Keycode keys_map[KEY_SIZE] = {
-        SDLK_x, // 0x0
-        SDLK_1, // 0x1
-        SDLK_2, // 0x2
-        SDLK_3, // 0x3
-        SDLK_a, // 0x4
-        SDLK_z, // 0x5
-        SDLK_e, // 0x6
-        SDLK_q, // 0x7
-        SDLK_s, // 0x8
-        SDLK_d, // 0x9
-        SDLK_w, // 0xa
-        SDLK_c, // 0xb
-        SDLK_4, // 0xc
-        SDLK_r, // 0xd
-        SDLK_f, // 0xe
-        SDLK_v  // 0xf
-};
-
-static uint8_t handle_keyboard_input(const SDL_Event *ev)
+bool set_key_bindings(display_t *d, const char *bindings)
 {
-    for (uint8_t i = 0; i < KEY_SIZE; i++)
-        if (ev->key.keysym.sym == keys_map[i])
-            return i;
+    if (strlen(bindings) != KEY_SIZE) {
+        dprintf(2, "%s : key bindings must list exactly %d keys\n", bindings, KEY_SIZE);
+        return true;
+    }
+
+    memset(d->keys_map, KEY_SIZE, sizeof(d->keys_map));
 
-    return KEY_SIZE;
+    for (uint8_t k = 0; k < KEY_SIZE; k++) {
+        SDL_Scancode scancode = SDL_GetScancodeFromKey((SDL_Keycode)tolower((unsigned char)bindings[k]));
+
+        if (scancode == SDL_SCANCODE_UNKNOWN) {
+            dprintf(2, "%c : key is not available on this keyboard\n", bindings[k]);
+            return true;
+        }
+
+        if (d->keys_map[scancode] != KEY_SIZE) {
+            dprintf(2, "%c : key bound twice\n", bindings[k]);
+            return true;
+        }
+
+        d->keys_map[scancode] = k;
+    }
+
+    return false;
 }
 
-bool poll_event(display_t *d, display_event_t *event)
+/*
+ * Drain every pending event and fold key events into keys, bit k being set while key k is down.
+ * Return false when the window is closed.
+ */
+bool poll_keys(display_t *d, uint16_t *keys)
 {
     SDL_Event ev;
+    uint64_t events = 0;
 
     reset_clock(&d->cap_clock);
 
@@ -92,25 +170,35 @@ bool poll_event(display_t *d, display_event_t *event)
         if (ev.type == SDL_QUIT)
             return false;
 
-        event->key_pressed = ev.type == SDL_KEYDOWN;
-        if (event->key_pressed || ev.type == SDL_KEYUP) {
-            event->key = handle_keyboard_input(&ev);
-            return true;
-        }
+        if (ev.type != SDL_KEYDOWN && ev.type != SDL_KEYUP)
+            continue;
+
+        uint8_t key = d->keys_map[ev.key.keysym.scancode];
+
+        if (key >= KEY_SIZE)
+            continue;
+
+        // Event timestamps are SDL ticks in milliseconds, move them back on the monotonic clock
+        d->key_event_time = get_monotonic_time() - (long int)(SDL_GetTicks() - ev.key.timestamp) * 1000L;
+
+        if (ev.type == SDL_KEYDOWN)
+            *keys |= 1 << key;
+        else
+            *keys &= ~(1 << key);
+        events++;
     }
 
-    event->key = KEY_SIZE;
+    if (d->metrics && events)
+        add_metric(d->metrics, INPUT_EVENTS, events);
+
     return true;
 }
 
-bool render(display_t *d, display_buffer_t *buf)
+static bool present(display_t *d)
 {
-    float avg_fps = 0;
+    long int previous_present = d->present_time;
     uint32_t frame_ticks = 0;
 
-    if (SDL_UpdateTexture(d->texture, NULL, buf, WINDOW_WIDTH * sizeof(uint8_t)))
-        return sdl_error("unable to update texture");
-
     if (SDL_RenderClear(d->renderer))
         return sdl_error("unable to clear renderer");
 
@@ -118,16 +206,13 @@ bool render(display_t *d, display_buffer_t *buf)
         return sdl_error("unable to render");
 
     SDL_RenderPresent(d->renderer);
+    d->present_time = get_monotonic_time();
 
-    avg_fps = (float)d->frame_counter / US_TO_S((float)get_elapsed(&d->framerate_clock));
-
-    if (avg_fps > 2000000)
-        avg_fps = 0;
-
-    if (d->log_framerate)
-        printf("average fps = %f\n", avg_fps);
-
-    d->frame_counter++;
+    if (d->metrics) {
+        add_metric(d->metrics, FRAMES_PRESENTED, 1);
+        if (previous_present)
+            add_frame_time(d->metrics, d->present_time - previous_present);
+    }
 
     frame_ticks = get_elapsed(&d->cap_clock);
     if (frame_ticks < MAX_SCREEN_TICKS_PER_FRAME)
@@ -136,10 +221,72 @@ bool render(display_t *d, display_buffer_t *buf)
     return false;
 }
 
+bool render(display_t *d, display_buffer_t *buf)
+{
+    if (SDL_UpdateTexture(d->texture, NULL, buf, CHIP8_WINDOW_WIDTH * sizeof(uint8_t)))
+        return sdl_error("unable to update texture");
+
+    return present(d);
+}
+
+/*
+ * Upload the latest completed frame if one was published since the last call, then present.
+ * Presenting waits for vsync, which paces the render thread on its own.
+ */
+bool render_latest_frame(display_t *d, triple_buffer_t *frames)
+{
+    bool fresh = false;
+    const frame_t *frame = get_latest_frame(frames, &fresh);
+
+    if (fresh && SDL_UpdateTexture(d->texture, NULL, frame->pixels, CHIP8_WINDOW_WIDTH * sizeof(uint8_t)))
+        return sdl_error("unable to update texture");
+
+    d->presented_frame = frame->id;
+
+    return present(d);
+}
+
+static void copy_tile(display_t *d, int instance, const display_buffer_t pixels)
+{
+    int pitch = d->columns * CHIP8_WINDOW_WIDTH;
+    uint8_t *tile = d->atlas
+        + (instance / d->columns) * CHIP8_WINDOW_HEIGHT * pitch
+        + (instance % d->columns) * CHIP8_WINDOW_WIDTH;
+
+    for (int y = 0; y < CHIP8_WINDOW_HEIGHT; y++)
+        memcpy(tile + y * pitch, pixels + y * CHIP8_WINDOW_WIDTH, CHIP8_WINDOW_WIDTH);
+}
+
+/*
+ * Copy the latest completed frame of every instance that published one since the last call
+ * into the atlas, then upload the whole atlas at once and present a single frame.
+ */
+bool render_wall(display_t *d, triple_buffer_t *frames, int instances)
+{
+    bool dirty = false;
+
+    for (int n = 0; n < instances; n++) {
+        bool fresh = false;
+        const frame_t *frame = get_latest_frame(&frames[n], &fresh);
+
+        if (!fresh)
+            continue;
+
+        copy_tile(d, n, frame->pixels);
+        dirty = true;
+    }
+
+    if (dirty && SDL_UpdateTexture(d->texture, NULL, d->atlas, d->columns * CHIP8_WINDOW_WIDTH * sizeof(uint8_t)))
+        return sdl_error("unable to update texture");
+
+    return present(d);
+}
+
 void destroy_display(display_t *d)
 {
+    free(d->atlas);
     SDL_DestroyTexture(d->texture);
     SDL_DestroyRenderer(d->renderer);
     SDL_DestroyWindow(d->window);
     SDL_Quit();
-}
\ No newline at end of file
+}
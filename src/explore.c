@@ -0,0 +1,399 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "explore.h"
+#include "fork.h"
+#include "clock.h"
+#include "utils.h"
+
+// Checks per second of the end of the search
+#define EXPLORE_POLL_FREQUENCY 10
+
+typedef struct explore_entry_s explore_entry_t;
+typedef struct explore_worker_s explore_worker_t;
+
+// Keys from power-on to a snapshot of the corpus
+struct explore_entry_s {
+    uint16_t *keys;
+    uint32_t frames_count;
+};
+
+struct explore_worker_s {
+    pthread_t thread;
+    explorer_t *explorer;
+    uint32_t random;
+    chip8_pool_t pool;
+    // Snapshot n of the corpus is slots[n], the last slot runs the search
+    chip8_engine_t *slots;
+    explore_entry_t *corpus;
+    int corpus_count;
+    // Keys of the search running, from power-on
+    uint16_t *keys;
+    uint32_t keys_capacity;
+    uint64_t hits[MEMORY_SIZE];
+    // First address no worker executed before in the run, -1 when none
+    int reached;
+};
+
+// One frame in four presses a single key or releases all of them, keys are held the rest of the time
+uint16_t generate_random_keys(uint32_t *state, uint16_t keys)
+{
+    uint32_t r = generate_random(state);
+
+    if (r % 4)
+        return keys;
+
+    return (r >> 8) % (KEY_SIZE + 1) == KEY_SIZE ? 0 : 1 << (r >> 8) % (KEY_SIZE + 1);
+}
+
+bool init_explorer(explorer_t *x, const chip8_engine_t *root, int threads, int corpus_capacity, const char *inputs_path)
+{
+    memset(x, 0, sizeof(explorer_t));
+
+    x->screens = calloc(EXPLORE_SCREENS_SIZE, sizeof(uint64_t));
+    if (!x->screens) {
+        dprintf(2, "calloc failed\n");
+        return true;
+    }
+
+    x->root = root;
+    x->threads = threads;
+    // The power-on snapshot is never replaced, there must be room for another one
+    x->corpus_capacity = corpus_capacity < 2 ? 2 : corpus_capacity;
+    x->inputs_path = inputs_path;
+    pthread_mutex_init(&x->lock, NULL);
+
+    return false;
+}
+
+void destroy_explorer(explorer_t *x)
+{
+    free(x->screens);
+    x->screens = NULL;
+    pthread_mutex_destroy(&x->lock);
+}
+
+static bool reserve_keys(explore_worker_t *w, uint32_t count)
+{
+    uint32_t capacity = w->keys_capacity ? w->keys_capacity : 1024;
+    uint16_t *keys;
+
+    if (count <= w->keys_capacity)
+        return false;
+
+    while (capacity < count)
+        capacity *= 2;
+
+    keys = realloc(w->keys, capacity * sizeof(uint16_t));
+    if (!keys) {
+        dprintf(2, "realloc failed\n");
+        return true;
+    }
+
+    w->keys = keys;
+    w->keys_capacity = capacity;
+
+    return false;
+}
+
+// Whether no worker saw this screen before, the clear screen hashes to 0 and is never new
+static bool is_new_screen(explorer_t *x, uint64_t hash)
+{
+    if (!hash)
+        return false;
+
+    for (uint64_t probe = 0; probe < EXPLORE_SCREENS_PROBES; probe++) {
+        _Atomic uint64_t *entry = &x->screens[(hash + probe) & (EXPLORE_SCREENS_SIZE - 1)];
+        uint64_t seen = atomic_load_explicit(entry, memory_order_relaxed);
+
+        if (!seen && atomic_compare_exchange_strong_explicit(entry, &seen, hash,
+                memory_order_relaxed, memory_order_relaxed)) {
+            atomic_fetch_add_explicit(&x->screens_count, 1, memory_order_relaxed);
+            return true;
+        }
+
+        if (seen == hash)
+            return false;
+    }
+
+    // Too crowded around this hash, taken as seen
+    return false;
+}
+
+// Marks the address as executed, keeping the first one no worker executed before
+static void mark_explored(chip8_engine_t *e, uint16_t pc, void *context)
+{
+    explore_worker_t *w = context;
+    explorer_t *x = w->explorer;
+
+    (void)e;
+    w->hits[pc]++;
+
+    if (!atomic_load_explicit(&x->reached[pc], memory_order_relaxed)
+        && !atomic_exchange_explicit(&x->reached[pc], 1, memory_order_relaxed) && w->reached == -1)
+        w->reached = pc;
+}
+
+// Input reaching address first, named after it
+static bool write_explore_input(explorer_t *x, uint16_t address, const uint16_t *keys, uint32_t frames_count)
+{
+    explore_input_header_t header;
+    FILE *file;
+
+    if (!x->inputs_path)
+        return false;
+
+    size_t size = strlen(x->inputs_path) + 16;
+    char path[size];
+
+    snprintf(path, size, "%s/%04x" EXPLORE_INPUT_EXTENSION, x->inputs_path, address);
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, EXPLORE_INPUT_MAGIC, sizeof(header.magic));
+    memcpy(header.sha1, x->root->sha1, SHA1_SIZE);
+    header.rng = x->root->rng;
+    header.instructions_per_frame = x->root->cycles_per_tick;
+    header.quirk_profile = x->root->quirk_profile;
+    header.frames_count = frames_count;
+
+    file = fopen(path, "wb");
+    if (!file) {
+        dprintf(2, "%s : %s\n", path, strerror(errno));
+        return true;
+    }
+
+    if (fwrite(&header, sizeof(header), 1, file) != 1
+        || fwrite(keys, sizeof(uint16_t), frames_count, file) != frames_count) {
+        dprintf(2, "%s : %s\n", path, strerror(errno));
+        fclose(file);
+        return true;
+    }
+
+    if (fclose(file)) {
+        dprintf(2, "%s : %s\n", path, strerror(errno));
+        return true;
+    }
+
+    atomic_fetch_add_explicit(&x->inputs, 1, memory_order_relaxed);
+    return false;
+}
+
+// Once the corpus is full, a new snapshot replaces any but the power-on state
+static bool keep_snapshot(explore_worker_t *w, const chip8_engine_t *e, uint32_t frames_count)
+{
+    explorer_t *x = w->explorer;
+    uint16_t *keys = malloc(frames_count * sizeof(uint16_t) + 1);
+    int n;
+
+    if (!keys) {
+        dprintf(2, "malloc failed\n");
+        return true;
+    }
+
+    if (w->corpus_count < x->corpus_capacity)
+        n = w->corpus_count++;
+    else
+        n = 1 + generate_random(&w->random) % (x->corpus_capacity - 1);
+
+    memcpy(keys, w->keys, frames_count * sizeof(uint16_t));
+    free(w->corpus[n].keys);
+    w->corpus[n] = (explore_entry_t){.keys = keys, .frames_count = frames_count};
+
+    atomic_fetch_add_explicit(&x->snapshots, 1, memory_order_relaxed);
+    return chip8_fork(&w->pool, &w->slots[n], e);
+}
+
+/*
+ * Fork a snapshot of the corpus and run it up to MAX_EXPLORE_RUN_FRAMES frames with random keys,
+ * mostly held as a player does. The result joins the corpus when it reached a new address or screen,
+ * its input is written when it reached a new address.
+ */
+static bool explore_once(explore_worker_t *w)
+{
+    explorer_t *x = w->explorer;
+    chip8_engine_t *e = &w->slots[x->corpus_capacity];
+    explore_entry_t *entry = &w->corpus[generate_random(&w->random) % w->corpus_count];
+    uint32_t frames = 1 + generate_random(&w->random) % MAX_EXPLORE_RUN_FRAMES;
+    uint32_t frames_count = entry->frames_count;
+    uint16_t keys = frames_count ? entry->keys[frames_count - 1] : 0;
+    bool new_screen = false;
+
+    w->reached = -1;
+    if (chip8_fork(&w->pool, e, &w->slots[entry - w->corpus]) || reserve_keys(w, frames_count))
+        return true;
+    if (frames_count)
+        memcpy(w->keys, entry->keys, frames_count * sizeof(uint16_t));
+
+    for (uint32_t f = 0; f < frames; f++) {
+        uint32_t frame = e->cycles / e->cycles_per_tick;
+
+        keys = generate_random_keys(&w->random, keys);
+        // Frames skipped along with an idle loop keep the keys, as replays see them
+        if (reserve_keys(w, frame + 1))
+            return true;
+        while (frames_count <= frame)
+            w->keys[frames_count++] = keys;
+
+        e->keyboard = keys;
+        run_chip8_frame(e, false, &mark_explored, w);
+        new_screen |= is_new_screen(x, e->screen_hash);
+    }
+
+    atomic_fetch_add_explicit(&x->frames, frames, memory_order_relaxed);
+
+    if (w->reached == -1 && !new_screen)
+        return false;
+
+    return keep_snapshot(w, e, frames_count)
+        || (w->reached != -1 && write_explore_input(x, w->reached, w->keys, frames_count));
+}
+
+static void *run_explore_worker(void *arg)
+{
+    explore_worker_t *w = arg;
+    explorer_t *x = w->explorer;
+
+    while (atomic_load_explicit(&x->running, memory_order_relaxed)) {
+        if (explore_once(w)) {
+            atomic_store(&x->failed, true);
+            break;
+        }
+    }
+
+    pthread_mutex_lock(&x->lock);
+    for (int a = 0; a < MEMORY_SIZE; a++)
+        x->hits[a] += w->hits[a];
+    pthread_mutex_unlock(&x->lock);
+
+    return NULL;
+}
+
+// The corpus starts with the power-on state
+static bool init_explore_worker(explore_worker_t *w, explorer_t *x)
+{
+    w->explorer = x;
+    w->random = (uint32_t)random() | 1;
+
+    if (init_chip8_pool(&w->pool, x->corpus_capacity + 1))
+        return true;
+
+    w->slots = calloc(x->corpus_capacity + 1, sizeof(chip8_engine_t));
+    w->corpus = calloc(x->corpus_capacity, sizeof(explore_entry_t));
+    if (!w->slots || !w->corpus) {
+        dprintf(2, "calloc failed\n");
+        return true;
+    }
+
+    w->corpus_count = 1;
+    return chip8_fork(&w->pool, &w->slots[0], x->root);
+}
+
+static void destroy_explore_worker(explore_worker_t *w)
+{
+    for (int n = 0; w->slots && n <= w->explorer->corpus_capacity; n++)
+        if (w->slots[n].pool)
+            release_chip8_fork(&w->slots[n]);
+
+    for (int n = 0; w->corpus && n < w->corpus_count; n++)
+        free(w->corpus[n].keys);
+
+    destroy_chip8_pool(&w->pool);
+    free(w->slots);
+    free(w->corpus);
+    free(w->keys);
+}
+
+/*
+ * Search on every worker thread for seconds, then merge their coverage into hits.
+ */
+bool run_explorer(explorer_t *x, int seconds)
+{
+    explore_worker_t *workers = calloc(x->threads, sizeof(explore_worker_t));
+    long int deadline = get_monotonic_time() + S_TO_US((long int)seconds);
+    chip8_pacer_t pacer;
+    int started = 0;
+
+    if (!workers) {
+        dprintf(2, "calloc failed\n");
+        return true;
+    }
+
+    atomic_store(&x->running, true);
+
+    for (; started < x->threads; started++) {
+        int err;
+
+        if (init_explore_worker(&workers[started], x)) {
+            destroy_explore_worker(&workers[started]);
+            atomic_store(&x->failed, true);
+            break;
+        }
+
+        err = pthread_create(&workers[started].thread, NULL, &run_explore_worker, &workers[started]);
+        if (err) {
+            dprintf(2, "unable to start explore thread : %s\n", strerror(err));
+            destroy_explore_worker(&workers[started]);
+            atomic_store(&x->failed, true);
+            break;
+        }
+    }
+
+    init_pacer(&pacer, EXPLORE_POLL_FREQUENCY);
+    while (!atomic_load(&x->failed) && get_monotonic_time() < deadline)
+        wait_pacer(&pacer);
+
+    atomic_store(&x->running, false);
+
+    for (int t = 0; t < started; t++) {
+        pthread_join(workers[t].thread, NULL);
+        destroy_explore_worker(&workers[t]);
+    }
+    free(workers);
+
+    return atomic_load(&x->failed);
+}
+
+bool read_explore_input(explore_input_t *input, const char *filepath)
+{
+    FILE *file = fopen(filepath, "rb");
+
+    input->keys = NULL;
+    if (!file) {
+        dprintf(2, "%s : %s\n", filepath, strerror(errno));
+        return true;
+    }
+
+    if (fread(&input->header, sizeof(input->header), 1, file) != 1
+        || memcmp(input->header.magic, EXPLORE_INPUT_MAGIC, sizeof(input->header.magic))
+        || !input->header.instructions_per_frame || input->header.instructions_per_frame > INT32_MAX
+        || input->header.quirk_profile >= QUIRK_PROFILES_SIZE) {
+        dprintf(2, "%s : not an input written by explore\n", filepath);
+        fclose(file);
+        return true;
+    }
+
+    input->keys = malloc(input->header.frames_count * sizeof(uint16_t) + 1);
+    if (!input->keys) {
+        dprintf(2, "malloc failed\n");
+        fclose(file);
+        return true;
+    }
+
+    if (fread(input->keys, sizeof(uint16_t), input->header.frames_count, file) != input->header.frames_count) {
+        dprintf(2, "%s : truncated input\n", filepath);
+        fclose(file);
+        destroy_explore_input(input);
+        return true;
+    }
+
+    fclose(file);
+    return false;
+}
+
+void destroy_explore_input(explore_input_t *input)
+{
+    free(input->keys);
+    input->keys = NULL;
+}
@@ -0,0 +1,112 @@
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fork.h"
+
+bool init_chip8_pool(chip8_pool_t *pool, int capacity)
+{
+    memset(pool, 0, sizeof(chip8_pool_t));
+
+    pool->pages = malloc((size_t)capacity * CHIP8_PAGES * sizeof(chip8_page_t));
+    if (!pool->pages) {
+        dprintf(2, "malloc failed\n");
+        return true;
+    }
+
+    pool->capacity = capacity;
+    for (int n = capacity * CHIP8_PAGES; n-- > 0;) {
+        pool->pages[n].next = pool->free;
+        pool->free = &pool->pages[n];
+    }
+
+    return false;
+}
+
+// Every fork of the pool must have been released
+void destroy_chip8_pool(chip8_pool_t *pool)
+{
+    free(pool->pages);
+    pool->pages = NULL;
+    pool->free = NULL;
+}
+
+static chip8_page_t *pop_free_page(chip8_pool_t *pool)
+{
+    chip8_page_t *page = pool->free;
+
+    pool->free = page->next;
+    page->refs = 1;
+
+    return page;
+}
+
+static void release_page(chip8_pool_t *pool, chip8_page_t *page)
+{
+    if (--page->refs)
+        return;
+
+    page->next = pool->free;
+    pool->free = page;
+}
+
+// Called by write_position on the first write of a fork to a shared page
+void copy_shared_page(chip8_engine_t *e, int page)
+{
+    chip8_page_t *copy = pop_free_page(e->pool);
+
+    memcpy(copy->bytes, e->pages[page]->bytes, CHIP8_PAGE_SIZE);
+    e->pages[page]->refs--;
+    e->pages[page] = copy;
+}
+
+/*
+ * Clone e into slot, a zeroed or released engine or a fork to replace.
+ * Only the state before the pages is copied, the pages are shared when e is a fork of the same pool,
+ * copied once otherwise. Forks run the reference engine : a predecoded array is far larger than the
+ * state, and sharing one would mix instructions decoded from the memory of different forks.
+ */
+bool chip8_fork(chip8_pool_t *pool, chip8_engine_t *slot, const chip8_engine_t *e)
+{
+    if (slot->pool)
+        release_chip8_fork(slot);
+
+    if (pool->forks == pool->capacity) {
+        dprintf(2, "chip8_fork : %d forks already, the pool is full\n", pool->capacity);
+        return true;
+    }
+
+    memcpy(slot, e, offsetof(chip8_engine_t, own_pages));
+    slot->pool = pool;
+    slot->execution_engine = REFERENCE_ENGINE;
+    slot->predecoded = NULL;
+    slot->latency = NULL;
+    slot->trace = NULL;
+    slot->profiler = NULL;
+    pool->forks++;
+
+    for (int page = 0; page < CHIP8_PAGES; page++) {
+        if (e->pool == pool) {
+            e->pages[page]->refs++;
+            continue;
+        }
+
+        slot->pages[page] = pop_free_page(pool);
+        memcpy(slot->pages[page]->bytes, e->pages[page]->bytes, CHIP8_PAGE_SIZE);
+    }
+
+    return false;
+}
+
+// The slot can only be forked into again
+void release_chip8_fork(chip8_engine_t *slot)
+{
+    chip8_pool_t *pool = slot->pool;
+
+    for (int page = 0; page < CHIP8_PAGES; page++)
+        release_page(pool, slot->pages[page]);
+
+    pool->forks--;
+    slot->pool = NULL;
+}
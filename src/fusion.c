@@ -0,0 +1,168 @@
+#include <stddef.h>
+#include <stdio.h>
+
+#include "fusion.h"
+
+const char *fusions_strings[FUSIONS_SIZE + 1] = {
+        "NONE",
+        "TIMER_WAIT",
+        "SPRITE_SETUP",
+        "INDEXED_SPRITE",
+        "LOOP_COUNTER",
+        NULL
+};
+
+// Number of instructions in each fused sequence
+const uint8_t fusions_lengths[FUSIONS_SIZE] = {
+        1,  // NO_FUSION
+        3,  // TIMER_WAIT
+        3,  // SPRITE_SETUP
+        2,  // INDEXED_SPRITE
+        2,  // LOOP_COUNTER
+};
+
+/*
+ * A fused handler is given the instruction of the first entry of its sequence.
+ * The instructions that follow are in the entries of the next addresses,
+ * so the instruction at pc + 2 * k is p[2 * k].instruction.
+ */
+static const predecoded_t *get_sequence(const instruction_t *i)
+{
+    return (const predecoded_t *)((const char *)i - offsetof(predecoded_t, instruction));
+}
+
+/*
+ * MOV x, DELAY - SKIP y, kk - JMP nnn
+ * Busy loop waiting for the delay timer.
+ */
+static void exec_timer_wait(chip8_engine_t *e, const instruction_t *i)
+{
+    const predecoded_t *p = get_sequence(i);
+    const instruction_t *skip = &p[2].instruction;
+
+    e->fusion_hits[TIMER_WAIT]++;
+
+    e->v[i->x] = get_timer(e, &e->delay);
+
+    if (e->v[skip->x] == skip->kk) {
+        // The skip jumps over the JMP
+        e->pc += 6;
+        e->cycles += 1;
+        return;
+    }
+
+    e->pc = p[4].instruction.nnn;
+    e->cycles += 2;
+}
+
+/*
+ * MVI x, kk - MVI y, kk - DISP x, y, n
+ * Load sprite coordinates, then draw it.
+ */
+static void exec_sprite_setup(chip8_engine_t *e, const instruction_t *i)
+{
+    const predecoded_t *p = get_sequence(i);
+
+    e->fusion_hits[SPRITE_SETUP]++;
+
+    e->v[i->x] = i->kk;
+    e->v[p[2].instruction.x] = p[2].instruction.kk;
+    e->pc += 4;
+    e->cycles += 2;
+
+    e->executors[DISP](e, &p[4].instruction);
+}
+
+/*
+ * MVI I, nnn - DISP x, y, n
+ * Point I to a sprite, then draw it.
+ */
+static void exec_indexed_sprite(chip8_engine_t *e, const instruction_t *i)
+{
+    const predecoded_t *p = get_sequence(i);
+
+    e->fusion_hits[INDEXED_SPRITE]++;
+
+    e->i = i->nnn;
+    e->pc += 2;
+    e->cycles += 1;
+
+    e->executors[DISP](e, &p[2].instruction);
+}
+
+/*
+ * ADD x, kk - SKIP y, kk
+ * Increment a loop counter, then skip the jump back once it reaches its end.
+ */
+static void exec_loop_counter(chip8_engine_t *e, const instruction_t *i)
+{
+    const instruction_t *skip = &get_sequence(i)[2].instruction;
+
+    e->fusion_hits[LOOP_COUNTER]++;
+
+    e->v[i->x] += i->kk;
+    e->pc += e->v[skip->x] == skip->kk ? 4 : 2;
+    e->pc += 2;
+    e->cycles += 1;
+}
+
+static bool matches(const predecoded_t *p, int available, op_code_t first, op_code_t second, op_code_t third)
+{
+    if (p[0].instruction.op_code != first || p[2].instruction.op_code != second)
+        return false;
+
+    return third == UNKNOWN || (available > 2 && p[4].instruction.op_code == third);
+}
+
+/*
+ * Replace the handler of p with a fused one when it starts a known sequence.
+ * The first available instructions from p are decoded.
+ */
+void fuse_instructions(predecoded_t *p, int available)
+{
+    if (available < 2)
+        return;
+
+    if (matches(p, available, MOV_X_DELAY, SKIP_X_KK, JMP_NNN)) {
+        p->fusion = TIMER_WAIT;
+        p->handler = &exec_timer_wait;
+    } else if (matches(p, available, MVI_X_KK, MVI_X_KK, DISP)) {
+        p->fusion = SPRITE_SETUP;
+        p->handler = &exec_sprite_setup;
+    } else if (matches(p, available, MVI_I_NNN, DISP, UNKNOWN)) {
+        p->fusion = INDEXED_SPRITE;
+        p->handler = &exec_indexed_sprite;
+    } else if (matches(p, available, ADD_X_KK, SKIP_X_KK, UNKNOWN)) {
+        p->fusion = LOOP_COUNTER;
+        p->handler = &exec_loop_counter;
+    }
+}
+
+void print_fusions_report(const chip8_engine_t *e)
+{
+    uint64_t saved = 0;
+
+    if (!e->predecoded)
+        return;
+
+    printf("fused sequences :\n");
+    for (int a = 0; a < MEMORY_SIZE; a++) {
+        const predecoded_t *p = &e->predecoded[a];
+
+        if (p->handler && p->fusion != NO_FUSION)
+            printf("  %04x %s\n", a, fusions_strings[p->fusion]);
+    }
+
+    printf("fused dispatches :\n");
+    for (int f = NO_FUSION + 1; f < FUSIONS_SIZE; f++) {
+        printf("  %-16s %lu\n", fusions_strings[f], (unsigned long)e->fusion_hits[f]);
+        saved += e->fusion_hits[f] * (fusions_lengths[f] - 1);
+    }
+
+    printf(
+        "%lu instructions in %lu dispatches, %.1f%% saved by fusion\n",
+        (unsigned long)e->cycles,
+        (unsigned long)(e->cycles - saved),
+        e->cycles ? 100.0 * saved / e->cycles : 0.0
+    );
+}
@@ -3,21 +3,18 @@
 
 #include "chip8_engine.h"
 #include "op_codes.h"
+#include "instructions_executors.h"
 #include "utils.h"
 
-static bool is_v_reg_out_of_bound(uint8_t r)
-{
-    return r >= V_REGISTERS_SIZE;
-}
-
 void exec_clear(chip8_engine_t *e, const instruction_t *i)
 {
     (void )i;
 
     e->pc += 2;
-    clear_display_buffer(e->screen);
+    clear_screen(e);
 
     e->draw_flag = true;
+    stamp_latency(e->latency, LATENCY_DRAWN);
 }
 
 /*
@@ -31,7 +28,8 @@ void exec_ret(chip8_engine_t *e, const instruction_t *i)
 {
     (void)i;
 
-    e->pc = e->stack[e->sp--];
+    e->pc = e->stack[e->sp];
+    e->sp = STACK_INDEX(e->sp - 1);
 }
 
 /*
@@ -56,7 +54,8 @@ void exec_jmp_nnn(chip8_engine_t *e, const instruction_t *i)
  */
 void exec_call(chip8_engine_t *e, const instruction_t *i)
 {
-    e->stack[++e->sp] = e->pc + 2;
+    e->sp = STACK_INDEX(e->sp + 1);
+    e->stack[e->sp] = e->pc + 2;
     e->pc = i->nnn;
 }
 
@@ -162,63 +161,6 @@ void exec_mov_x_y(chip8_engine_t *e, const instruction_t *i)
     e->v[i->x] = e->v[i->y];
 }
 
-/*
- * OR x, y
- * Set Vx = Vx OR Vy.
- *
- * Performs a bitwise OR on the values of Vx and Vy, then stores the result in Vx.
- * A bitwise OR compares the corresponding bits from two values, and if either bit is 1,
- * then the same bit in the result is also 1.
- * Otherwise, it is 0.
- */
-void exec_or(chip8_engine_t *e, const instruction_t *i)
-{
-    e->pc += 2;
-
-    if (is_v_reg_out_of_bound(i->x) || is_v_reg_out_of_bound(i->y))
-        return;
-
-    e->v[i->x] |= e->v[i->y];
-}
-
-/*
- * AND x, y
- * Set Vx = Vx AND Vy.
-
- * Performs a bitwise AND on the values of Vx and Vy, then stores the result in Vx.
- * A bitwise AND compares the corresponding bits from two values, and if both bits are 1,
- * then the same bit in the result is also 1.
- * Otherwise, it is 0.
- */
-void exec_and(chip8_engine_t *e, const instruction_t *i)
-{
-    e->pc += 2;
-
-    if (is_v_reg_out_of_bound(i->x) || is_v_reg_out_of_bound(i->y))
-        return;
-
-    e->v[i->x] &= e->v[i->y];
-}
-
-/*
- * XOR Vx, Vy
- * Set Vx = Vx XOR Vy.
- *
- * Performs a bitwise exclusive OR on the values of Vx and Vy, then stores the result in Vx.
- * An exclusive OR compares the corresponding bits from two values, and if the bits are not both the same,
- * then the corresponding bit in the result is set to 1.
- * Otherwise, it is 0.
- */
-void exec_xor(chip8_engine_t *e, const instruction_t *i)
-{
-    e->pc += 2;
-
-    if (is_v_reg_out_of_bound(i->x) || is_v_reg_out_of_bound(i->y))
-        return;
-
-    e->v[i->x] ^= e->v[i->y];
-}
-
 /*
  * ADD x, y
  * Set Vx = Vx + Vy, set VF = carry.
@@ -257,24 +199,6 @@ void exec_sub(chip8_engine_t *e, const instruction_t *i)
     e->v[i->x] -= e->v[i->y];
 }
 
-/*
- * SHR x
- * Set Vx = Vx SHR 1.
- *
- * If the least-significant bit of Vx is 1, then VF is set to 1, otherwise 0.
- * Then Vx is divided by 2.
- */
-void exec_shr(chip8_engine_t *e, const instruction_t *i)
-{
-    e->pc += 2;
-
-    if (is_v_reg_out_of_bound(i->x))
-        return;
-
-    e->v[0xf] = e->v[i->x] & 1;
-    e->v[i->x] /= 2;
-}
-
 /*
  * SUBN Vx, Vy
  * Set Vx = Vy - Vx, set VF = NOT borrow.
@@ -293,24 +217,6 @@ void exec_subn(chip8_engine_t *e, const instruction_t *i)
     e->v[i->x] = e->v[i->y] - e->v[i->x];
 }
 
-/*
- * SHL Vx
- * Set Vx = Vx SHL 1.
- *
- * If the most-significant bit of Vx is 1, then VF is set to 1, otherwise to 0.
- * Then Vx is multiplied by 2.
- */
-void exec_shl(chip8_engine_t *e, const instruction_t *i)
-{
-    e->pc += 2;
-
-    if (is_v_reg_out_of_bound(i->x))
-        return;
-
-    e->v[0xf] = (e->v[i->x] >> 7) & 1;
-    e->v[i->x] *= 2;
-}
-
 /*
  * SKIPN x, y
  * Skip next instruction if Vx != Vy.
@@ -342,17 +248,6 @@ void exec_mvi_i_nnn(chip8_engine_t *e, const instruction_t *i)
     e->i = i->nnn;
 }
 
-/*
- * JP V0, nnn
- * Jump to location nnn + V0.
-
- * The program counter is set to nnn plus the value of V0.
- */
-void exec_jmp_v0_nnn(chip8_engine_t *e, const instruction_t *i)
-{
-    e->pc = i->nnn + (uint16_t)e->v[0];
-}
-
 /*
  * RND x, kk
  * Set Vx = random byte AND kk.
@@ -367,52 +262,7 @@ void exec_rand(chip8_engine_t *e, const instruction_t *i)
     if (is_v_reg_out_of_bound(i->x))
         return;
 
-    e->v[i->x] = generate_random_byte() & i->kk;
-}
-
-/*
- *
- * DISP x, y, n
- * Display n-byte sprite starting at memory location I at (Vx, Vy), set VF = collision.
- *
- * The interpreter reads n bytes from memory, starting at the address stored in I.
- * These bytes are then displayed as sprites on screen at coordinates (Vx, Vy).
- * Sprites are XORed onto the existing screen.
- * If this causes any pixels to be erased, VF is set to 1, otherwise it is set to 0.
- * If the sprite is positioned so part of it is outside the coordinates of the display,
- * it wraps around to the opposite side of the screen.
- * See instruction 8xy3 for more information on XOR, and section 2.4, Display,
- * for more information on the Chip-8 screen and sprites.
- */
-void exec_disp(chip8_engine_t *e, const instruction_t *i)
-{
-    e->pc += 2;
-    if (is_v_reg_out_of_bound(i->x) || is_v_reg_out_of_bound(i->y))
-        return;
-
-    uint8_t x = e->v[i->x];
-    uint8_t y = e->v[i->y];
-    e->v[0xf] = 0;
-
-    for (uint8_t j = 0; j < i->n; j++) {
-        uint8_t pixels = e->memory[e->i + j];
-
-        for (uint8_t k = 0; k < 8; k++) {
-            uint8_t x_incr = (x + (7 - k)) % CHIP8_WINDOW_WIDTH;
-            uint8_t y_incr = (y + j) % CHIP8_WINDOW_HEIGHT;
-            uint8_t sprite_pixel = pixels >> k & 1;
-            uint8_t screen_pixel = get_pixel(e->screen, x_incr, y_incr);
-
-            if (sprite_pixel && screen_pixel) e->v[0xf] = 1;
-
-            if (sprite_pixel)
-                sprite_pixel = 0xff;
-
-            draw_pixel(e->screen, x_incr, y_incr, screen_pixel ^ sprite_pixel);
-        }
-    }
-
-    e->draw_flag = true;
+    e->v[i->x] = generate_random_byte(&e->rng) & i->kk;
 }
 
 /*
@@ -431,7 +281,9 @@ void exec_skip_key(chip8_engine_t *e, const instruction_t *i)
 
     int x = e->v[i->x];
 
-    if (x < KEY_SIZE && e->keyboard[x])
+    stamp_latency(e->latency, LATENCY_OBSERVED);
+
+    if (x < KEY_SIZE && e->keyboard >> x & 1)
         e->pc += 2;
 }
 
@@ -451,7 +303,9 @@ void exec_skipn_key(chip8_engine_t *e, const instruction_t *i)
 
     int x = e->v[i->x];
 
-    if (x < KEY_SIZE && !e->keyboard[x])
+    stamp_latency(e->latency, LATENCY_OBSERVED);
+
+    if (x < KEY_SIZE && !(e->keyboard >> x & 1))
         e->pc += 2;
 }
 
@@ -468,7 +322,7 @@ void exec_mov_x_delay(chip8_engine_t *e, const instruction_t *i)
     if (is_v_reg_out_of_bound(i->x))
         return;
 
-    e->v[i->x] = e->delay;
+    e->v[i->x] = get_timer(e, &e->delay);
 }
 
 /*
@@ -485,12 +339,11 @@ void exec_mov_key(chip8_engine_t *e, const instruction_t *i)
         return;
     }
 
-    for (int j = 0; j < KEY_SIZE; j++) {
-        if (e->keyboard[j]) {
-            e->v[i->x] = j;
-            e->pc += 2;
-            break;
-        }
+    stamp_latency(e->latency, LATENCY_OBSERVED);
+
+    if (e->keyboard) {
+        e->v[i->x] = __builtin_ctz(e->keyboard);
+        e->pc += 2;
     }
 }
 
@@ -507,7 +360,7 @@ void exec_mov_delay_x(chip8_engine_t *e, const instruction_t *i)
     if (is_v_reg_out_of_bound(i->x))
         return;
 
-    e->delay = e->v[i->x];
+    set_timer(e, &e->delay, e->v[i->x]);
 }
 
 /*
@@ -523,7 +376,7 @@ void exec_mov_sound(chip8_engine_t *e, const instruction_t *i)
     if (is_v_reg_out_of_bound(i->x))
         return;
 
-    e->sound = e->v[i->x];
+    set_timer(e, &e->sound, e->v[i->x]);
 }
 
 /*
@@ -579,48 +432,11 @@ void exec_movbcd(chip8_engine_t *e, const instruction_t *i)
 
     uint8_t x = e->v[i->x];
 
-    e->memory[e->i]     = x % 1000 / 100;
-    e->memory[e->i + 1] = x % 100 / 10;
-    e->memory[e->i + 2] = x % 10;
-}
-
-/*
- *  MOVM I, x
- * Store registers V0 through Vx in memory starting at location I.
- *
- * The interpreter copies the values of registers V0 through Vx into memory,
- * starting at the address in I
- */
-void exec_movm_i_x(chip8_engine_t *e, const instruction_t *i)
-{
-    e->pc += 2;
-
-    if (is_v_reg_out_of_bound(i->x))
-        return;
-
-    for (uint8_t j = 0; j <= i->x; j++)
-        e->memory[e->i + j] = e->v[j];
-
-    e->i += i->x + 1;
-}
-
-/*
- * MOVM x, I
- * Read registers V0 through Vx from memory starting at location I.
- *
- * The interpreter reads values from memory starting at location I into registers V0 through Vx.
- */
-void exec_movm_x_i(chip8_engine_t *e, const instruction_t *i)
-{
-    e->pc += 2;
-
-    if (is_v_reg_out_of_bound(i->x))
-        return;
-
-    for (uint8_t j = 0; j <= i->x; j++)
-        e->v[j] = e->memory[e->i + j];
+    write_memory(e, MEMORY_ADDRESS(e->i), x % 1000 / 100);
+    write_memory(e, MEMORY_ADDRESS(e->i + 1), x % 100 / 10);
+    write_memory(e, MEMORY_ADDRESS(e->i + 2), x % 10);
 
-    e->i += i->x + 1;
+    invalidate_predecoded(e, e->i, 3);
 }
 
 void exec_unknown(chip8_engine_t *e, const instruction_t *i)
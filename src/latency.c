@@ -0,0 +1,153 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "latency.h"
+#include "clock.h"
+
+// A sample still in flight after this long is considered ignored by the ROM
+#define LATENCY_SAMPLE_TIMEOUT  S_TO_US(1)
+
+// The printed histogram has one row per millisecond
+#define LATENCY_BUCKETS_PER_ROW (1000 / LATENCY_BUCKET_US)
+#define LATENCY_BAR_WIDTH       50
+
+static const char *intervals_strings[LATENCY_INTERVALS_SIZE] = {
+        "input -> observed",
+        "observed -> drawn",
+        "drawn -> presented",
+        "input -> presented"
+};
+
+void init_latency_probe(latency_probe_t *p)
+{
+    memset(p->histograms, 0, sizeof(p->histograms));
+    p->samples = 0;
+    p->dropped = 0;
+
+    atomic_init(&p->stage, LATENCY_INPUT);
+    atomic_init(&p->frame_id, 0);
+    for (int s = 0; s < LATENCY_STAGES_SIZE; s++)
+        atomic_init(&p->stamps[s], 0);
+}
+
+/*
+ * Called by the render thread after the new key state has been handed to the emulation thread,
+ * so that the emulation thread sees that state once it acquires the stage.
+ */
+void start_latency_sample(latency_probe_t *p, long int input_time)
+{
+    int stage = atomic_load_explicit(&p->stage, memory_order_acquire);
+
+    if (stage != LATENCY_INPUT) {
+        if (input_time - atomic_load_explicit(&p->stamps[LATENCY_INPUT], memory_order_relaxed) < LATENCY_SAMPLE_TIMEOUT)
+            return;
+        p->dropped++;
+    }
+
+    atomic_store_explicit(&p->stamps[LATENCY_INPUT], input_time, memory_order_relaxed);
+    atomic_store_explicit(&p->stage, LATENCY_APPLIED, memory_order_release);
+}
+
+void reach_latency_stage(latency_probe_t *p, latency_stage_t stage)
+{
+    int expected = stage;
+
+    atomic_store_explicit(&p->stamps[stage], get_monotonic_time(), memory_order_relaxed);
+    atomic_compare_exchange_strong_explicit(
+        &p->stage,
+        &expected,
+        stage + 1,
+        memory_order_acq_rel,
+        memory_order_relaxed
+    );
+}
+
+void publish_latency_frame(latency_probe_t *p, uint64_t frame_id)
+{
+    if (atomic_load_explicit(&p->stage, memory_order_relaxed) != LATENCY_PUBLISHED)
+        return;
+
+    atomic_store_explicit(&p->frame_id, frame_id, memory_order_relaxed);
+    reach_latency_stage(p, LATENCY_PUBLISHED);
+}
+
+static void record_interval(latency_probe_t *p, latency_interval_t interval, latency_stage_t from, latency_stage_t to)
+{
+    long int elapsed = atomic_load_explicit(&p->stamps[to], memory_order_relaxed)
+        - atomic_load_explicit(&p->stamps[from], memory_order_relaxed);
+    long int bucket = elapsed / LATENCY_BUCKET_US;
+
+    if (bucket < 0)
+        bucket = 0;
+    if (bucket >= LATENCY_BUCKETS)
+        bucket = LATENCY_BUCKETS - 1;
+
+    p->histograms[interval][bucket]++;
+}
+
+void present_latency_frame(latency_probe_t *p, uint64_t frame_id, long int present_time)
+{
+    if (atomic_load_explicit(&p->stage, memory_order_acquire) != LATENCY_PRESENTED)
+        return;
+
+    if (frame_id < atomic_load_explicit(&p->frame_id, memory_order_relaxed))
+        return;
+
+    atomic_store_explicit(&p->stamps[LATENCY_PRESENTED], present_time, memory_order_relaxed);
+
+    record_interval(p, INPUT_TO_OBSERVED, LATENCY_INPUT, LATENCY_OBSERVED);
+    record_interval(p, OBSERVED_TO_DRAWN, LATENCY_OBSERVED, LATENCY_DRAWN);
+    record_interval(p, DRAWN_TO_PRESENTED, LATENCY_DRAWN, LATENCY_PRESENTED);
+    record_interval(p, INPUT_TO_PRESENTED, LATENCY_INPUT, LATENCY_PRESENTED);
+    p->samples++;
+
+    atomic_store_explicit(&p->stage, LATENCY_INPUT, memory_order_release);
+}
+
+// Upper bound in microseconds of the bucket holding the given fraction of the samples
+static long int get_percentile(const uint32_t histogram[LATENCY_BUCKETS], uint32_t samples, double fraction)
+{
+    uint32_t rank = (uint32_t)(samples * fraction);
+    uint32_t count = 0;
+
+    for (int b = 0; b < LATENCY_BUCKETS; b++) {
+        count += histogram[b];
+        if (count > rank)
+            return (long int)(b + 1) * LATENCY_BUCKET_US;
+    }
+
+    return LATENCY_BUCKETS * LATENCY_BUCKET_US;
+}
+
+void print_latency_report(const latency_probe_t *p)
+{
+    printf("latency : %u samples, %u dropped\n", p->samples, p->dropped);
+
+    if (!p->samples)
+        return;
+
+    for (int l = 0; l < LATENCY_INTERVALS_SIZE; l++) {
+        printf(
+            "%-20s p50 = %6.1f ms, p99 = %6.1f ms\n",
+            intervals_strings[l],
+            US_TO_MS((double)get_percentile(p->histograms[l], p->samples, 0.50)),
+            US_TO_MS((double)get_percentile(p->histograms[l], p->samples, 0.99))
+        );
+    }
+
+    printf("%s histogram :\n", intervals_strings[INPUT_TO_PRESENTED]);
+    for (int b = 0; b < LATENCY_BUCKETS; b += LATENCY_BUCKETS_PER_ROW) {
+        uint32_t count = 0;
+
+        for (int r = b; r < b + LATENCY_BUCKETS_PER_ROW; r++)
+            count += p->histograms[INPUT_TO_PRESENTED][r];
+
+        if (!count)
+            continue;
+
+        printf("  < %4ld ms %6u ", US_TO_MS((long int)(b + LATENCY_BUCKETS_PER_ROW) * LATENCY_BUCKET_US), count);
+        for (uint32_t bar = 0; bar < count * LATENCY_BAR_WIDTH / p->samples + 1; bar++)
+            putchar('#');
+        putchar('\n');
+    }
+}
@@ -1,72 +1,397 @@
+#include <errno.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 #include <time.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/stat.h>
 
 #ifdef EMSCRIPTEN
 #include <emscripten.h>
 #endif
 
+#include "cfg.h"
 #include "disas.h"
+#include "disas_corpus.h"
 #include "utils.h"
 #include "display.h"
+#include "batch.h"
+#include "fusion.h"
+#include "rom_pack.h"
+#include "trace.h"
+#include "profiler.h"
+#include "metrics.h"
+#include "explore.h"
+#include "scanner.h"
 
-#define COMMANDS_SIZE 2
+#define COMMANDS_SIZE 7
+
+#define DEFAULT_WALL_INSTANCES 16
 
 typedef enum command {
     DISAS,
     INTERPRET,
+    WALL,
+    PACK,
+    TRACE,
+    EXPLORE,
+    SCAN,
     UNKNOWN_COMMAND
 } command_t;
 
 static const char *commands[COMMANDS_SIZE + 1] = {
         "disas",
         "interpret",
+        "wall",
+        "pack",
+        "trace",
+        "explore",
+        "scan",
         NULL
 };
 
+static volatile sig_atomic_t latency_report_requested = 0;
+
+static void request_latency_report(int sig)
+{
+    (void)sig;
+    latency_report_requested = 1;
+}
+
+static bool parse_execution_engine(const char *str, execution_engine_t *engine)
+{
+    for (int i = 0; str && execution_engines_strings[i]; i++) {
+        if (!strcmp(str, execution_engines_strings[i])) {
+            *engine = i;
+            return false;
+        }
+    }
+
+    dprintf(2, "%s : unknown execution engine\n", str ? str : "(null)");
+    return true;
+}
+
+static bool parse_quirk_profile(const char *str, quirk_profile_t *profile)
+{
+    for (int i = 0; str && quirk_profiles_strings[i]; i++) {
+        if (!strcmp(str, quirk_profiles_strings[i])) {
+            *profile = i;
+            return false;
+        }
+    }
+
+    dprintf(2, "%s : unknown quirk profile\n", str ? str : "(null)");
+    return true;
+}
+
+static bool parse_disas_format(const char *str, disas_format_t *format)
+{
+    for (int i = 0; str && disas_formats_strings[i]; i++) {
+        if (!strcmp(str, disas_formats_strings[i])) {
+            *format = i;
+            return false;
+        }
+    }
+
+    dprintf(2, "%s : unknown output format\n", str ? str : "(null)");
+    return true;
+}
+
+// Options given on the command line take precedence over the ROM database
+static void override_batch_tuning(batch_t *batch, int ipf, quirk_profile_t quirk_profile)
+{
+    if (ipf)
+        set_batch_instructions_per_frame(batch, ipf);
+
+    if (quirk_profile != QUIRK_PROFILES_SIZE)
+        set_batch_quirk_profile(batch, quirk_profile);
+}
+
+static const char *get_key_bindings(const batch_t *batch, const char *keymap)
+{
+    const rom_entry_t *rom = batch->engines[0].rom;
+
+    if (keymap)
+        return keymap;
+
+    return rom && rom->key_bindings ? rom->key_bindings : DEFAULT_KEY_BINDINGS;
+}
+
+// One name of every distinct ROM in the pack, NULL on failure
+static const char **list_pack_roms(const rom_pack_t *pack, int *roms_count)
+{
+    const char **roms = malloc((pack->header->names_count + 1) * sizeof(const char *));
+    bool *packed = calloc(pack->header->roms_count + 1, sizeof(bool));
+
+    *roms_count = 0;
+
+    if (!roms || !packed) {
+        dprintf(2, "malloc failed\n");
+        free(roms);
+        free(packed);
+        return NULL;
+    }
+
+    for (uint32_t n = 0; n < pack->header->names_count; n++) {
+        if (!packed[pack->names[n].rom])
+            roms[(*roms_count)++] = (const char *)pack->map + pack->names[n].name_offset;
+        packed[pack->names[n].rom] = true;
+    }
+
+    free(packed);
+    return roms;
+}
+
+/*
+ * Load the batch from ROM files, or from the ROMs of the pack at pack_path when it is not NULL.
+ * The pack is only mapped while loading. Without ROMs, every distinct ROM of the pack is loaded.
+ */
+static bool load_batch(batch_t *batch, const char **roms, int roms_count, const char *pack_path, int instances, int threads)
+{
+    rom_pack_t pack;
+    const char **pack_roms = NULL;
+    bool err;
+
+    if (!pack_path && !roms_count)
+        dprintf(2, "No ROM given\n");
+
+    if (!pack_path)
+        return !roms_count || init_batch(batch, roms, roms_count, NULL, instances, threads);
+
+    if (open_rom_pack(&pack, pack_path))
+        return true;
+
+    if (!roms_count) {
+        if (!(pack_roms = list_pack_roms(&pack, &roms_count))) {
+            close_rom_pack(&pack);
+            return true;
+        }
+
+        roms = pack_roms;
+    }
+
+    err = !roms_count || init_batch(batch, roms, roms_count, &pack, instances, threads);
+    if (!roms_count)
+        dprintf(2, "%s : empty ROM pack\n", pack_path);
+
+    free(pack_roms);
+    close_rom_pack(&pack);
+
+    return err;
+}
+
 static int usage(const char *prog_name, bool is_error)
 {
     int fd = is_error + 1;
 
     dprintf(fd, \
         "USAGE\n"
-        "\t%s disas|interpret file.ch8 [--debug]\n"
-    , prog_name);
+        "\t%s disas file.ch8 [file.ch8 ...] [--debug] [--format text|json|binary] [--histogram] [--threads N]\n"
+        "\t\t[--pack FILE] [--cfg] [--blocks OUT]\n"
+        "\t%s interpret file.ch8 [--ipf N] [--keymap KEYS] [--show-fps] [--disas] [--dump-regs] [--latency]\n"
+        "\t\t[--mute] [--audio-clock] [--engine reference|predecoded|fused] [--fusions] [--perf-counters]\n"
+        "\t\t[--quirks modern|vip|chip48|schip] [--pack FILE] [--blocks FILE] [--profile OUT.folded] [TRACE OPTIONS]\n"
+        "\t\t[METRICS OPTIONS] [VERIFY OPTIONS] [--replay INPUT.c8in]\n"
+        "\t%s wall file.ch8 [file.ch8 ...] [--instances N] [--threads N] [--ipf N] [--keymap KEYS] [--show-fps]\n"
+        "\t\t[--engine reference|predecoded|fused] [--quirks modern|vip|chip48|schip] [--pack FILE] [--blocks FILE]\n"
+        "\t\t[--perf-counters] [TRACE OPTIONS] [METRICS OPTIONS] [VERIFY OPTIONS]\n"
+        "\t%s pack out.c8pk file.ch8 [file.ch8 ...]\n"
+        "\t%s trace trace.c8tr [--pc LOW-HIGH] [--op OP,...] [--reg vX|I] [--cycles FROM-TO] [--format text|json]\n"
+        "\t\t[--count]\n"
+        "\t%s explore file.ch8 [--time SECONDS] [--threads N] [--corpus N] [--inputs DIR] [--ipf N]\n"
+        "\t\t[--quirks modern|vip|chip48|schip] [--pack FILE]\n"
+        "\t%s scan file.ch8 STEP [STEP ...] [--instances N] [--threads N] [--ipf N] [--engine reference|predecoded|fused]\n"
+        "\t\t[--quirks modern|vip|chip48|schip] [--pack FILE]\n"
+        "SCAN STEPS\n"
+        "\tframes:N random:N keys:KEYS|- eq:VALUE changed unchanged increased decreased\n"
+        "TRACE OPTIONS\n"
+        "\t--trace FILE [--trace-size RECORDS] [--trace-pc LOW-HIGH] [--trace-op OP,...]\n"
+        "METRICS OPTIONS\n"
+        "\t--metrics FILE [--metrics-interval SECONDS]\n"
+        "VERIFY OPTIONS\n"
+        "\t--verify [--verify-interval INSTRUCTIONS]\n"
+        "\tWith --pack, ROMs are names or SHA-1 of ROMs in the pack, disas and wall run all of them if none is given\n"
+        "\tdisas --blocks saves the basic blocks of the ROM, interpret and wall --blocks predecode them\n"
+        "\texplore --inputs writes the inputs reaching new addresses, interpret --replay plays them back\n"
+        "\tscan runs the steps in order on every instance, filters keep the memory bytes matching them\n"
+        "\tsince the previous filter, keys are hexadecimal digits\n"
+        "\tAddresses are hexadecimal, op codes are mnemonics\n"
+    , prog_name, prog_name, prog_name, prog_name, prog_name, prog_name, prog_name);
 
     return is_error;
 }
 
-static int disassemble(int ac, const char **av)
+/*
+ * Build the control flow graph of the ROM, print it with --cfg and save its basic blocks with --blocks.
+ */
+static int disassemble_cfg(const rom_pack_t *pack, const char *name, bool print, const char *index_path)
 {
-    bool debug = ac > 1 && !strcmp(av[1], "--debug");
-    size_t progsize = 0;
-    uint8_t *buf = NULL;
-    uint16_t pc = INITIAL_PROGRAM_COUNTER;
+    cfg_t *cfg = malloc(sizeof(cfg_t));
+    disas_rom_t rom;
+    uint8_t *buf;
+    int exit_code = 0;
 
-    if (!(buf = read_file_offset(*av, INITIAL_PROGRAM_COUNTER, &progsize, MAX_PROG_SIZE)))
+    if (!cfg) {
+        dprintf(2, "malloc failed\n");
         return 1;
+    }
 
+    if (load_disas_rom(pack, name, &rom, &buf) || build_cfg(cfg, rom.content, rom.size)) {
+        free(buf);
+        free(cfg);
+        return 1;
+    }
 
-    for (; (size_t)pc < progsize; pc += 2)
-        disas(buf, pc , debug);
+    if (print)
+        print_cfg(cfg);
+    if (index_path && write_block_index(cfg, rom.sha1, index_path))
+        exit_code = 1;
 
+    destroy_cfg(cfg);
+    free(cfg);
     free(buf);
 
-    return 0;
+    return exit_code;
+}
+
+/*
+ * Disassemble every 2 bytes of the ROMs on all cores, or follow the control flow of a single ROM
+ * from its entry point with --cfg, which tells code from data.
+ * With --histogram, only the op code counts of all the ROMs are written.
+ */
+static int disassemble(int ac, const char **av)
+{
+    const char *roms[ac];
+    int roms_count = 0;
+    const char **pack_roms = NULL;
+    bool cfg = false;
+    const char *pack_path = NULL;
+    const char *index_path = NULL;
+    int threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    rom_pack_t pack = {.map = NULL};
+    disas_corpus_t corpus = {.fd = 1};
+    int exit_code = 0;
+
+    for (int i = 0; i < ac; i++) {
+        if (!strcmp(av[i], "--debug"))
+            corpus.options.debug = true;
+        else if (!strcmp(av[i], "--cfg"))
+            cfg = true;
+        else if (!strcmp(av[i], "--histogram"))
+            corpus.options.histogram_only = true;
+        else if (!strcmp(av[i], "--threads")) {
+            if (parse_positive_int(av[++i], &threads))
+                return 1;
+        } else if (!strcmp(av[i], "--format")) {
+            if (parse_disas_format(av[++i], &corpus.options.format))
+                return 1;
+        } else if (!strcmp(av[i], "--pack") && av[i + 1])
+            pack_path = av[++i];
+        else if (!strcmp(av[i], "--blocks") && av[i + 1])
+            index_path = av[++i];
+        else
+            roms[roms_count++] = av[i];
+    }
+
+    if (pack_path && open_rom_pack(&pack, pack_path))
+        return 1;
+
+    // Every ROM of the pack when none is given
+    if (pack_path && !roms_count && !(pack_roms = list_pack_roms(&pack, &roms_count))) {
+        close_rom_pack(&pack);
+        return 1;
+    }
+
+    if (!roms_count) {
+        dprintf(2, "No ROM given\n");
+        exit_code = 1;
+    } else if ((cfg || index_path) && roms_count > 1) {
+        dprintf(2, "--cfg and --blocks take a single ROM\n");
+        exit_code = 1;
+    } else if (cfg || index_path)
+        exit_code = disassemble_cfg(pack_path ? &pack : NULL, pack_roms ? pack_roms[0] : roms[0], cfg, index_path);
+    else {
+        corpus.roms = pack_roms ? pack_roms : roms;
+        corpus.roms_count = roms_count;
+        corpus.pack = pack_path ? &pack : NULL;
+        corpus.options.named = roms_count > 1;
+
+        exit_code = disas_corpus(&corpus, threads);
+        if (corpus.options.histogram_only && write_opcode_histogram(corpus.histogram, corpus.options.format, 1))
+            exit_code = 1;
+    }
+
+    free(pack_roms);
+    if (pack_path)
+        close_rom_pack(&pack);
+
+    return exit_code;
 }
 
+/*
+ * The engine runs on its own worker thread, paced at FREQUENCY frames per second,
+ * while this thread owns SDL : it drains input and presents the latest completed frame.
+ * With --latency, input to present latency is reported on exit and on SIGUSR1.
+ * With --audio-clock, the audio device rather than the monotonic clock paces emulation.
+ * With --fusions, the fused sequences found in the ROM and their dispatches are reported on exit.
+ * Known ROMs get their speed, quirks and key bindings from the ROM database, unless given as options.
+ * With --blocks, the basic blocks saved by disas --blocks are predecoded before starting.
+ * With --trace, executed instructions are recorded to a file, see the trace command.
+ * With --profile, executed instructions are counted per address, op code and call stack,
+ * reported on exit and written as folded stacks for flamegraph.pl.
+ * With --metrics, the metrics registry is exported every interval for Prometheus,
+ * with --show-fps its rates are printed every interval.
+ * With --perf-counters, hardware events of the emulation thread are reported on exit,
+ * per emulated instruction and per frame.
+ * With --verify, the reference engine runs in the shadow of the selected one and their states are compared
+ * every interval instructions, a divergence is dumped and the exit status is 1.
+ * With --replay, the keys of an input written by explore replace the keyboard until it ends,
+ * on the speed, quirks and random numbers it was found with.
+ */
 static int interpret(int ac, const char **av)
 {
     bool show_fps = false;
     bool disas = false;
     bool dump_regs = false;
+    bool measure_latency = false;
+    bool mute = false;
+    bool audio_clock = false;
+    bool report_fusions = false;
+    bool count_perf = false;
+    // Unless given, these come from the ROM database or default to DEFAULT_* values
+    int ipf = 0;
+    const char *keymap = NULL;
+    execution_engine_t engine = DEFAULT_EXECUTION_ENGINE;
+    quirk_profile_t quirk_profile = QUIRK_PROFILES_SIZE;
+    const char *pack_path = NULL;
+    const char *index_path = NULL;
+    const char *trace_path = NULL;
+    int trace_size = DEFAULT_TRACE_CAPACITY;
+    trace_filter_t trace_filter;
+    uint64_t trace_op_codes = 0;
+    const char *profile_path = NULL;
+    const char *metrics_path = NULL;
+    int metrics_interval = DEFAULT_METRICS_INTERVAL;
+    bool verify = false;
+    int verify_interval = DEFAULT_VERIFY_INTERVAL;
+    const char *replay_path = NULL;
 
-    chip8_engine_t engine;
+    batch_t batch;
     display_t display;
-    display_event_t ev = {KEY_SIZE, false};
+    metrics_t metrics;
+    metrics_exporter_t exporter;
+    perf_report_t perf_report;
+    latency_probe_t probe;
+    explore_input_t replay = {.keys = NULL};
+    profiler_t profiler = {.nodes = NULL};
+    audio_t audio = {.device = 0};
+    uint16_t keys = 0;
+    uint16_t previous_keys = 0;
     int exit_code = 0;
 
+    init_trace_filter(&trace_filter);
+
     for (int i = 1; i < ac; i++) {
         if (!strcmp(av[i], "--show-fps"))
             show_fps = true;
@@ -74,36 +399,658 @@ static int interpret(int ac, const char **av)
             disas = true;
         if (!strcmp(av[i], "--dump-regs"))
             dump_regs = true;
+        if (!strcmp(av[i], "--latency"))
+            measure_latency = true;
+        if (!strcmp(av[i], "--mute"))
+            mute = true;
+        if (!strcmp(av[i], "--audio-clock"))
+            audio_clock = true;
+        if (!strcmp(av[i], "--fusions"))
+            report_fusions = true;
+        if (!strcmp(av[i], "--perf-counters"))
+            count_perf = true;
+        if (!strcmp(av[i], "--ipf") && parse_positive_int(av[++i], &ipf))
+            return 1;
+        if (!strcmp(av[i], "--keymap") && av[i + 1])
+            keymap = av[++i];
+        if (!strcmp(av[i], "--engine") && parse_execution_engine(av[++i], &engine))
+            return 1;
+        if (!strcmp(av[i], "--quirks") && parse_quirk_profile(av[++i], &quirk_profile))
+            return 1;
+        if (!strcmp(av[i], "--pack") && av[i + 1])
+            pack_path = av[++i];
+        if (!strcmp(av[i], "--blocks") && av[i + 1])
+            index_path = av[++i];
+        if (!strcmp(av[i], "--trace") && av[i + 1])
+            trace_path = av[++i];
+        if (!strcmp(av[i], "--trace-size") && parse_positive_int(av[++i], &trace_size))
+            return 1;
+        if (!strcmp(av[i], "--trace-pc") && parse_trace_range(av[++i], &trace_filter.low, &trace_filter.high))
+            return 1;
+        if (!strcmp(av[i], "--trace-op") && parse_trace_op_codes(av[++i], &trace_op_codes))
+            return 1;
+        if (!strcmp(av[i], "--profile") && av[i + 1])
+            profile_path = av[++i];
+        if (!strcmp(av[i], "--metrics") && av[i + 1])
+            metrics_path = av[++i];
+        if (!strcmp(av[i], "--metrics-interval") && parse_positive_int(av[++i], &metrics_interval))
+            return 1;
+        if (!strcmp(av[i], "--verify"))
+            verify = true;
+        if (!strcmp(av[i], "--verify-interval") && parse_positive_int(av[++i], &verify_interval))
+            return 1;
+        if (!strcmp(av[i], "--replay") && av[i + 1])
+            replay_path = av[++i];
     }
 
-    init_chip8_engine(&engine);
-    if (load_file_to_memory(*av, engine.memory + INITIAL_PROGRAM_COUNTER, &engine.prog_size, MAX_PROG_SIZE))
-        return 1;
+    if (trace_op_codes)
+        trace_filter.op_codes = trace_op_codes;
 
     srandom(time(NULL));
 
-    if (init_display(&display, show_fps))
+    if (replay_path && read_explore_input(&replay, replay_path))
         return 1;
 
-    while (!exit_code) {
-        if (!poll_event(&display, &ev))
-            break;
+    if (load_batch(&batch, av, 1, pack_path, 1, 1)) {
+        destroy_explore_input(&replay);
+        return 1;
+    }
+
+    if (replay_path && memcmp(replay.header.sha1, batch.engines[0].sha1, SHA1_SIZE)) {
+        dprintf(2, "%s : found on another ROM\n", replay_path);
+        destroy_explore_input(&replay);
+        destroy_batch(&batch);
+        return 1;
+    }
+
+    // Fused dispatches may end a frame a few cycles late, the keys would change on other instructions
+    if (replay_path && engine == FUSED_ENGINE)
+        engine = PREDECODED_ENGINE;
+
+    if (set_batch_execution_engine(&batch, engine)) {
+        destroy_explore_input(&replay);
+        destroy_batch(&batch);
+        return 1;
+    }
+
+    override_batch_tuning(&batch, ipf, quirk_profile);
+    if (replay_path) {
+        override_batch_tuning(&batch, replay.header.instructions_per_frame, replay.header.quirk_profile);
+        batch.engines[0].rng = replay.header.rng;
+        batch.script = replay.keys;
+        batch.script_frames = replay.header.frames_count;
+    }
+
+    if ((index_path && warm_batch(&batch, index_path))
+        || (trace_path && set_batch_trace(&batch, trace_path, trace_size, &trace_filter))
+        || (profile_path && init_profiler(&profiler))) {
+        destroy_batch(&batch);
+        destroy_explore_input(&replay);
+        return 1;
+    }
+
+    init_metrics(&metrics, batch.instances);
+    batch.metrics = &metrics;
+    batch.disas = disas;
+    batch.dump_regs = dump_regs;
+    if (verify && set_batch_verify(&batch, verify_interval)) {
+        destroy_profiler(&profiler);
+        destroy_batch(&batch);
+        destroy_explore_input(&replay);
+        return 1;
+    }
+    if (profile_path)
+        batch.engines[0].profiler = &profiler;
 
-        if (ev.key < KEY_SIZE) engine.keyboard[ev.key] = ev.key_pressed;
+    if (measure_latency) {
+        init_latency_probe(&probe);
+        batch.engines[0].latency = &probe;
+        signal(SIGUSR1, &request_latency_report);
+    }
 
-        update_chip8_engine(&engine, disas);
+    if (init_display(&display)) {
+        destroy_profiler(&profiler);
+        destroy_batch(&batch);
+        destroy_explore_input(&replay);
+        return 1;
+    }
 
-        if (dump_regs)
-            chip8_dump_registers(&engine);
+    if (set_key_bindings(&display, get_key_bindings(&batch, keymap))) {
+        destroy_display(&display);
+        destroy_profiler(&profiler);
+        destroy_batch(&batch);
+        destroy_explore_input(&replay);
+        return 1;
+    }
+    display.metrics = &metrics;
 
-        if (engine.draw_flag) {
-            exit_code = render(&display, &engine.screen);
-            engine.draw_flag = false;
+    if (!mute) {
+        if (init_audio(&audio))
+            dprintf(2, "Warning : sound disabled\n");
+        else {
+            batch.audio = &audio;
+            batch.audio_clock = audio_clock;
         }
     }
 
+    if (count_perf) {
+        init_perf_report(&perf_report);
+        batch.perf = &perf_report;
+    }
+
+    if (start_batch(&batch)) {
+        if (count_perf)
+            destroy_perf_report(&perf_report);
+        destroy_audio(&audio);
+        destroy_display(&display);
+        destroy_profiler(&profiler);
+        destroy_batch(&batch);
+        destroy_explore_input(&replay);
+        return 1;
+    }
+
+    init_metrics_exporter(&exporter, metrics_path, metrics_interval, show_fps);
+    while (!exit_code && poll_keys(&display, &keys)) {
+        set_batch_keys(&batch, keys);
+        // A failed export is reported once, emulation goes on without it
+        if (export_metrics(&exporter, &metrics, false))
+            exporter.filepath = NULL;
+
+        if (measure_latency && keys != previous_keys)
+            start_latency_sample(&probe, display.key_event_time);
+        previous_keys = keys;
+
+        exit_code = render_latest_frame(&display, batch.frames);
+
+        if (!measure_latency)
+            continue;
+
+        present_latency_frame(&probe, display.presented_frame, display.present_time);
+
+        if (latency_report_requested) {
+            latency_report_requested = 0;
+            print_latency_report(&probe);
+        }
+    }
+
+    stop_batch(&batch);
+    destroy_audio(&audio);
+    destroy_display(&display);
+    if (exporter.filepath && export_metrics(&exporter, &metrics, true))
+        exit_code = 1;
+
+    if (report_fusions)
+        print_fusions_report(&batch.engines[0]);
+
+    if (count_batch_divergences(&batch))
+        exit_code = 1;
+
+    if (count_perf) {
+        print_perf_report(&perf_report);
+        destroy_perf_report(&perf_report);
+    }
+
+    if (profile_path) {
+        print_profile_report(&profiler, &batch.engines[0]);
+        if (write_folded_stacks(&profiler, profile_path))
+            exit_code = 1;
+        destroy_profiler(&profiler);
+    }
+    destroy_batch(&batch);
+    destroy_explore_input(&replay);
+
+    if (measure_latency)
+        print_latency_report(&probe);
+
+    return exit_code;
+}
+
+/*
+ * Run many instances on worker threads and watch all of them at once,
+ * tiled in a single window. Instances cycle through the given ROMs.
+ * With --perf-counters, hardware events of all the workers are reported on exit.
+ * With --verify, every instance is checked against the reference engine, see interpret.
+ */
+static int wall(int ac, const char **av)
+{
+    const char *roms[ac];
+    int roms_count = 0;
+    int instances = DEFAULT_WALL_INSTANCES;
+    int threads = (int)sysconf(_SC_NPROCESSORS_ONLN) - 1;
+    // Unless given, these come from the ROM database or default to DEFAULT_* values
+    int ipf = 0;
+    bool show_fps = false;
+    bool count_perf = false;
+    const char *keymap = NULL;
+    execution_engine_t engine = DEFAULT_EXECUTION_ENGINE;
+    quirk_profile_t quirk_profile = QUIRK_PROFILES_SIZE;
+    const char *pack_path = NULL;
+    const char *index_path = NULL;
+    const char *trace_path = NULL;
+    int trace_size = DEFAULT_TRACE_CAPACITY;
+    trace_filter_t trace_filter;
+    uint64_t trace_op_codes = 0;
+    const char *metrics_path = NULL;
+    int metrics_interval = DEFAULT_METRICS_INTERVAL;
+    bool verify = false;
+    int verify_interval = DEFAULT_VERIFY_INTERVAL;
+
+    batch_t batch;
+    display_t display;
+    metrics_t metrics;
+    metrics_exporter_t exporter;
+    perf_report_t perf_report;
+    uint16_t keys = 0;
+    int exit_code = 0;
+
+    init_trace_filter(&trace_filter);
+
+    for (int i = 0; i < ac; i++) {
+        if (!strcmp(av[i], "--show-fps"))
+            show_fps = true;
+        else if (!strcmp(av[i], "--perf-counters"))
+            count_perf = true;
+        else if (!strcmp(av[i], "--verify"))
+            verify = true;
+        else if (!strcmp(av[i], "--instances")) {
+            if (parse_positive_int(av[++i], &instances))
+                return 1;
+        } else if (!strcmp(av[i], "--threads")) {
+            if (parse_positive_int(av[++i], &threads))
+                return 1;
+        } else if (!strcmp(av[i], "--ipf")) {
+            if (parse_positive_int(av[++i], &ipf))
+                return 1;
+        } else if (!strcmp(av[i], "--engine")) {
+            if (parse_execution_engine(av[++i], &engine))
+                return 1;
+        } else if (!strcmp(av[i], "--quirks")) {
+            if (parse_quirk_profile(av[++i], &quirk_profile))
+                return 1;
+        } else if (!strcmp(av[i], "--keymap") && av[i + 1])
+            keymap = av[++i];
+        else if (!strcmp(av[i], "--pack") && av[i + 1])
+            pack_path = av[++i];
+        else if (!strcmp(av[i], "--blocks") && av[i + 1])
+            index_path = av[++i];
+        else if (!strcmp(av[i], "--trace") && av[i + 1])
+            trace_path = av[++i];
+        else if (!strcmp(av[i], "--trace-size")) {
+            if (parse_positive_int(av[++i], &trace_size))
+                return 1;
+        } else if (!strcmp(av[i], "--trace-pc")) {
+            if (parse_trace_range(av[++i], &trace_filter.low, &trace_filter.high))
+                return 1;
+        } else if (!strcmp(av[i], "--trace-op")) {
+            if (parse_trace_op_codes(av[++i], &trace_op_codes))
+                return 1;
+        } else if (!strcmp(av[i], "--metrics") && av[i + 1])
+            metrics_path = av[++i];
+        else if (!strcmp(av[i], "--metrics-interval")) {
+            if (parse_positive_int(av[++i], &metrics_interval))
+                return 1;
+        } else
+            roms[roms_count++] = av[i];
+    }
+
+    if (trace_op_codes)
+        trace_filter.op_codes = trace_op_codes;
+
+    if (threads < 1)
+        threads = 1;
+
+    srandom(time(NULL));
+
+    if (load_batch(&batch, roms, roms_count, pack_path, instances, threads))
+        return 1;
+
+    if (set_batch_execution_engine(&batch, engine)) {
+        destroy_batch(&batch);
+        return 1;
+    }
+
+    override_batch_tuning(&batch, ipf, quirk_profile);
+    if ((index_path && warm_batch(&batch, index_path))
+        || (trace_path && set_batch_trace(&batch, trace_path, trace_size, &trace_filter))) {
+        destroy_batch(&batch);
+        return 1;
+    }
+
+    init_metrics(&metrics, batch.instances);
+    batch.metrics = &metrics;
+    if ((verify && set_batch_verify(&batch, verify_interval)) || init_wall_display(&display, batch.instances)) {
+        destroy_batch(&batch);
+        return 1;
+    }
+
+    if (set_key_bindings(&display, get_key_bindings(&batch, keymap))) {
+        destroy_display(&display);
+        destroy_batch(&batch);
+        return 1;
+    }
+    display.metrics = &metrics;
+
+    if (count_perf) {
+        init_perf_report(&perf_report);
+        batch.perf = &perf_report;
+    }
+
+    if (start_batch(&batch)) {
+        if (count_perf)
+            destroy_perf_report(&perf_report);
+        destroy_display(&display);
+        destroy_batch(&batch);
+        return 1;
+    }
+
+    init_metrics_exporter(&exporter, metrics_path, metrics_interval, show_fps);
+    while (!exit_code && poll_keys(&display, &keys)) {
+        set_batch_keys(&batch, keys);
+        // A failed export is reported once, emulation goes on without it
+        if (export_metrics(&exporter, &metrics, false))
+            exporter.filepath = NULL;
+        exit_code = render_wall(&display, batch.frames, batch.instances);
+    }
+
+    stop_batch(&batch);
     destroy_display(&display);
+    if (exporter.filepath && export_metrics(&exporter, &metrics, true))
+        exit_code = 1;
+    if (count_perf) {
+        print_perf_report(&perf_report);
+        destroy_perf_report(&perf_report);
+    }
+    if (count_batch_divergences(&batch)) {
+        dprintf(2, "%d instances diverged from the reference\n", count_batch_divergences(&batch));
+        exit_code = 1;
+    }
+    destroy_batch(&batch);
+
+    return exit_code;
+}
+
+/*
+ * Search key sequences reaching new addresses or new screens on every core, from the power-on state of the ROM.
+ * Prints the disassembly with the executions of every instruction, then what the search found.
+ * With --inputs, the inputs reaching new addresses are written to DIR, named after the first of them,
+ * see interpret --replay.
+ */
+static int explore(int ac, const char **av)
+{
+    const char *rom = NULL;
+    int seconds = DEFAULT_EXPLORE_TIME;
+    int threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    int corpus = DEFAULT_EXPLORE_CORPUS;
+    const char *inputs_path = NULL;
+    // Unless given, these come from the ROM database or default to DEFAULT_* values
+    int ipf = 0;
+    quirk_profile_t quirk_profile = QUIRK_PROFILES_SIZE;
+    const char *pack_path = NULL;
+
+    batch_t batch;
+    explorer_t *explorer = malloc(sizeof(explorer_t));
+    cfg_t *cfg = malloc(sizeof(cfg_t));
+    uint8_t content[MAX_PROG_SIZE];
+    int exit_code = 0;
+
+    if (!explorer || !cfg) {
+        dprintf(2, "malloc failed\n");
+        free(explorer);
+        free(cfg);
+        return 1;
+    }
+
+    for (int i = 0; i < ac && !exit_code; i++) {
+        if (!strcmp(av[i], "--time"))
+            exit_code = parse_positive_int(av[++i], &seconds);
+        else if (!strcmp(av[i], "--threads"))
+            exit_code = parse_positive_int(av[++i], &threads);
+        else if (!strcmp(av[i], "--corpus"))
+            exit_code = parse_positive_int(av[++i], &corpus);
+        else if (!strcmp(av[i], "--ipf"))
+            exit_code = parse_positive_int(av[++i], &ipf);
+        else if (!strcmp(av[i], "--quirks"))
+            exit_code = parse_quirk_profile(av[++i], &quirk_profile);
+        else if (!strcmp(av[i], "--inputs") && av[i + 1])
+            inputs_path = av[++i];
+        else if (!strcmp(av[i], "--pack") && av[i + 1])
+            pack_path = av[++i];
+        else
+            rom = av[i];
+    }
+
+    if (exit_code) {
+        free(explorer);
+        free(cfg);
+        return 1;
+    }
+
+    if (inputs_path && mkdir(inputs_path, 0755) && errno != EEXIST) {
+        dprintf(2, "%s : %s\n", inputs_path, strerror(errno));
+        free(explorer);
+        free(cfg);
+        return 1;
+    }
+
+    srandom(time(NULL));
+
+    if (load_batch(&batch, &rom, rom != NULL, pack_path, 1, 1)) {
+        free(explorer);
+        free(cfg);
+        return 1;
+    }
+
+    override_batch_tuning(&batch, ipf, quirk_profile);
+
+    for (uint16_t a = 0; a < batch.engines[0].prog_size; a++)
+        content[a] = read_memory(&batch.engines[0], INITIAL_PROGRAM_COUNTER + a);
+
+    if (build_cfg(cfg, content, batch.engines[0].prog_size)
+        || init_explorer(explorer, &batch.engines[0], threads, corpus, inputs_path)) {
+        destroy_batch(&batch);
+        free(explorer);
+        free(cfg);
+        return 1;
+    }
+
+    exit_code = run_explorer(explorer, seconds);
+
+    print_coverage(cfg, explorer->hits);
+    printf("\nExplore : %lu frames in %d s (%lu frames/s), %lu distinct screens, %lu snapshots, %lu inputs\n",
+           (unsigned long)explorer->frames, seconds, (unsigned long)explorer->frames / seconds,
+           (unsigned long)explorer->screens_count, (unsigned long)explorer->snapshots, (unsigned long)explorer->inputs);
 
+    destroy_explorer(explorer);
+    destroy_cfg(cfg);
+    destroy_batch(&batch);
+    free(explorer);
+    free(cfg);
+
+    return exit_code;
+}
+
+/*
+ * Run the steps on many instances of the ROM, each filter narrowing the memory bytes that could hold
+ * a variable such as a score, then list what is left. Instances run the reference engine unless told otherwise,
+ * the predecoded instructions of thousands of instances would not fit in the caches.
+ */
+static int scan(int ac, const char **av)
+{
+    const char *rom = NULL;
+    scan_step_t steps[ac];
+    int steps_count = 0;
+    int instances = DEFAULT_SCAN_INSTANCES;
+    int threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    // Unless given, these come from the ROM database or default to DEFAULT_* values
+    int ipf = 0;
+    execution_engine_t engine = REFERENCE_ENGINE;
+    quirk_profile_t quirk_profile = QUIRK_PROFILES_SIZE;
+    const char *pack_path = NULL;
+
+    batch_t batch;
+    scanner_t scanner;
+
+    for (int i = 0; i < ac; i++) {
+        if (!strcmp(av[i], "--instances")) {
+            if (parse_positive_int(av[++i], &instances))
+                return 1;
+        } else if (!strcmp(av[i], "--threads")) {
+            if (parse_positive_int(av[++i], &threads))
+                return 1;
+        } else if (!strcmp(av[i], "--ipf")) {
+            if (parse_positive_int(av[++i], &ipf))
+                return 1;
+        } else if (!strcmp(av[i], "--engine")) {
+            if (parse_execution_engine(av[++i], &engine))
+                return 1;
+        } else if (!strcmp(av[i], "--quirks")) {
+            if (parse_quirk_profile(av[++i], &quirk_profile))
+                return 1;
+        } else if (!strcmp(av[i], "--pack") && av[i + 1])
+            pack_path = av[++i];
+        else if (!rom)
+            rom = av[i];
+        else if (parse_scan_step(av[i], &steps[steps_count++]))
+            return 1;
+    }
+
+    if (!steps_count) {
+        dprintf(2, "No scan step given\n");
+        return 1;
+    }
+
+    srandom(time(NULL));
+
+    if (load_batch(&batch, &rom, rom != NULL, pack_path, instances, 1))
+        return 1;
+
+    if (set_batch_execution_engine(&batch, engine)) {
+        destroy_batch(&batch);
+        return 1;
+    }
+
+    override_batch_tuning(&batch, ipf, quirk_profile);
+    if (init_scanner(&scanner, batch.engines, batch.instances, threads)) {
+        destroy_batch(&batch);
+        return 1;
+    }
+
+    for (int s = 0; s < steps_count; s++) {
+        uint64_t candidates = run_scan_step(&scanner, &steps[s]);
+
+        if (steps[s].kind == FILTER_STEP && steps[s].filter == EQUAL_FILTER)
+            printf("eq:%-7u %10lu candidates\n", steps[s].value, (unsigned long)candidates);
+        else if (steps[s].kind == FILTER_STEP)
+            printf("%-10s %10lu candidates\n", scan_filters_strings[steps[s].filter], (unsigned long)candidates);
+    }
+
+    print_scan_candidates(&scanner);
+
+    destroy_scanner(&scanner);
+    destroy_batch(&batch);
+
+    return 0;
+}
+
+static bool parse_trace_register(const char *str, uint8_t *reg)
+{
+    unsigned int x;
+    int end = 0;
+
+    if (str && (!strcmp(str, "I") || !strcmp(str, "i"))) {
+        *reg = TRACE_REGISTER_I;
+        return false;
+    }
+
+    if (str && (*str == 'v' || *str == 'V') && sscanf(str + 1, "%1x%n", &x, &end) == 1 && !str[end + 1]) {
+        *reg = x;
+        return false;
+    }
+
+    dprintf(2, "%s : unknown register\n", str ? str : "(null)");
+    return true;
+}
+
+/*
+ * Decode a trace recorded by interpret or wall --trace, oldest record first,
+ * keeping only the records matching every given filter.
+ */
+static int search_trace(int ac, const char **av)
+{
+    trace_t trace;
+    trace_filter_t filter;
+    uint64_t op_codes = 0;
+    uint8_t reg = TRACE_NO_REGISTER;
+    unsigned long long from = 0;
+    unsigned long long to = UINT64_MAX;
+    disas_format_t format = TEXT_FORMAT;
+    bool count_only = false;
+    uint64_t matches = 0;
+    disas_buffer_t buf = {.size = 0};
+    char out[64 * 1024];
+    int exit_code = 0;
+
+    init_trace_filter(&filter);
+
+    for (int i = 1; i < ac; i++) {
+        if (!strcmp(av[i], "--pc") && parse_trace_range(av[++i], &filter.low, &filter.high))
+            return 1;
+        if (!strcmp(av[i], "--op") && parse_trace_op_codes(av[++i], &op_codes))
+            return 1;
+        if (!strcmp(av[i], "--reg") && parse_trace_register(av[++i], &reg))
+            return 1;
+        if (!strcmp(av[i], "--format") && parse_disas_format(av[++i], &format))
+            return 1;
+        if (!strcmp(av[i], "--count"))
+            count_only = true;
+        if (!strcmp(av[i], "--cycles")) {
+            const char *range = av[++i];
+
+            if (!range || sscanf(range, "%llu-%llu", &from, &to) != 2) {
+                dprintf(2, "%s : invalid cycle range\n", range ? range : "(null)");
+                return 1;
+            }
+        }
+    }
+
+    if (op_codes)
+        filter.op_codes = op_codes;
+
+    if (format == BINARY_FORMAT) {
+        dprintf(2, "The trace is binary already\n");
+        return 1;
+    }
+
+    if (open_trace(&trace, *av))
+        return 1;
+
+    buf.data = out;
+    buf.capacity = sizeof(out);
+
+    for (uint64_t n = get_trace_first(&trace); n < trace.header->head && !exit_code; n++) {
+        const trace_record_t *r = get_trace_record(&trace, n);
+
+        if (r->pc < filter.low || r->pc > filter.high || r->op_code >= OP_CODES_SIZE || !(filter.op_codes >> r->op_code & 1))
+            continue;
+        if (r->cycle < from || r->cycle > to || (reg != TRACE_NO_REGISTER && r->reg != reg))
+            continue;
+
+        matches++;
+        if (count_only)
+            continue;
+
+        if (buf.size + MAX_DISAS_RECORD_SIZE > buf.capacity)
+            exit_code = write_disas_buffer(&buf, 1);
+        buf.size += format_trace_record(buf.data + buf.size, r, format);
+    }
+
+    if (!exit_code)
+        exit_code = write_disas_buffer(&buf, 1);
+
+    if (count_only)
+        printf("%lu\n", (unsigned long)matches);
+
+    destroy_trace(&trace);
     return exit_code;
 }
 
@@ -112,6 +1059,7 @@ typedef struct core
 {
     chip8_engine_t *engine;
     display_t *display;
+    audio_t *audio;
 } core_t;
 
 void main_loop(void *arg)
@@ -120,17 +1068,20 @@ void main_loop(void *arg)
     int exit_code;
     chip8_engine_t *engine = core->engine;
     display_t *display = core->display;
-    display_event_t ev = {KEY_SIZE, false};
 
-    if (!poll_event(display, &ev))
+    if (!poll_keys(display, &engine->keyboard))
         return;
 
-    if (ev.key < KEY_SIZE) engine->keyboard[ev.key] = ev.key_pressed;
-
     update_chip8_engine(engine, true);
 
+    if (core->audio->device)
+        set_audio_playing(core->audio, get_timer(engine, &engine->sound) > 0);
+
     if (engine->draw_flag) {
-        exit_code = render(display, &engine->screen);
+        display_buffer_t screen;
+
+        copy_screen(engine, screen);
+        exit_code = render(display, &screen);
         printf("exit_code = %d\n", exit_code);
         engine->draw_flag = false;
     }
@@ -140,27 +1091,38 @@ static int wasm_run()
 {
     display_t display;
     chip8_engine_t engine;
+    audio_t audio;
     core_t core = {
             &engine,
-            &display
+            &display,
+            &audio
     };
 
     init_chip8_engine(core.engine);
+    // One instruction per browser frame
+    core.engine->cycles_per_tick = 1;
 
-    if (load_file_to_memory("./Pong.ch8", core.engine->memory + INITIAL_PROGRAM_COUNTER, &core.engine->prog_size, MAX_PROG_SIZE)) {
+    uint8_t content[MAX_PROG_SIZE];
+
+    if (load_file_to_memory("./Pong.ch8", content, &core.engine->prog_size, MAX_PROG_SIZE)) {
         return 1;
     }
+    load_chip8_memory(core.engine, INITIAL_PROGRAM_COUNTER, content, core.engine->prog_size);
     printf("OK\n");
 
     srandom(time(NULL));
 
-    if (init_display(core.display, false))
+    if (init_display(core.display))
         return 1;
 
+    if (init_audio(core.audio))
+        dprintf(2, "Warning : sound disabled\n");
+
     srandom(time(NULL));
 
     emscripten_set_main_loop_arg(&main_loop, &core, -1, 1);
 
+    destroy_audio(core.audio);
     destroy_display(core.display);
 
     return 0;
@@ -192,6 +1154,16 @@ int main(int ac, const char **av)
             return disassemble(ac - 2, av + 2);
         case INTERPRET:
             return interpret(ac - 2, av + 2);
+        case TRACE:
+            return search_trace(ac - 2, av + 2);
+        case WALL:
+            return wall(ac - 2, av + 2);
+        case EXPLORE:
+            return explore(ac - 2, av + 2);
+        case SCAN:
+            return scan(ac - 2, av + 2);
+        case PACK:
+            return ac < 4 ? usage(*av, true) : write_rom_pack(av[2], av + 3, ac - 3);
         default:
             return usage(*av, true);
     }
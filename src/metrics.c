@@ -0,0 +1,178 @@
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "metrics.h"
+#include "clock.h"
+
+const char *metrics_strings[METRICS_SIZE] = {
+        "instructions_executed",
+        "idle_skipped_cycles",
+        "frames_emulated",
+        "frames_presented",
+        "frames_dropped",
+        "pacer_skips",
+        "input_events",
+};
+
+static const char *metrics_help[METRICS_SIZE] = {
+        "Instructions executed by all instances, idle loops skipped included",
+        "Cycles of idle loops fast forwarded rather than executed",
+        "Frames emulated by all instances",
+        "Frames presented on screen",
+        "Emulated frames replaced by a newer one before being presented",
+        "Ticks skipped by the worker threads when too late to catch up",
+        "Key presses and releases bound to a chip8 key",
+};
+
+// A 60 Hz display presents every 16667 microseconds
+const long int frame_time_bounds[FRAME_TIME_BUCKETS_SIZE - 1] = {
+        2000, 4000, 8000, 12000, 16000, 17000, 20000, 33000, 50000
+};
+
+void init_metrics(metrics_t *m, int instances)
+{
+    for (int k = 0; k < METRICS_SIZE; k++)
+        atomic_init(&m->counters[k], 0);
+    for (int k = 0; k < FRAME_TIME_BUCKETS_SIZE; k++)
+        atomic_init(&m->frame_times[k], 0);
+    atomic_init(&m->frame_time_sum, 0);
+
+    m->instances = instances;
+    m->start_time = get_monotonic_time();
+}
+
+// Time in microseconds since the previous present
+void add_frame_time(metrics_t *m, long int frame_time)
+{
+    int bucket = 0;
+
+    while (bucket < FRAME_TIME_BUCKETS_SIZE - 1 && frame_time > frame_time_bounds[bucket])
+        bucket++;
+
+    atomic_fetch_add_explicit(&m->frame_times[bucket], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&m->frame_time_sum, frame_time, memory_order_relaxed);
+}
+
+// Export every interval seconds, to filepath when not NULL
+void init_metrics_exporter(metrics_exporter_t *x, const char *filepath, int interval, bool log)
+{
+    memset(x, 0, sizeof(metrics_exporter_t));
+
+    x->filepath = filepath;
+    x->log = log;
+    x->interval = S_TO_US((long int)interval);
+    x->previous_time = get_monotonic_time();
+    x->next_export = x->previous_time + x->interval;
+}
+
+static void write_counters(FILE *file, const uint64_t counters[METRICS_SIZE])
+{
+    for (int k = 0; k < METRICS_SIZE; k++)
+        fprintf(file,
+                "# HELP chip8_%s_total %s\n"
+                "# TYPE chip8_%s_total counter\n"
+                "chip8_%s_total %lu\n",
+                metrics_strings[k], metrics_help[k], metrics_strings[k], metrics_strings[k],
+                (unsigned long)counters[k]);
+}
+
+static void write_frame_times(FILE *file, const metrics_t *m)
+{
+    uint64_t count = 0;
+
+    fprintf(file,
+            "# HELP chip8_frame_time_seconds Time between two presents\n"
+            "# TYPE chip8_frame_time_seconds histogram\n");
+
+    // Prometheus buckets are cumulative
+    for (int k = 0; k < FRAME_TIME_BUCKETS_SIZE; k++) {
+        count += atomic_load_explicit(&m->frame_times[k], memory_order_relaxed);
+
+        if (k < FRAME_TIME_BUCKETS_SIZE - 1)
+            fprintf(file, "chip8_frame_time_seconds_bucket{le=\"%g\"} %lu\n",
+                    frame_time_bounds[k] / 1e6, (unsigned long)count);
+        else
+            fprintf(file, "chip8_frame_time_seconds_bucket{le=\"+Inf\"} %lu\n", (unsigned long)count);
+    }
+
+    fprintf(file, "chip8_frame_time_seconds_sum %g\n",
+            atomic_load_explicit(&m->frame_time_sum, memory_order_relaxed) / 1e6);
+    fprintf(file, "chip8_frame_time_seconds_count %lu\n", (unsigned long)count);
+}
+
+/*
+ * The file is written next to filepath then renamed over it,
+ * so a scraper reading it at any time sees a complete export.
+ */
+static bool write_metrics_file(const metrics_exporter_t *x, const metrics_t *m, const uint64_t counters[METRICS_SIZE], double ips, long int now)
+{
+    char tmp_path[4096];
+    FILE *file;
+
+    if (snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", x->filepath) >= (int)sizeof(tmp_path)) {
+        dprintf(2, "%s : path too long\n", x->filepath);
+        return true;
+    }
+
+    file = fopen(tmp_path, "w");
+    if (!file) {
+        dprintf(2, "%s : %s\n", tmp_path, strerror(errno));
+        return true;
+    }
+
+    write_counters(file, counters);
+    write_frame_times(file, m);
+    fprintf(file,
+            "# HELP chip8_instructions_per_second Instructions executed per second since the previous export\n"
+            "# TYPE chip8_instructions_per_second gauge\n"
+            "chip8_instructions_per_second %.0f\n"
+            "# HELP chip8_instances Instances emulated\n"
+            "# TYPE chip8_instances gauge\n"
+            "chip8_instances %d\n"
+            "# HELP chip8_uptime_seconds Time since the emulation started\n"
+            "# TYPE chip8_uptime_seconds gauge\n"
+            "chip8_uptime_seconds %.3f\n",
+            ips, m->instances, (now - m->start_time) / 1e6);
+
+    if (fclose(file) || rename(tmp_path, x->filepath)) {
+        dprintf(2, "%s : %s\n", x->filepath, strerror(errno));
+        return true;
+    }
+
+    return false;
+}
+
+/*
+ * Called on every iteration of the render loop, does nothing until the interval is elapsed unless forced.
+ * Rates are computed over the time since the previous export.
+ */
+bool export_metrics(metrics_exporter_t *x, const metrics_t *m, bool force)
+{
+    long int now = get_monotonic_time();
+    uint64_t counters[METRICS_SIZE];
+    double elapsed;
+    double ips;
+
+    if ((now < x->next_export && !force) || (!x->filepath && !x->log) || now == x->previous_time)
+        return false;
+
+    for (int k = 0; k < METRICS_SIZE; k++)
+        counters[k] = get_metric(m, k);
+
+    elapsed = (now - x->previous_time) / 1e6;
+    ips = (counters[INSTRUCTIONS_EXECUTED] - x->previous[INSTRUCTIONS_EXECUTED]) / elapsed;
+
+    // Emulated frames per instance, to compare with FREQUENCY
+    if (x->log)
+        printf("fps : %.1f presented, %.1f emulated, %lu dropped, %.0f instructions per second\n",
+                (counters[FRAMES_PRESENTED] - x->previous[FRAMES_PRESENTED]) / elapsed,
+                (counters[FRAMES_EMULATED] - x->previous[FRAMES_EMULATED]) / elapsed / m->instances,
+                (unsigned long)(counters[FRAMES_DROPPED] - x->previous[FRAMES_DROPPED]), ips);
+
+    memcpy(x->previous, counters, sizeof(counters));
+    x->previous_time = now;
+    x->next_export = now + x->interval;
+
+    return x->filepath && write_metrics_file(x, m, counters, ips, now);
+}
@@ -41,51 +41,25 @@ const char *op_codes_strings[OP_CODES_SIZE + 1] = {
         NULL
 };
 
-static void decode_instruction(const uint8_t *buf, size_t pc, instruction_t *i)
+/*
+ * Reference classifier, kept as the specification of the decoder.
+ * It is only run at build time, to generate op_codes_table from every instruction word.
+ */
+void classify_instruction_reference(instruction_t *i)
 {
-    // http://devernay.free.fr/hacks/chip8/C8TECH10.HTM
-
-    // All instructions are 2 bytes long and are stored most-significant-byte first.
-    i->instruction = (uint16_t)buf[pc] << 8 | (uint16_t)buf[pc + 1];
-
-    // u - A 4-bit value, the highest 4 bits of the instruction
-    i->u = (uint8_t)(i->instruction >> 12);
-
-    // nnn or addr - A 12-bit value, the lowest 12 bits of the instruction
-    i->nnn = i->instruction & 0x0fff;
-
-    // n or nibble - A 4-bit value, the lowest 4 bits of the instruction
-    i->n = i->instruction & 0x000f;
-
-    // x - A 4-bit value, the lower 4 bits of the high byte of the instruction
-    i->x = (i->instruction >> 8) & 0x000f;
-
-    // y - A 4-bit value, the upper 4 bits of the low byte of the instruction
-    i->y = (i->instruction >> 4) & 0x000f;
-
-    // kk or byte - An 8-bit value, the lowest 8 bits of the instruction
-    i->kk = i->instruction & 0x00ff;
-}
-
-void read_next_instruction(const uint8_t *buf, uint16_t pc, instruction_t *i)
-{
-    if (!i)
-        return;
-
-    decode_instruction(buf, pc, i);
-
     i->op_code = UNKNOWN;
 
     switch (i->u) {
         case 0x0:
 
-            switch (i->kk) {
+            // 0nnn other than these is a call to machine code, unsupported
+            switch (i->nnn) {
 
-                case 0xe0:
+                case 0x0e0:
                     i->op_code = CLEAR;
                     break;
 
-                case 0xee:
+                case 0x0ee:
                     i->op_code = RET;
                     break;
                 default:
@@ -0,0 +1,226 @@
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+
+#include "perf_counters.h"
+
+const char *perf_counters_strings[PERF_COUNTERS_SIZE] = {
+        "cycles",
+        "instructions",
+        "branch-misses",
+        "L1d-misses",
+};
+
+#ifdef __linux__
+static const struct {
+    uint32_t type;
+    uint64_t config;
+} perf_events[PERF_COUNTERS_SIZE] = {
+        [PERF_CYCLES] = {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+        [PERF_INSTRUCTIONS] = {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+        [PERF_BRANCH_MISSES] = {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+        [PERF_L1D_MISSES] = {PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D
+                | PERF_COUNT_HW_CACHE_OP_READ << 8 | PERF_COUNT_HW_CACHE_RESULT_MISS << 16},
+};
+
+static int open_perf_event(perf_counter_t counter, int group)
+{
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = perf_events[counter].type;
+    attr.config = perf_events[counter].config;
+    // The leader starts disabled and drives the whole group
+    attr.disabled = group == -1;
+    // User space only, which perf_event_paranoid 2 still allows
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+    return syscall(SYS_perf_event_open, &attr, 0, -1, group, 0);
+}
+
+/*
+ * Open the counters of the calling thread, disabled.
+ * Fails only when cycles cannot be counted, other counters missing on this CPU are skipped.
+ * Every counter is closed on failure, counters can still be merged and closed.
+ */
+bool open_perf_counters(perf_counters_t *c)
+{
+    memset(c, 0, sizeof(perf_counters_t));
+    for (int k = 0; k < PERF_COUNTERS_SIZE; k++)
+        c->fds[k] = -1;
+
+    c->fds[PERF_CYCLES] = open_perf_event(PERF_CYCLES, -1);
+    if (c->fds[PERF_CYCLES] == -1) {
+        dprintf(2, "perf_event_open : %s\n", strerror(errno));
+        return true;
+    }
+
+    for (int k = PERF_CYCLES + 1; k < PERF_COUNTERS_SIZE; k++)
+        c->fds[k] = open_perf_event(k, c->fds[PERF_CYCLES]);
+
+    return false;
+}
+
+void close_perf_counters(perf_counters_t *c)
+{
+    for (int k = PERF_COUNTERS_SIZE; k-- > 0;) {
+        if (c->fds[k] != -1)
+            close(c->fds[k]);
+        c->fds[k] = -1;
+    }
+}
+
+void enable_perf_counters(perf_counters_t *c)
+{
+    ioctl(c->fds[PERF_CYCLES], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+}
+
+void disable_perf_counters(perf_counters_t *c)
+{
+    ioctl(c->fds[PERF_CYCLES], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+}
+
+/*
+ * Read the counts of the whole group, accumulated over every enabled period.
+ * Values come in the order the counters joined the group, scaled up when the group was multiplexed.
+ */
+bool read_perf_counters(perf_counters_t *c)
+{
+    uint64_t values[3 + PERF_COUNTERS_SIZE];
+    uint64_t n = 0;
+
+    if (read(c->fds[PERF_CYCLES], values, sizeof(values)) == -1) {
+        dprintf(2, "perf counters : %s\n", strerror(errno));
+        return true;
+    }
+
+    uint64_t enabled = values[1];
+    uint64_t running = values[2];
+
+    for (int k = 0; k < PERF_COUNTERS_SIZE && n < values[0]; k++) {
+        if (c->fds[k] == -1)
+            continue;
+
+        c->counts[k] = running && running < enabled
+                ? (uint64_t)((double)values[3 + n] * enabled / running)
+                : values[3 + n];
+        n++;
+    }
+
+    return false;
+}
+#else
+// perf_event_open is Linux only, every thread counts as failed elsewhere
+bool open_perf_counters(perf_counters_t *c)
+{
+    memset(c, 0, sizeof(perf_counters_t));
+    for (int k = 0; k < PERF_COUNTERS_SIZE; k++)
+        c->fds[k] = -1;
+
+    dprintf(2, "perf counters : unsupported on this platform\n");
+    return true;
+}
+
+void close_perf_counters(perf_counters_t *c)
+{
+    (void)c;
+}
+
+void enable_perf_counters(perf_counters_t *c)
+{
+    (void)c;
+}
+
+void disable_perf_counters(perf_counters_t *c)
+{
+    (void)c;
+}
+
+bool read_perf_counters(perf_counters_t *c)
+{
+    (void)c;
+    return true;
+}
+#endif
+
+void init_perf_report(perf_report_t *r)
+{
+    memset(r, 0, sizeof(perf_report_t));
+    pthread_mutex_init(&r->lock, NULL);
+}
+
+// Counters of a thread that could not be opened, or that were closed as they could not be read, only count as failed
+void merge_perf_counters(perf_report_t *r, const perf_counters_t *c, execution_engine_t execution_engine)
+{
+    pthread_mutex_lock(&r->lock);
+
+    if (c->fds[PERF_CYCLES] == -1) {
+        r->failed_threads++;
+        pthread_mutex_unlock(&r->lock);
+        return;
+    }
+
+    for (int k = 0; k < PERF_COUNTERS_SIZE; k++) {
+        r->counts[execution_engine][k] += c->counts[k];
+        r->supported[k] |= c->fds[k] != -1;
+    }
+    r->instructions[execution_engine] += c->instructions;
+    r->frames[execution_engine] += c->frames;
+
+    pthread_mutex_unlock(&r->lock);
+}
+
+static void print_per(const char *label, const perf_report_t *r, execution_engine_t engine, const uint64_t *per)
+{
+    printf("  per %-12s", label);
+    for (int k = 0; k < PERF_COUNTERS_SIZE; k++) {
+        if (r->supported[k])
+            printf(" %14.2f", (double)r->counts[engine][k] / per[engine]);
+        else
+            printf(" %14s", "n/a");
+    }
+    printf("\n");
+}
+
+/*
+ * Host events per emulated instruction and per emulated frame, one block per execution engine that ran.
+ * Emulated instructions exclude the idle loops skipped, which cost next to nothing.
+ */
+void print_perf_report(const perf_report_t *r)
+{
+    printf("Perf counters, user space");
+    if (r->failed_threads)
+        printf(", %d threads not counted", r->failed_threads);
+    printf("\n%-18s", "");
+    for (int k = 0; k < PERF_COUNTERS_SIZE; k++)
+        printf(" %14s", perf_counters_strings[k]);
+    printf("\n");
+
+    for (int engine = 0; engine < EXECUTION_ENGINES_SIZE; engine++) {
+        if (!r->instructions[engine] || !r->frames[engine])
+            continue;
+
+        printf("%s : %lu instructions, %lu frames, %.2f host instructions per cycle\n",
+                execution_engines_strings[engine],
+                (unsigned long)r->instructions[engine], (unsigned long)r->frames[engine],
+                r->counts[engine][PERF_CYCLES]
+                        ? (double)r->counts[engine][PERF_INSTRUCTIONS] / r->counts[engine][PERF_CYCLES] : 0);
+        print_per("instruction", r, engine, r->instructions);
+        print_per("frame", r, engine, r->frames);
+    }
+}
+
+void destroy_perf_report(perf_report_t *r)
+{
+    pthread_mutex_destroy(&r->lock);
+}
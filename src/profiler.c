@@ -0,0 +1,269 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "profiler.h"
+#include "disas.h"
+
+typedef struct profile_entry_s profile_entry_t;
+
+// Row of a report, sorted by count
+struct profile_entry_s {
+    uint32_t key;
+    uint64_t count;
+    uint64_t inclusive;
+    uint64_t calls;
+};
+
+static int compare_profile_entries(const void *a, const void *b)
+{
+    const profile_entry_t *x = a;
+    const profile_entry_t *y = b;
+
+    if (x->count != y->count)
+        return x->count < y->count ? 1 : -1;
+
+    return x->key < y->key ? -1 : x->key > y->key;
+}
+
+// The root stands for the code outside any subroutine, from the entry point
+bool init_profiler(profiler_t *p)
+{
+    memset(p, 0, sizeof(profiler_t));
+
+    p->nodes_capacity = 64;
+    p->nodes = malloc(p->nodes_capacity * sizeof(profile_node_t));
+    if (!p->nodes) {
+        dprintf(2, "malloc failed\n");
+        return true;
+    }
+
+    p->nodes[PROFILE_ROOT] = (profile_node_t){
+            .address = INITIAL_PROGRAM_COUNTER,
+            .parent = PROFILE_NO_NODE,
+            .first_child = PROFILE_NO_NODE,
+            .next_sibling = PROFILE_NO_NODE
+    };
+    p->nodes_count = 1;
+    p->current = PROFILE_ROOT;
+
+    return false;
+}
+
+void destroy_profiler(profiler_t *p)
+{
+    free(p->nodes);
+    p->nodes = NULL;
+}
+
+// Make the stack of the subroutine at address called from the current one current
+void enter_profile_call(profiler_t *p, uint16_t address)
+{
+    uint32_t child;
+
+    if (p->unrecorded_depth) {
+        p->unrecorded_depth++;
+        return;
+    }
+
+    for (child = p->nodes[p->current].first_child; child != PROFILE_NO_NODE; child = p->nodes[child].next_sibling)
+        if (p->nodes[child].address == address)
+            break;
+
+    if (child == PROFILE_NO_NODE) {
+        if (p->nodes_count == p->nodes_capacity) {
+            profile_node_t *nodes = p->nodes_capacity < MAX_PROFILE_NODES
+                    ? realloc(p->nodes, p->nodes_capacity * 2 * sizeof(profile_node_t))
+                    : NULL;
+
+            if (!nodes) {
+                p->unrecorded_depth++;
+                return;
+            }
+
+            p->nodes = nodes;
+            p->nodes_capacity *= 2;
+        }
+
+        child = p->nodes_count++;
+        p->nodes[child] = (profile_node_t){
+                .address = address,
+                .parent = p->current,
+                .first_child = PROFILE_NO_NODE,
+                .next_sibling = p->nodes[p->current].first_child
+        };
+        p->nodes[p->current].first_child = child;
+    }
+
+    p->nodes[child].calls++;
+    p->current = child;
+}
+
+// Count the iterations of a loop without any call, fast forwarded rather than executed
+void add_profile_iterations(profiler_t *p, uint16_t pc, const instruction_t *loop[], int length, uint64_t iterations)
+{
+    for (int k = 0; k < length; k++) {
+        p->addresses[(pc + k * 2) & (MEMORY_SIZE - 1)] += iterations;
+        p->op_codes[loop[k]->op_code] += iterations;
+    }
+
+    p->nodes[p->current].cycles += iterations * length;
+}
+
+static void print_frame(FILE *file, const profiler_t *p, uint32_t node)
+{
+    if (p->nodes[node].parent != PROFILE_NO_NODE) {
+        print_frame(file, p, p->nodes[node].parent);
+        fprintf(file, ";sub_%04x", p->nodes[node].address);
+    } else
+        fprintf(file, "main");
+}
+
+/*
+ * One line per call stack that executed instructions : frames from the outermost, then the count.
+ * This is the folded format flamegraph.pl reads.
+ */
+bool write_folded_stacks(const profiler_t *p, const char *filepath)
+{
+    FILE *file = fopen(filepath, "w");
+
+    if (!file) {
+        dprintf(2, "%s : %s\n", filepath, strerror(errno));
+        return true;
+    }
+
+    for (uint32_t n = 0; n < p->nodes_count; n++) {
+        if (!p->nodes[n].cycles)
+            continue;
+
+        print_frame(file, p, n);
+        fprintf(file, " %lu\n", (unsigned long)p->nodes[n].cycles);
+    }
+
+    if (fclose(file)) {
+        dprintf(2, "%s : %s\n", filepath, strerror(errno));
+        return true;
+    }
+
+    return false;
+}
+
+// Whether the subroutine of node is already running in one of its callers
+static bool is_recursive(const profiler_t *p, uint32_t node)
+{
+    for (uint32_t n = p->nodes[node].parent; n != PROFILE_NO_NODE; n = p->nodes[n].parent)
+        if (n != PROFILE_ROOT && p->nodes[n].address == p->nodes[node].address)
+            return true;
+
+    return false;
+}
+
+static void print_hot_addresses(const profiler_t *p, const chip8_engine_t *e, uint64_t total)
+{
+    profile_entry_t hot[MEMORY_SIZE];
+    int count = 0;
+
+    for (uint32_t a = 0; a < MEMORY_SIZE; a++)
+        if (p->addresses[a])
+            hot[count++] = (profile_entry_t){.key = a, .count = p->addresses[a]};
+
+    qsort(hot, count, sizeof(profile_entry_t), &compare_profile_entries);
+
+    printf("\nHot addresses\n");
+    for (int n = 0; n < count && n < PROFILE_HOT_ADDRESSES; n++) {
+        char line[MAX_DISAS_RECORD_SIZE];
+        instruction_t i;
+        size_t size;
+
+        // Disassembled from memory as it is now
+        fetch_instruction(e, hot[n].key, &i);
+        size = format_instruction(line, hot[n].key, &i);
+
+        printf("%14lu %6.2f%%  %.*s", (unsigned long)hot[n].count, 100.0 * hot[n].count / total, (int)size, line);
+    }
+}
+
+static void print_op_codes(const profiler_t *p, uint64_t total)
+{
+    profile_entry_t ops[OP_CODES_SIZE];
+    int count = 0;
+
+    for (int op = 0; op < OP_CODES_SIZE; op++)
+        if (p->op_codes[op])
+            ops[count++] = (profile_entry_t){.key = op, .count = p->op_codes[op]};
+
+    qsort(ops, count, sizeof(profile_entry_t), &compare_profile_entries);
+
+    printf("\nOp codes\n");
+    for (int n = 0; n < count; n++)
+        printf("%14lu %6.2f%%  %2u %s\n", (unsigned long)ops[n].count, 100.0 * ops[n].count / total,
+                ops[n].key, op_codes_strings[ops[n].key]);
+}
+
+static void print_subroutines(const profiler_t *p, uint64_t total)
+{
+    profile_entry_t *subs = calloc(MEMORY_SIZE, sizeof(profile_entry_t));
+    uint64_t *inclusive = calloc(p->nodes_count, sizeof(uint64_t));
+    int count = 0;
+
+    if (!subs || !inclusive) {
+        dprintf(2, "calloc failed\n");
+        free(subs);
+        free(inclusive);
+        return;
+    }
+
+    // Children are always created after their parent
+    for (uint32_t n = p->nodes_count; n-- > 0;) {
+        inclusive[n] += p->nodes[n].cycles;
+        if (p->nodes[n].parent != PROFILE_NO_NODE)
+            inclusive[p->nodes[n].parent] += inclusive[n];
+    }
+
+    for (uint32_t n = 1; n < p->nodes_count; n++) {
+        profile_entry_t *sub = &subs[p->nodes[n].address];
+
+        sub->key = p->nodes[n].address;
+        sub->count += p->nodes[n].cycles;
+        sub->calls += p->nodes[n].calls;
+        // Recursive calls are already part of the outermost one
+        if (!is_recursive(p, n))
+            sub->inclusive += inclusive[n];
+    }
+
+    for (uint32_t a = 0; a < MEMORY_SIZE; a++)
+        if (subs[a].calls)
+            subs[count++] = subs[a];
+
+    qsort(subs, count, sizeof(profile_entry_t), &compare_profile_entries);
+
+    printf("\nSubroutines         self               total       calls\n");
+    printf("%-8s %11lu %6.2f%% %11lu %6.2f%%\n", "main", (unsigned long)p->nodes[PROFILE_ROOT].cycles,
+            100.0 * p->nodes[PROFILE_ROOT].cycles / total, (unsigned long)total, 100.0);
+    for (int n = 0; n < count; n++)
+        printf("sub_%04x %11lu %6.2f%% %11lu %6.2f%% %11lu\n", subs[n].key,
+                (unsigned long)subs[n].count, 100.0 * subs[n].count / total,
+                (unsigned long)subs[n].inclusive, 100.0 * subs[n].inclusive / total,
+                (unsigned long)subs[n].calls);
+
+    free(subs);
+    free(inclusive);
+}
+
+// Instructions executed per address, annotated with their disassembly, per op code and per subroutine
+void print_profile_report(const profiler_t *p, const chip8_engine_t *e)
+{
+    uint64_t total = 0;
+
+    for (int op = 0; op < OP_CODES_SIZE; op++)
+        total += p->op_codes[op];
+
+    printf("Profile : %lu instructions\n", (unsigned long)total);
+    if (!total)
+        return;
+
+    print_hot_addresses(p, e, total);
+    print_op_codes(p, total);
+    print_subroutines(p, total);
+}
@@ -0,0 +1,294 @@
+#include <stddef.h>
+
+#include "quirk_executors.h"
+
+/*
+ * Handlers of the instructions whose behavior differs between interpreters, generated for every quirk profile.
+ *
+ * The quirks of the profile are compile time constants in each handler, so the tests on them
+ * are resolved by the compiler and every handler only runs the code of its own profile.
+ */
+
+#define QUIRK_CONSTANTS(...) QUIRK_CONSTANTS_ENUM(__VA_ARGS__)
+#define QUIRK_CONSTANTS_ENUM(shift_vy, i_increment, vf_reset, jump_vx, clip_sprites, display_wait) \
+    enum {                                                                  \
+        SHIFT_VY = shift_vy,                                                \
+        I_INCREMENT = i_increment,                                          \
+        VF_RESET = vf_reset,                                                \
+        JUMP_VX = jump_vx,                                                  \
+        CLIP_SPRITES = clip_sprites,                                        \
+        DISPLAY_WAIT = display_wait                                         \
+    };
+
+// Handlers specialized on the quirk profile : name_profile
+#define DEFINE_QUIRK_HANDLER(profile_name, profile, quirks, name, ...)     \
+    static void name##_##profile_name(chip8_engine_t *e, const instruction_t *i) \
+    {                                                                       \
+        QUIRK_CONSTANTS(quirks)                                             \
+        __VA_ARGS__                                                         \
+    }
+
+#define DEFINE_QUIRK_HANDLERS(name, ...) FOR_EACH_QUIRK_PROFILE(DEFINE_QUIRK_HANDLER, name, __VA_ARGS__)
+
+/*
+ * OR x, y
+ * Set Vx = Vx OR Vy.
+ *
+ * Performs a bitwise OR on the values of Vx and Vy, then stores the result in Vx.
+ * A bitwise OR compares the corresponding bits from two values, and if either bit is 1,
+ * then the same bit in the result is also 1.
+ * Otherwise, it is 0.
+ * VIP : VF is reset.
+ */
+DEFINE_QUIRK_HANDLERS(or, {
+    e->pc += 2;
+
+    if (is_v_reg_out_of_bound(i->x) || is_v_reg_out_of_bound(i->y))
+        return;
+
+    e->v[i->x] |= e->v[i->y];
+
+    if (VF_RESET)
+        e->v[0xf] = 0;
+})
+
+/*
+ * AND x, y
+ * Set Vx = Vx AND Vy.
+
+ * Performs a bitwise AND on the values of Vx and Vy, then stores the result in Vx.
+ * A bitwise AND compares the corresponding bits from two values, and if both bits are 1,
+ * then the same bit in the result is also 1.
+ * Otherwise, it is 0.
+ * VIP : VF is reset.
+ */
+DEFINE_QUIRK_HANDLERS(and, {
+    e->pc += 2;
+
+    if (is_v_reg_out_of_bound(i->x) || is_v_reg_out_of_bound(i->y))
+        return;
+
+    e->v[i->x] &= e->v[i->y];
+
+    if (VF_RESET)
+        e->v[0xf] = 0;
+})
+
+/*
+ * XOR Vx, Vy
+ * Set Vx = Vx XOR Vy.
+ *
+ * Performs a bitwise exclusive OR on the values of Vx and Vy, then stores the result in Vx.
+ * An exclusive OR compares the corresponding bits from two values, and if the bits are not both the same,
+ * then the corresponding bit in the result is set to 1.
+ * Otherwise, it is 0.
+ * VIP : VF is reset.
+ */
+DEFINE_QUIRK_HANDLERS(xor, {
+    e->pc += 2;
+
+    if (is_v_reg_out_of_bound(i->x) || is_v_reg_out_of_bound(i->y))
+        return;
+
+    e->v[i->x] ^= e->v[i->y];
+
+    if (VF_RESET)
+        e->v[0xf] = 0;
+})
+
+/*
+ * SHR x
+ * Set Vx = Vx SHR 1.
+ *
+ * If the least-significant bit of Vx is 1, then VF is set to 1, otherwise 0.
+ * Then Vx is divided by 2.
+ * VIP : Vy is shifted rather than Vx.
+ */
+DEFINE_QUIRK_HANDLERS(shr, {
+    e->pc += 2;
+
+    if (is_v_reg_out_of_bound(i->x))
+        return;
+
+    uint8_t source = SHIFT_VY ? i->y : i->x;
+
+    e->v[0xf] = e->v[source] & 1;
+    e->v[i->x] = e->v[source] / 2;
+})
+
+/*
+ * SHL Vx
+ * Set Vx = Vx SHL 1.
+ *
+ * If the most-significant bit of Vx is 1, then VF is set to 1, otherwise to 0.
+ * Then Vx is multiplied by 2.
+ * VIP : Vy is shifted rather than Vx.
+ */
+DEFINE_QUIRK_HANDLERS(shl, {
+    e->pc += 2;
+
+    if (is_v_reg_out_of_bound(i->x))
+        return;
+
+    uint8_t source = SHIFT_VY ? i->y : i->x;
+
+    e->v[0xf] = (e->v[source] >> 7) & 1;
+    e->v[i->x] = e->v[source] * 2;
+})
+
+/*
+ * JP V0, nnn
+ * Jump to location nnn + V0.
+
+ * The program counter is set to nnn plus the value of V0.
+ * CHIP-48 and SCHIP : the register added is Vx, x being the highest nibble of nnn.
+ */
+DEFINE_QUIRK_HANDLERS(jmp_v0_nnn, {
+    e->pc = i->nnn + (uint16_t)e->v[JUMP_VX ? i->x : 0];
+})
+
+/*
+ *
+ * DISP x, y, n
+ * Display n-byte sprite starting at memory location I at (Vx, Vy), set VF = collision.
+ *
+ * The interpreter reads n bytes from memory, starting at the address stored in I.
+ * These bytes are then displayed as sprites on screen at coordinates (Vx, Vy).
+ * Sprites are XORed onto the existing screen.
+ * If this causes any pixels to be erased, VF is set to 1, otherwise it is set to 0.
+ * If the sprite is positioned so part of it is outside the coordinates of the display,
+ * it wraps around to the opposite side of the screen.
+ * See instruction 8xy3 for more information on XOR, and section 2.4, Display,
+ * for more information on the Chip-8 screen and sprites.
+ * VIP, CHIP-48 and SCHIP : only the coordinates wrap, the sprite is clipped at the edges.
+ * VIP : drawing waits for the start of a frame, as the VIP waited for the vertical blank.
+ */
+DEFINE_QUIRK_HANDLERS(disp, {
+    // Frames start on multiples of cycles_per_tick, the instruction runs again until then
+    if (DISPLAY_WAIT && e->cycles % e->cycles_per_tick)
+        return;
+
+    e->pc += 2;
+    if (is_v_reg_out_of_bound(i->x) || is_v_reg_out_of_bound(i->y))
+        return;
+
+    uint8_t x = e->v[i->x];
+    uint8_t y = e->v[i->y];
+    e->v[0xf] = 0;
+
+    if (CLIP_SPRITES) {
+        x %= CHIP8_WINDOW_WIDTH;
+        y %= CHIP8_WINDOW_HEIGHT;
+    }
+
+    for (uint8_t j = 0; j < i->n; j++) {
+        if (CLIP_SPRITES && y + j >= CHIP8_WINDOW_HEIGHT)
+            break;
+
+        uint8_t pixels = read_memory(e, MEMORY_ADDRESS(e->i + j));
+
+        for (uint8_t k = 0; k < 8; k++) {
+            if (CLIP_SPRITES && x + (7 - k) >= CHIP8_WINDOW_WIDTH)
+                continue;
+
+            uint8_t x_incr = (x + (7 - k)) % CHIP8_WINDOW_WIDTH;
+            uint8_t y_incr = (y + j) % CHIP8_WINDOW_HEIGHT;
+            uint8_t sprite_pixel = pixels >> k & 1;
+            uint8_t screen_pixel = get_screen_pixel(e, x_incr, y_incr);
+
+            if (sprite_pixel && screen_pixel) e->v[0xf] = 1;
+
+            // Only the pixels that change are written, the others may stay shared with forks
+            if (sprite_pixel)
+                write_pixel(e, x_incr, y_incr, screen_pixel ^ 0xff);
+        }
+    }
+
+    e->draw_flag = true;
+    stamp_latency(e->latency, LATENCY_DRAWN);
+})
+
+/*
+ *  MOVM I, x
+ * Store registers V0 through Vx in memory starting at location I.
+ *
+ * The interpreter copies the values of registers V0 through Vx into memory,
+ * starting at the address in I
+ * I is then left at I + x + 1, at I + x on CHIP-48, unchanged on SCHIP.
+ */
+DEFINE_QUIRK_HANDLERS(movm_i_x, {
+    e->pc += 2;
+
+    if (is_v_reg_out_of_bound(i->x))
+        return;
+
+    for (uint8_t j = 0; j <= i->x; j++)
+        write_memory(e, MEMORY_ADDRESS(e->i + j), e->v[j]);
+
+    invalidate_predecoded(e, e->i, i->x + 1);
+
+    if (I_INCREMENT != I_UNCHANGED)
+        e->i += i->x + I_INCREMENT;
+})
+
+/*
+ * MOVM x, I
+ * Read registers V0 through Vx from memory starting at location I.
+ *
+ * The interpreter reads values from memory starting at location I into registers V0 through Vx.
+ * I is then left at I + x + 1, at I + x on CHIP-48, unchanged on SCHIP.
+ */
+DEFINE_QUIRK_HANDLERS(movm_x_i, {
+    e->pc += 2;
+
+    if (is_v_reg_out_of_bound(i->x))
+        return;
+
+    for (uint8_t j = 0; j <= i->x; j++)
+        e->v[j] = read_memory(e, MEMORY_ADDRESS(e->i + j));
+
+    if (I_INCREMENT != I_UNCHANGED)
+        e->i += i->x + I_INCREMENT;
+})
+
+#define EXECUTORS_TABLE_ENTRY(profile_name, profile, quirks, ...) [profile] = { \
+        [CLEAR] = &exec_clear,                                              \
+        [RET] = &exec_ret,                                                  \
+        [JMP_NNN] = &exec_jmp_nnn,                                          \
+        [CALL] = &exec_call,                                                \
+        [SKIP_X_KK] = &exec_skip_x_kk,                                      \
+        [SKIPN_X_KK] = &exec_skipn_x_kk,                                    \
+        [SKIP_X_Y] = &exec_skip_x_y,                                        \
+        [MVI_X_KK] = &exec_mvi_x_kk,                                        \
+        [ADD_X_KK] = &exec_add_x_kk,                                        \
+        [MOV_X_Y] = &exec_mov_x_y,                                          \
+        [OR] = &or_##profile_name,                                          \
+        [AND] = &and_##profile_name,                                        \
+        [XOR] = &xor_##profile_name,                                        \
+        [ADD_X_Y] = &exec_add_x_y,                                          \
+        [SUB] = &exec_sub,                                                  \
+        [SHR] = &shr_##profile_name,                                        \
+        [SUBN] = &exec_subn,                                                \
+        [SHL] = &shl_##profile_name,                                        \
+        [SKIPN_X_Y] = &exec_skipn_x_y,                                      \
+        [MVI_I_NNN] = &exec_mvi_i_nnn,                                      \
+        [JMP_V0_NNN] = &jmp_v0_nnn_##profile_name,                          \
+        [RAND] = &exec_rand,                                                \
+        [DISP] = &disp_##profile_name,                                      \
+        [SKIP_KEY] = &exec_skip_key,                                        \
+        [SKIPN_KEY] = &exec_skipn_key,                                      \
+        [MOV_X_DELAY] = &exec_mov_x_delay,                                  \
+        [MOV_KEY] = &exec_mov_key,                                          \
+        [MOV_DELAY_X] = &exec_mov_delay_x,                                  \
+        [MOV_SOUND] = &exec_mov_sound,                                      \
+        [ADD_I_X] = &exec_add_i_x,                                          \
+        [SPRITE_POS] = &exec_sprite_pos,                                    \
+        [MOVBCD] = &exec_movbcd,                                            \
+        [MOVM_I_X] = &movm_i_x_##profile_name,                              \
+        [MOVM_X_I] = &movm_x_i_##profile_name,                              \
+        [UNKNOWN] = &exec_unknown,                                          \
+    },
+
+const instruction_handler_t executors_tables[QUIRK_PROFILES_SIZE][OP_CODES_SIZE] = {
+        FOR_EACH_QUIRK_PROFILE(EXECUTORS_TABLE_ENTRY, )
+};
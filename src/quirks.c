@@ -0,0 +1,26 @@
+#include <stddef.h>
+
+#include "quirks.h"
+
+const char *quirk_profiles_strings[QUIRK_PROFILES_SIZE + 1] = {
+        "modern",
+        "vip",
+        "chip48",
+        "schip",
+        NULL
+};
+
+#define QUIRKS_ENTRY(name, profile, quirks, ...) [profile] = QUIRKS_INITIALIZER(quirks),
+#define QUIRKS_INITIALIZER(...) QUIRKS_FIELDS(__VA_ARGS__)
+#define QUIRKS_FIELDS(shift_vy_, i_increment_, vf_reset_, jump_vx_, clip_sprites_, display_wait_) { \
+        .shift_vy = shift_vy_,                                                                      \
+        .i_increment = i_increment_,                                                                \
+        .vf_reset = vf_reset_,                                                                      \
+        .jump_vx = jump_vx_,                                                                        \
+        .clip_sprites = clip_sprites_,                                                              \
+        .display_wait = display_wait_,                                                              \
+    }
+
+const quirks_t quirk_profiles[QUIRK_PROFILES_SIZE] = {
+        FOR_EACH_QUIRK_PROFILE(QUIRKS_ENTRY, )
+};
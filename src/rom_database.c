@@ -0,0 +1,35 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "rom_database.h"
+
+/*
+ * Known ROMs, sorted by SHA-1 so they can be binary searched.
+ * The hash of a ROM file is given by sha1sum.
+ */
+static const rom_entry_t rom_database[] = {
+        {
+            .sha1 = {
+                0xb2, 0x32, 0xef, 0x88, 0x0b, 0xd6, 0x06, 0x0f, 0xb4, 0x5f,
+                0xa6, 0xef, 0xfe, 0xd7, 0xed, 0xf0, 0xae, 0x95, 0x67, 0x0e
+            },
+            .title = "Pong",
+            .instructions_per_frame = 10,
+            .quirk_profile = MODERN_PROFILE,
+            .key_bindings = NULL,
+            .idle_loop = 0x21a
+        },
+};
+
+#define ROM_DATABASE_SIZE (sizeof(rom_database) / sizeof(rom_entry_t))
+
+static int compare_rom_entry(const void *sha1, const void *entry)
+{
+    return memcmp(sha1, ((const rom_entry_t *)entry)->sha1, SHA1_SIZE);
+}
+
+// Entry of the ROM with this SHA-1, NULL when it is unknown
+const rom_entry_t *get_rom_entry(const uint8_t sha1[SHA1_SIZE])
+{
+    return bsearch(sha1, rom_database, ROM_DATABASE_SIZE, sizeof(rom_entry_t), &compare_rom_entry);
+}
@@ -0,0 +1,343 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "rom_pack.h"
+#include "chip8_engine.h"
+#include "utils.h"
+
+typedef struct pending_rom_s pending_rom_t;
+
+// ROM file read by write_rom_pack
+struct pending_rom_s {
+    const char *name;
+    uint8_t *content;
+    size_t size;
+    uint8_t sha1[SHA1_SIZE];
+    // Index in the roms of the pack, shared by files with the same content
+    uint32_t rom;
+};
+
+static int compare_pending_sha1(const void *a, const void *b)
+{
+    return memcmp(((const pending_rom_t *)a)->sha1, ((const pending_rom_t *)b)->sha1, SHA1_SIZE);
+}
+
+static int compare_pending_name(const void *a, const void *b)
+{
+    return strcmp(((const pending_rom_t *)a)->name, ((const pending_rom_t *)b)->name);
+}
+
+static bool write_all(const char *filepath, const uint8_t *buf, size_t size)
+{
+    int fd = open(filepath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+    if (fd == -1) {
+        dprintf(2, "%s : %s\n", filepath, strerror(errno));
+        return true;
+    }
+
+    while (size) {
+        ssize_t written = write(fd, buf, size);
+
+        if (written == -1) {
+            dprintf(2, "%s : %s\n", filepath, strerror(errno));
+            close(fd);
+            return true;
+        }
+
+        buf += written;
+        size -= written;
+    }
+
+    close(fd);
+    return false;
+}
+
+static void free_pending_roms(pending_rom_t *pending, int count)
+{
+    for (int n = 0; n < count; n++)
+        free(pending[n].content);
+
+    free(pending);
+}
+
+/*
+ * Lay the pending ROMs out as a pack, see rom_pack.h.
+ * pending is sorted by name, with the rom index of every file already assigned.
+ */
+static uint8_t *build_rom_pack(const pending_rom_t *pending, int names_count, uint32_t roms_count, size_t *pack_size)
+{
+    size_t roms_offset = sizeof(rom_pack_header_t);
+    size_t names_offset = roms_offset + roms_count * sizeof(packed_rom_t);
+    size_t strings_offset = names_offset + names_count * sizeof(packed_name_t);
+    size_t contents_offset = strings_offset;
+    size_t size;
+    uint8_t *pack;
+
+    for (int n = 0; n < names_count; n++)
+        contents_offset += strlen(pending[n].name) + 1;
+
+    contents_offset += contents_offset & 1;
+    size = contents_offset;
+
+    // Contents are written once per distinct ROM, in rom order
+    uint32_t *offsets = calloc(roms_count, sizeof(uint32_t));
+    const pending_rom_t **by_rom = calloc(roms_count, sizeof(pending_rom_t *));
+    if (!offsets || !by_rom) {
+        dprintf(2, "calloc failed\n");
+        free(offsets);
+        free(by_rom);
+        return NULL;
+    }
+
+    for (int n = 0; n < names_count; n++)
+        by_rom[pending[n].rom] = &pending[n];
+
+    for (uint32_t r = 0; r < roms_count; r++) {
+        offsets[r] = (uint32_t)size;
+        size += by_rom[r]->size + (by_rom[r]->size & 1);
+    }
+
+    pack = calloc(size, 1);
+    if (!pack) {
+        dprintf(2, "calloc failed\n");
+        free(offsets);
+        free(by_rom);
+        return NULL;
+    }
+
+    rom_pack_header_t *header = (rom_pack_header_t *)pack;
+    packed_rom_t *roms = (packed_rom_t *)(pack + roms_offset);
+    packed_name_t *names = (packed_name_t *)(pack + names_offset);
+    size_t string = strings_offset;
+
+    memcpy(header->magic, ROM_PACK_MAGIC, sizeof(header->magic));
+    header->version = ROM_PACK_VERSION;
+    header->roms_count = roms_count;
+    header->names_count = names_count;
+
+    for (uint32_t r = 0; r < roms_count; r++) {
+        memcpy(roms[r].sha1, by_rom[r]->sha1, SHA1_SIZE);
+        roms[r].size = (uint32_t)by_rom[r]->size;
+        roms[r].offset = offsets[r];
+        memcpy(pack + offsets[r], by_rom[r]->content, by_rom[r]->size);
+    }
+
+    for (int n = 0; n < names_count; n++) {
+        names[n].name_offset = (uint32_t)string;
+        names[n].rom = pending[n].rom;
+        strcpy((char *)pack + string, pending[n].name);
+        string += strlen(pending[n].name) + 1;
+    }
+
+    free(offsets);
+    free(by_rom);
+
+    *pack_size = size;
+    return pack;
+}
+
+/*
+ * Pack the given ROM files, named after their base name.
+ * Files with the same content are stored once, files with the same name must have the same content.
+ */
+bool write_rom_pack(const char *filepath, const char **files, int files_count)
+{
+    pending_rom_t *pending = calloc(files_count, sizeof(pending_rom_t));
+    uint32_t roms_count = 0;
+    int names_count = 0;
+    size_t pack_size;
+    uint8_t *pack;
+    bool err;
+
+    if (!pending) {
+        dprintf(2, "calloc failed\n");
+        return true;
+    }
+
+    for (int n = 0; n < files_count; n++) {
+        const char *base_name = strrchr(files[n], '/');
+
+        pending[n].name = base_name ? base_name + 1 : files[n];
+        pending[n].content = read_file_offset(files[n], 0, &pending[n].size, MAX_PROG_SIZE);
+        if (!pending[n].content) {
+            free_pending_roms(pending, files_count);
+            return true;
+        }
+
+        compute_sha1(pending[n].content, pending[n].size, pending[n].sha1);
+    }
+
+    qsort(pending, files_count, sizeof(pending_rom_t), &compare_pending_sha1);
+    for (int n = 0; n < files_count; n++) {
+        if (n > 0 && compare_pending_sha1(&pending[n], &pending[n - 1]))
+            roms_count++;
+        pending[n].rom = roms_count;
+    }
+    roms_count += files_count > 0;
+
+    // The same file given twice is packed once
+    qsort(pending, files_count, sizeof(pending_rom_t), &compare_pending_name);
+    for (int n = 0; n < files_count; n++) {
+        if (names_count > 0 && !compare_pending_name(&pending[n], &pending[names_count - 1])) {
+            if (pending[n].rom != pending[names_count - 1].rom) {
+                dprintf(2, "%s : different ROMs with this name\n", pending[n].name);
+                free_pending_roms(pending, files_count);
+                return true;
+            }
+
+            continue;
+        }
+
+        pending_rom_t kept = pending[n];
+        pending[n] = pending[names_count];
+        pending[names_count++] = kept;
+    }
+
+    pack = build_rom_pack(pending, names_count, roms_count, &pack_size);
+    err = !pack || write_all(filepath, pack, pack_size);
+
+    free(pack);
+    free_pending_roms(pending, files_count);
+
+    return err;
+}
+
+static bool is_valid_rom_pack(const rom_pack_t *p)
+{
+    const rom_pack_header_t *header = p->header;
+    uint64_t index_end = sizeof(rom_pack_header_t)
+        + (uint64_t)header->roms_count * sizeof(packed_rom_t)
+        + (uint64_t)header->names_count * sizeof(packed_name_t);
+
+    if (memcmp(header->magic, ROM_PACK_MAGIC, sizeof(header->magic)) || header->version != ROM_PACK_VERSION)
+        return false;
+
+    if (index_end > p->size)
+        return false;
+
+    for (uint32_t r = 0; r < header->roms_count; r++)
+        if ((uint64_t)p->roms[r].offset + p->roms[r].size > p->size || p->roms[r].size > MAX_PROG_SIZE)
+            return false;
+
+    for (uint32_t n = 0; n < header->names_count; n++) {
+        const packed_name_t *name = &p->names[n];
+
+        if (name->rom >= header->roms_count || name->name_offset >= p->size)
+            return false;
+
+        if (!memchr(p->map + name->name_offset, '\0', p->size - name->name_offset))
+            return false;
+    }
+
+    return true;
+}
+
+bool open_rom_pack(rom_pack_t *p, const char *filepath)
+{
+    struct stat statbuf;
+    void *map;
+    int fd;
+
+    memset(p, 0, sizeof(rom_pack_t));
+
+    fd = open(filepath, O_RDONLY);
+    if (fd == -1 || fstat(fd, &statbuf) == -1) {
+        dprintf(2, "%s : %s\n", filepath, strerror(errno));
+        if (fd != -1)
+            close(fd);
+        return true;
+    }
+
+    if ((size_t)statbuf.st_size < sizeof(rom_pack_header_t)) {
+        dprintf(2, "%s : not a ROM pack\n", filepath);
+        close(fd);
+        return true;
+    }
+
+    map = mmap(NULL, statbuf.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        dprintf(2, "%s : %s\n", filepath, strerror(errno));
+        return true;
+    }
+
+    p->map = map;
+    p->size = statbuf.st_size;
+    p->header = map;
+    p->roms = (const packed_rom_t *)(p->map + sizeof(rom_pack_header_t));
+    p->names = (const packed_name_t *)(p->roms + p->header->roms_count);
+
+    if (!is_valid_rom_pack(p)) {
+        dprintf(2, "%s : not a ROM pack\n", filepath);
+        close_rom_pack(p);
+        return true;
+    }
+
+    return false;
+}
+
+void close_rom_pack(rom_pack_t *p)
+{
+    if (p->map)
+        munmap((void *)p->map, p->size);
+
+    memset(p, 0, sizeof(rom_pack_t));
+}
+
+/*
+ * ROM packed under this file name, or with this SHA-1 given as 40 hexadecimal digits.
+ * NULL when the pack has none.
+ */
+const packed_rom_t *find_packed_rom(const rom_pack_t *p, const char *key)
+{
+    uint8_t sha1[SHA1_SIZE];
+    uint32_t low = 0;
+    uint32_t high;
+
+    if (!parse_sha1(key, sha1)) {
+        high = p->header->roms_count;
+
+        while (low < high) {
+            uint32_t middle = low + (high - low) / 2;
+            int cmp = memcmp(sha1, p->roms[middle].sha1, SHA1_SIZE);
+
+            if (!cmp)
+                return &p->roms[middle];
+            if (cmp < 0)
+                high = middle;
+            else
+                low = middle + 1;
+        }
+
+        return NULL;
+    }
+
+    high = p->header->names_count;
+
+    while (low < high) {
+        uint32_t middle = low + (high - low) / 2;
+        int cmp = strcmp(key, (const char *)p->map + p->names[middle].name_offset);
+
+        if (!cmp)
+            return &p->roms[p->names[middle].rom];
+        if (cmp < 0)
+            high = middle;
+        else
+            low = middle + 1;
+    }
+
+    return NULL;
+}
+
+// Content of the ROM, read in place from the mapped pack
+const uint8_t *get_packed_rom_content(const rom_pack_t *p, const packed_rom_t *rom)
+{
+    return p->map + rom->offset;
+}
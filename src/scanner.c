@@ -0,0 +1,348 @@
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "scanner.h"
+#include "explore.h"
+#include "utils.h"
+
+/*
+ * Bytes filtered at once, the width of SSE2, NEON and WebAssembly SIMD registers, all baseline on their targets.
+ * Vector extensions rather than intrinsics, the compiler lowers them to the registers of the target.
+ */
+#define SCAN_VECTOR_SIZE 16
+
+typedef uint8_t scan_vector_t __attribute__((vector_size(SCAN_VECTOR_SIZE), may_alias));
+typedef struct scan_worker_s scan_worker_t;
+typedef struct scan_result_s scan_result_t;
+
+// Runs frames on the instances in [first, last)
+struct scan_worker_s {
+    pthread_t thread;
+    scanner_t *scanner;
+    const scan_step_t *step;
+    int first;
+    int last;
+};
+
+struct scan_result_s {
+    uint16_t address;
+    uint32_t instances;
+};
+
+const char *scan_filters_strings[SCAN_FILTERS_SIZE + 1] = {
+        "eq",
+        "changed",
+        "unchanged",
+        "increased",
+        "decreased",
+        NULL
+};
+
+static bool parse_scan_frames(const char *str, scan_step_t *step, scan_step_kind_t kind)
+{
+    step->kind = kind;
+
+    return parse_positive_int(str, &step->frames);
+}
+
+static bool parse_scan_keys(const char *str, scan_step_t *step)
+{
+    step->kind = KEYS_STEP;
+    step->keys = 0;
+
+    if (!strcmp(str, "-"))
+        return false;
+
+    if (!*str) {
+        dprintf(2, "no keys given, - for none\n");
+        return true;
+    }
+
+    for (const char *c = str; *c; c++) {
+        char digit[2] = {*c, 0};
+        char *end = NULL;
+        long key = strtol(digit, &end, 16);
+
+        if (*end || end == digit) {
+            dprintf(2, "%s : keys are hexadecimal digits, - for none\n", str);
+            return true;
+        }
+
+        step->keys |= 1 << key;
+    }
+
+    return false;
+}
+
+static bool parse_scan_value(const char *str, scan_step_t *step)
+{
+    char *end = NULL;
+    long value;
+
+    step->kind = FILTER_STEP;
+    step->filter = EQUAL_FILTER;
+
+    errno = 0;
+    value = strtol(str, &end, 0);
+    if (errno || end == str || *end || value < 0 || value > UINT8_MAX) {
+        dprintf(2, "%s : invalid byte value\n", str);
+        return true;
+    }
+
+    step->value = value;
+    return false;
+}
+
+bool parse_scan_step(const char *str, scan_step_t *step)
+{
+    memset(step, 0, sizeof(scan_step_t));
+
+    if (!strncmp(str, "frames:", 7))
+        return parse_scan_frames(str + 7, step, FRAMES_STEP);
+    if (!strncmp(str, "random:", 7))
+        return parse_scan_frames(str + 7, step, RANDOM_STEP);
+    if (!strncmp(str, "keys:", 5))
+        return parse_scan_keys(str + 5, step);
+    if (!strncmp(str, "eq:", 3))
+        return parse_scan_value(str + 3, step);
+
+    for (int f = CHANGED_FILTER; f < SCAN_FILTERS_SIZE; f++) {
+        if (!strcmp(str, scan_filters_strings[f])) {
+            step->kind = FILTER_STEP;
+            step->filter = f;
+            return false;
+        }
+    }
+
+    dprintf(2, "%s : unknown scan step\n", str);
+    return true;
+}
+
+static void capture_memories(scanner_t *s, uint8_t *memories)
+{
+    for (int n = 0; n < s->instances; n++)
+        copy_memory(&s->engines[n], memories + (size_t)n * MEMORY_SIZE);
+}
+
+bool init_scanner(scanner_t *s, chip8_engine_t *engines, int instances, int threads)
+{
+    size_t size = (size_t)instances * MEMORY_SIZE;
+
+    memset(s, 0, sizeof(scanner_t));
+
+    s->engines = engines;
+    s->instances = instances;
+    s->threads = threads > instances ? instances : threads;
+    s->random = malloc(instances * sizeof(uint32_t));
+    s->keys = calloc(instances, sizeof(uint16_t));
+    s->snapshot = aligned_alloc(SCAN_VECTOR_SIZE, size);
+    s->capture = aligned_alloc(SCAN_VECTOR_SIZE, size);
+    s->candidates = aligned_alloc(SCAN_VECTOR_SIZE, size);
+    if (!s->random || !s->keys || !s->snapshot || !s->capture || !s->candidates) {
+        dprintf(2, "malloc failed\n");
+        destroy_scanner(s);
+        return true;
+    }
+
+    for (int n = 0; n < instances; n++)
+        s->random[n] = (uint32_t)random() | 1;
+
+    memset(s->candidates, 0xff, size);
+    capture_memories(s, s->snapshot);
+
+    return false;
+}
+
+void destroy_scanner(scanner_t *s)
+{
+    free(s->random);
+    free(s->keys);
+    free(s->snapshot);
+    free(s->capture);
+    free(s->candidates);
+    memset(s, 0, sizeof(scanner_t));
+}
+
+static void *run_scan_worker(void *arg)
+{
+    scan_worker_t *w = arg;
+    scanner_t *s = w->scanner;
+
+    for (int n = w->first; n < w->last; n++) {
+        chip8_engine_t *e = &s->engines[n];
+
+        for (int f = 0; f < w->step->frames; f++) {
+            if (w->step->kind == RANDOM_STEP)
+                s->keys[n] = generate_random_keys(&s->random[n], s->keys[n]);
+            e->keyboard = s->keys[n];
+            run_chip8_frame(e, false, NULL, NULL);
+        }
+    }
+
+    return NULL;
+}
+
+// Instances are split between the threads, a thread failing to start leaves its share to this one
+static void run_scan_frames(scanner_t *s, const scan_step_t *step)
+{
+    scan_worker_t workers[s->threads];
+    int started = 0;
+
+    for (int t = 0; t < s->threads; t++) {
+        workers[t] = (scan_worker_t){
+            .scanner = s,
+            .step = step,
+            .first = t * s->instances / s->threads,
+            .last = (t + 1) * s->instances / s->threads,
+        };
+    }
+
+    for (; started < s->threads; started++) {
+        int err = pthread_create(&workers[started].thread, NULL, &run_scan_worker, &workers[started]);
+
+        if (err) {
+            dprintf(2, "pthread_create : %s\n", strerror(err));
+            break;
+        }
+    }
+
+    for (int t = started; t < s->threads; t++)
+        run_scan_worker(&workers[t]);
+
+    for (int t = 0; t < started; t++)
+        pthread_join(workers[t].thread, NULL);
+}
+
+// 0xff for the bytes matching the filter, 0 for the others
+static inline scan_vector_t match_bytes(scan_filter_t filter, scan_vector_t now, scan_vector_t before, uint8_t value)
+{
+    switch (filter) {
+        case EQUAL_FILTER:
+            return (scan_vector_t)(now == value);
+        case CHANGED_FILTER:
+            return (scan_vector_t)(now != before);
+        case UNCHANGED_FILTER:
+            return (scan_vector_t)(now == before);
+        case INCREASED_FILTER:
+            return (scan_vector_t)(now > before);
+        default:
+            return (scan_vector_t)(now < before);
+    }
+}
+
+static void filter_candidates(scanner_t *s, scan_filter_t filter, uint8_t value)
+{
+    size_t size = (size_t)s->instances * MEMORY_SIZE;
+    uint8_t *swap;
+
+    capture_memories(s, s->capture);
+
+    for (size_t i = 0; i < size; i += SCAN_VECTOR_SIZE) {
+        scan_vector_t *candidates = (scan_vector_t *)(s->candidates + i);
+
+        *candidates &= match_bytes(filter, *(const scan_vector_t *)(s->capture + i),
+                                   *(const scan_vector_t *)(s->snapshot + i), value);
+    }
+
+    swap = s->snapshot;
+    s->snapshot = s->capture;
+    s->capture = swap;
+}
+
+// Candidates left in all the instances
+uint64_t run_scan_step(scanner_t *s, const scan_step_t *step)
+{
+    switch (step->kind) {
+        case FRAMES_STEP:
+        case RANDOM_STEP:
+            run_scan_frames(s, step);
+            break;
+        case KEYS_STEP:
+            for (int n = 0; n < s->instances; n++)
+                s->keys[n] = step->keys;
+            break;
+        case FILTER_STEP:
+            filter_candidates(s, step->filter, step->value);
+            break;
+    }
+
+    return count_scan_candidates(s, NULL);
+}
+
+// Candidates left in all the instances, and the instances keeping each address in counts when not NULL
+uint64_t count_scan_candidates(const scanner_t *s, uint32_t counts[MEMORY_SIZE])
+{
+    uint32_t instances[MEMORY_SIZE] = {0};
+    uint64_t total = 0;
+
+    for (int n = 0; n < s->instances; n++) {
+        const uint8_t *candidates = s->candidates + (size_t)n * MEMORY_SIZE;
+
+        for (int a = 0; a < MEMORY_SIZE; a++)
+            instances[a] += candidates[a] & 1;
+    }
+
+    for (int a = 0; a < MEMORY_SIZE; a++)
+        total += instances[a];
+
+    if (counts)
+        memcpy(counts, instances, sizeof(instances));
+
+    return total;
+}
+
+static int compare_scan_results(const void *a, const void *b)
+{
+    const scan_result_t *x = a;
+    const scan_result_t *y = b;
+
+    if (x->instances != y->instances)
+        return x->instances < y->instances ? 1 : -1;
+
+    return x->address - y->address;
+}
+
+/*
+ * Addresses still candidates in the most instances, with the range of their values in these instances
+ * as of the last filter.
+ */
+void print_scan_candidates(const scanner_t *s)
+{
+    uint32_t counts[MEMORY_SIZE];
+    scan_result_t results[MEMORY_SIZE];
+    int results_count = 0;
+
+    count_scan_candidates(s, counts);
+
+    for (int a = 0; a < MEMORY_SIZE; a++)
+        if (counts[a])
+            results[results_count++] = (scan_result_t){.address = a, .instances = counts[a]};
+
+    qsort(results, results_count, sizeof(scan_result_t), &compare_scan_results);
+
+    printf("%d addresses left\n", results_count);
+
+    for (int r = 0; r < results_count && r < MAX_SCAN_RESULTS; r++) {
+        uint16_t address = results[r].address;
+        uint8_t low = UINT8_MAX;
+        uint8_t high = 0;
+
+        for (int n = 0; n < s->instances; n++) {
+            uint8_t value = s->snapshot[(size_t)n * MEMORY_SIZE + address];
+
+            if (!s->candidates[(size_t)n * MEMORY_SIZE + address])
+                continue;
+
+            low = value < low ? value : low;
+            high = value > high ? value : high;
+        }
+
+        printf("%04x %8u instances  values %u-%u\n", address, (unsigned)results[r].instances, low, high);
+    }
+
+    if (results_count > MAX_SCAN_RESULTS)
+        printf("... %d more\n", results_count - MAX_SCAN_RESULTS);
+}
@@ -0,0 +1,104 @@
+#include <ctype.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "sha1.h"
+
+#define SHA1_BLOCK_SIZE 64
+
+static uint32_t rotate_left(uint32_t value, int bits)
+{
+    return value << bits | value >> (32 - bits);
+}
+
+static void process_block(uint32_t h[5], const uint8_t block[SHA1_BLOCK_SIZE])
+{
+    uint32_t w[80];
+    uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+
+    for (int t = 0; t < 16; t++)
+        w[t] = (uint32_t)block[t * 4] << 24 | block[t * 4 + 1] << 16 | block[t * 4 + 2] << 8 | block[t * 4 + 3];
+
+    for (int t = 16; t < 80; t++)
+        w[t] = rotate_left(w[t - 3] ^ w[t - 8] ^ w[t - 14] ^ w[t - 16], 1);
+
+    for (int t = 0; t < 80; t++) {
+        uint32_t f, k;
+
+        if (t < 20) {
+            f = (b & c) | (~b & d);
+            k = 0x5a827999;
+        } else if (t < 40) {
+            f = b ^ c ^ d;
+            k = 0x6ed9eba1;
+        } else if (t < 60) {
+            f = (b & c) | (b & d) | (c & d);
+            k = 0x8f1bbcdc;
+        } else {
+            f = b ^ c ^ d;
+            k = 0xca62c1d6;
+        }
+
+        uint32_t temp = rotate_left(a, 5) + f + e + k + w[t];
+        e = d;
+        d = c;
+        c = rotate_left(b, 30);
+        b = a;
+        a = temp;
+    }
+
+    h[0] += a;
+    h[1] += b;
+    h[2] += c;
+    h[3] += d;
+    h[4] += e;
+}
+
+/*
+ * SHA-1 as specified by FIPS 180-4.
+ * Only used to identify ROMs, not for anything security related.
+ */
+void compute_sha1(const uint8_t *data, size_t size, uint8_t digest[SHA1_SIZE])
+{
+    uint32_t h[5] = {0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0};
+    uint8_t block[SHA1_BLOCK_SIZE];
+    size_t offset = 0;
+    uint64_t bits = (uint64_t)size * 8;
+
+    for (; size - offset >= SHA1_BLOCK_SIZE; offset += SHA1_BLOCK_SIZE)
+        process_block(h, data + offset);
+
+    // Last bytes, then a 1 bit, zeros, and the message length in bits on the last 8 bytes
+    memset(block, 0, SHA1_BLOCK_SIZE);
+    memcpy(block, data + offset, size - offset);
+    block[size - offset] = 0x80;
+
+    if (size - offset >= SHA1_BLOCK_SIZE - 8) {
+        process_block(h, block);
+        memset(block, 0, SHA1_BLOCK_SIZE);
+    }
+
+    for (int j = 0; j < 8; j++)
+        block[SHA1_BLOCK_SIZE - 1 - j] = (uint8_t)(bits >> (j * 8));
+
+    process_block(h, block);
+
+    for (int j = 0; j < SHA1_SIZE; j++)
+        digest[j] = (uint8_t)(h[j / 4] >> (24 - j % 4 * 8));
+}
+
+// SHA-1 written as exactly 40 hexadecimal digits, true otherwise
+bool parse_sha1(const char *str, uint8_t sha1[SHA1_SIZE])
+{
+    if (strlen(str) != SHA1_SIZE * 2)
+        return true;
+
+    for (int j = 0; j < SHA1_SIZE * 2; j++)
+        if (!isxdigit((unsigned char)str[j]))
+            return true;
+
+    for (int j = 0; j < SHA1_SIZE; j++)
+        sscanf(str + j * 2, "%2hhx", &sha1[j]);
+
+    return false;
+}
@@ -0,0 +1,219 @@
+#include <stddef.h>
+
+#include "specialized_executors.h"
+
+/*
+ * Handlers of the hot ALU and skip instructions, specialized for every register operand.
+ *
+ * The registers are baked into each handler, so they compile down to fixed offsets in e->v
+ * with no operand decoding or bound checking left. They must behave exactly like their
+ * generic counterparts in instructions_executors.c, including when x or y is VF.
+ */
+
+#define FOR_EACH_X(M, ...)  \
+    M(0, __VA_ARGS__) M(1, __VA_ARGS__) M(2, __VA_ARGS__) M(3, __VA_ARGS__) \
+    M(4, __VA_ARGS__) M(5, __VA_ARGS__) M(6, __VA_ARGS__) M(7, __VA_ARGS__) \
+    M(8, __VA_ARGS__) M(9, __VA_ARGS__) M(a, __VA_ARGS__) M(b, __VA_ARGS__) \
+    M(c, __VA_ARGS__) M(d, __VA_ARGS__) M(e, __VA_ARGS__) M(f, __VA_ARGS__)
+
+#define FOR_EACH_Y(M, ...)  \
+    M(0, __VA_ARGS__) M(1, __VA_ARGS__) M(2, __VA_ARGS__) M(3, __VA_ARGS__) \
+    M(4, __VA_ARGS__) M(5, __VA_ARGS__) M(6, __VA_ARGS__) M(7, __VA_ARGS__) \
+    M(8, __VA_ARGS__) M(9, __VA_ARGS__) M(a, __VA_ARGS__) M(b, __VA_ARGS__) \
+    M(c, __VA_ARGS__) M(d, __VA_ARGS__) M(e, __VA_ARGS__) M(f, __VA_ARGS__)
+
+// Handlers specialized on x only : name_x
+#define DEFINE_X_HANDLER(x, name, body)                                     \
+    static void name##_##x(chip8_engine_t *e, const instruction_t *i)       \
+    {                                                                       \
+        enum { X = 0x##x };                                                 \
+        (void)i;                                                            \
+        body                                                                \
+    }
+#define X_HANDLER_ENTRY(x, name) [0x##x] = &name##_##x,
+
+#define DEFINE_X_HANDLERS(name, body)                                       \
+    FOR_EACH_X(DEFINE_X_HANDLER, name, body)                                \
+    static const instruction_handler_t name##_handlers[V_REGISTERS_SIZE] = { \
+        FOR_EACH_X(X_HANDLER_ENTRY, name)                                   \
+    };
+
+// Handlers specialized on x and y : name_x_y
+#define DEFINE_X_Y_HANDLER(y, x, name, body)                                \
+    static void name##_##x##_##y(chip8_engine_t *e, const instruction_t *i) \
+    {                                                                       \
+        enum { X = 0x##x, Y = 0x##y };                                      \
+        (void)i;                                                            \
+        body                                                                \
+    }
+#define DEFINE_X_Y_HANDLERS_FOR_X(x, name, body) FOR_EACH_Y(DEFINE_X_Y_HANDLER, x, name, body)
+#define X_Y_HANDLER_ENTRY(y, x, name) [0x##x][0x##y] = &name##_##x##_##y,
+#define X_Y_HANDLER_ENTRIES_FOR_X(x, name) FOR_EACH_Y(X_Y_HANDLER_ENTRY, x, name)
+
+#define DEFINE_X_Y_HANDLERS(name, body)                                     \
+    FOR_EACH_X(DEFINE_X_Y_HANDLERS_FOR_X, name, body)                       \
+    static const instruction_handler_t name##_handlers[V_REGISTERS_SIZE][V_REGISTERS_SIZE] = { \
+        FOR_EACH_X(X_Y_HANDLER_ENTRIES_FOR_X, name)                         \
+    };
+
+// SKIP x, kk
+DEFINE_X_HANDLERS(skip_x_kk, {
+    e->pc += e->v[X] == i->kk ? 4 : 2;
+})
+
+// SKIPN x, kk
+DEFINE_X_HANDLERS(skipn_x_kk, {
+    e->pc += e->v[X] != i->kk ? 4 : 2;
+})
+
+// SKIP x, y
+DEFINE_X_Y_HANDLERS(skip_x_y, {
+    e->pc += e->v[X] == e->v[Y] ? 4 : 2;
+})
+
+// ADD x, kk
+DEFINE_X_HANDLERS(add_x_kk, {
+    e->pc += 2;
+    e->v[X] += i->kk;
+})
+
+// MOV x, y
+DEFINE_X_Y_HANDLERS(mov_x_y, {
+    e->pc += 2;
+    e->v[X] = e->v[Y];
+})
+
+// OR x, y
+DEFINE_X_Y_HANDLERS(or, {
+    e->pc += 2;
+    e->v[X] |= e->v[Y];
+})
+
+// OR x, y resetting VF
+DEFINE_X_Y_HANDLERS(or_vf_reset, {
+    e->pc += 2;
+    e->v[X] |= e->v[Y];
+    e->v[0xf] = 0;
+})
+
+// AND x, y
+DEFINE_X_Y_HANDLERS(and, {
+    e->pc += 2;
+    e->v[X] &= e->v[Y];
+})
+
+// AND x, y resetting VF
+DEFINE_X_Y_HANDLERS(and_vf_reset, {
+    e->pc += 2;
+    e->v[X] &= e->v[Y];
+    e->v[0xf] = 0;
+})
+
+// XOR x, y
+DEFINE_X_Y_HANDLERS(xor, {
+    e->pc += 2;
+    e->v[X] ^= e->v[Y];
+})
+
+// XOR x, y resetting VF
+DEFINE_X_Y_HANDLERS(xor_vf_reset, {
+    e->pc += 2;
+    e->v[X] ^= e->v[Y];
+    e->v[0xf] = 0;
+})
+
+// ADD x, y
+DEFINE_X_Y_HANDLERS(add_x_y, {
+    e->pc += 2;
+    uint16_t res = (uint16_t)e->v[X] + (uint16_t)e->v[Y];
+    e->v[0xf] = res > 255;
+    e->v[X] = (uint8_t)(res & 0xff);
+})
+
+// SUB x, y
+DEFINE_X_Y_HANDLERS(sub, {
+    e->pc += 2;
+    e->v[0xf] = e->v[X] >= e->v[Y];
+    e->v[X] -= e->v[Y];
+})
+
+// SHR x
+DEFINE_X_HANDLERS(shr, {
+    e->pc += 2;
+    e->v[0xf] = e->v[X] & 1;
+    e->v[X] /= 2;
+})
+
+// SHR x, y shifting Vy
+DEFINE_X_Y_HANDLERS(shr_vy, {
+    e->pc += 2;
+    e->v[0xf] = e->v[Y] & 1;
+    e->v[X] = e->v[Y] / 2;
+})
+
+// SUBN x, y
+DEFINE_X_Y_HANDLERS(subn, {
+    e->pc += 2;
+    e->v[0xf] = e->v[Y] > e->v[X];
+    e->v[X] = e->v[Y] - e->v[X];
+})
+
+// SHL x
+DEFINE_X_HANDLERS(shl, {
+    e->pc += 2;
+    e->v[0xf] = (e->v[X] >> 7) & 1;
+    e->v[X] *= 2;
+})
+
+// SHL x, y shifting Vy
+DEFINE_X_Y_HANDLERS(shl_vy, {
+    e->pc += 2;
+    e->v[0xf] = (e->v[Y] >> 7) & 1;
+    e->v[X] = e->v[Y] * 2;
+})
+
+// SKIPN x, y
+DEFINE_X_Y_HANDLERS(skipn_x_y, {
+    e->pc += e->v[X] != e->v[Y] ? 4 : 2;
+})
+
+/*
+ * Handler specialized on the operands of i, or NULL when its op code has none
+ * and the generic executor must be used.
+ * Handlers of quirk dependent instructions are picked for the given quirks.
+ */
+instruction_handler_t get_specialized_handler(const instruction_t *i, const quirks_t *quirks)
+{
+    switch (i->op_code) {
+        case SKIP_X_KK:
+            return skip_x_kk_handlers[i->x];
+        case SKIPN_X_KK:
+            return skipn_x_kk_handlers[i->x];
+        case SKIP_X_Y:
+            return skip_x_y_handlers[i->x][i->y];
+        case ADD_X_KK:
+            return add_x_kk_handlers[i->x];
+        case MOV_X_Y:
+            return mov_x_y_handlers[i->x][i->y];
+        case OR:
+            return quirks->vf_reset ? or_vf_reset_handlers[i->x][i->y] : or_handlers[i->x][i->y];
+        case AND:
+            return quirks->vf_reset ? and_vf_reset_handlers[i->x][i->y] : and_handlers[i->x][i->y];
+        case XOR:
+            return quirks->vf_reset ? xor_vf_reset_handlers[i->x][i->y] : xor_handlers[i->x][i->y];
+        case ADD_X_Y:
+            return add_x_y_handlers[i->x][i->y];
+        case SUB:
+            return sub_handlers[i->x][i->y];
+        case SHR:
+            return quirks->shift_vy ? shr_vy_handlers[i->x][i->y] : shr_handlers[i->x];
+        case SUBN:
+            return subn_handlers[i->x][i->y];
+        case SHL:
+            return quirks->shift_vy ? shl_vy_handlers[i->x][i->y] : shl_handlers[i->x];
+        case SKIPN_X_Y:
+            return skipn_x_y_handlers[i->x][i->y];
+        default:
+            return NULL;
+    }
+}
@@ -0,0 +1,277 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "trace.h"
+
+const uint8_t trace_registers[OP_CODES_SIZE] = {
+        [CLEAR] = TRACE_NO_REGISTER,
+        [RET] = TRACE_NO_REGISTER,
+        [JMP_NNN] = TRACE_NO_REGISTER,
+        [CALL] = TRACE_NO_REGISTER,
+        [SKIP_X_KK] = TRACE_NO_REGISTER,
+        [SKIPN_X_KK] = TRACE_NO_REGISTER,
+        [SKIP_X_Y] = TRACE_NO_REGISTER,
+        [MVI_X_KK] = TRACE_REGISTER_X,
+        [ADD_X_KK] = TRACE_REGISTER_X,
+        [MOV_X_Y] = TRACE_REGISTER_X,
+        [OR] = TRACE_REGISTER_X,
+        [AND] = TRACE_REGISTER_X,
+        [XOR] = TRACE_REGISTER_X,
+        [ADD_X_Y] = TRACE_REGISTER_X,
+        [SUB] = TRACE_REGISTER_X,
+        [SHR] = TRACE_REGISTER_X,
+        [SUBN] = TRACE_REGISTER_X,
+        [SHL] = TRACE_REGISTER_X,
+        [SKIPN_X_Y] = TRACE_NO_REGISTER,
+        [MVI_I_NNN] = TRACE_REGISTER_I,
+        [JMP_V0_NNN] = TRACE_NO_REGISTER,
+        [RAND] = TRACE_REGISTER_X,
+        [DISP] = TRACE_NO_REGISTER,
+        [SKIP_KEY] = TRACE_NO_REGISTER,
+        [SKIPN_KEY] = TRACE_NO_REGISTER,
+        [MOV_X_DELAY] = TRACE_REGISTER_X,
+        [MOV_KEY] = TRACE_REGISTER_X,
+        [MOV_DELAY_X] = TRACE_NO_REGISTER,
+        [MOV_SOUND] = TRACE_NO_REGISTER,
+        [ADD_I_X] = TRACE_REGISTER_I,
+        [SPRITE_POS] = TRACE_REGISTER_I,
+        [MOVBCD] = TRACE_NO_REGISTER,
+        [MOVM_I_X] = TRACE_REGISTER_I,
+        // Last register read
+        [MOVM_X_I] = TRACE_REGISTER_X,
+        [UNKNOWN] = TRACE_NO_REGISTER,
+};
+
+// Every address and every op code
+void init_trace_filter(trace_filter_t *filter)
+{
+    filter->low = 0;
+    filter->high = UINT16_MAX;
+    filter->op_codes = (1ULL << OP_CODES_SIZE) - 1;
+}
+
+static bool map_trace(trace_t *t, int fd, size_t size, int prot, int flags)
+{
+    void *map = mmap(NULL, size, prot, flags, fd, 0);
+
+    if (map == MAP_FAILED) {
+        dprintf(2, "mmap : %s\n", strerror(errno));
+        return true;
+    }
+
+    t->header = map;
+    t->records = (trace_record_t *)(t->header + 1);
+    t->map_size = size;
+    return false;
+}
+
+/*
+ * Trace of capacity records, rounded up to a power of two, kept in filepath or in memory only when it is NULL.
+ * The file is mapped, records reach it without any system call.
+ */
+bool init_trace(trace_t *t, const char *filepath, uint64_t capacity, const trace_filter_t *filter, const uint8_t sha1[SHA1_SIZE])
+{
+    uint64_t rounded = 1;
+    size_t size;
+    int fd = -1;
+    bool err;
+
+    memset(t, 0, sizeof(trace_t));
+
+    while (rounded < capacity)
+        rounded *= 2;
+    size = sizeof(trace_header_t) + rounded * sizeof(trace_record_t);
+
+    if (filepath) {
+        fd = open(filepath, O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (fd == -1 || ftruncate(fd, size) == -1) {
+            dprintf(2, "%s : %s\n", filepath, strerror(errno));
+            if (fd != -1)
+                close(fd);
+            return true;
+        }
+
+        err = map_trace(t, fd, size, PROT_READ | PROT_WRITE, MAP_SHARED);
+        close(fd);
+    } else
+        err = map_trace(t, -1, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS);
+
+    if (err)
+        return true;
+
+    memcpy(t->header->magic, TRACE_MAGIC, sizeof(t->header->magic));
+    t->header->version = TRACE_VERSION;
+    t->header->capacity = rounded;
+    t->header->head = 0;
+    memcpy(t->header->sha1, sha1, SHA1_SIZE);
+    t->header->filter = *filter;
+
+    t->mask = rounded - 1;
+    t->filter = *filter;
+
+    return false;
+}
+
+// Map a trace file written by init_trace, read only
+bool open_trace(trace_t *t, const char *filepath)
+{
+    struct stat statbuf;
+    int fd;
+    bool err;
+
+    memset(t, 0, sizeof(trace_t));
+
+    fd = open(filepath, O_RDONLY);
+    if (fd == -1 || fstat(fd, &statbuf) == -1) {
+        dprintf(2, "%s : %s\n", filepath, strerror(errno));
+        if (fd != -1)
+            close(fd);
+        return true;
+    }
+
+    if ((size_t)statbuf.st_size < sizeof(trace_header_t)) {
+        dprintf(2, "%s : not a trace\n", filepath);
+        close(fd);
+        return true;
+    }
+
+    err = map_trace(t, fd, statbuf.st_size, PROT_READ, MAP_PRIVATE);
+    close(fd);
+    if (err)
+        return true;
+
+    const trace_header_t *header = t->header;
+
+    if (memcmp(header->magic, TRACE_MAGIC, sizeof(header->magic)) || header->version != TRACE_VERSION
+        || !header->capacity || header->capacity & (header->capacity - 1)
+        || header->capacity > (t->map_size - sizeof(trace_header_t)) / sizeof(trace_record_t)) {
+        dprintf(2, "%s : not a trace\n", filepath);
+        destroy_trace(t);
+        return true;
+    }
+
+    t->mask = header->capacity - 1;
+    t->filter = header->filter;
+
+    return false;
+}
+
+void destroy_trace(trace_t *t)
+{
+    if (t->header)
+        munmap(t->header, t->map_size);
+
+    memset(t, 0, sizeof(trace_t));
+}
+
+// Oldest record still in the ring, records [first, head) are valid
+uint64_t get_trace_first(const trace_t *t)
+{
+    return t->header->head > t->header->capacity ? t->header->head - t->header->capacity : 0;
+}
+
+const trace_record_t *get_trace_record(const trace_t *t, uint64_t n)
+{
+    return &t->records[n & t->mask];
+}
+
+/*
+ * Text : cycle, then the instruction as disassembled, then the register it wrote.
+ * JSON : one object per record.
+ * buf holds at least MAX_DISAS_RECORD_SIZE bytes.
+ */
+size_t format_trace_record(char *buf, const trace_record_t *r, disas_format_t format)
+{
+    instruction_t i;
+    char reg[4] = "";
+    char line[MAX_DISAS_RECORD_SIZE];
+    size_t size;
+
+    decode_instruction(r->instruction, &i);
+    i.op_code = r->op_code < OP_CODES_SIZE ? r->op_code : UNKNOWN;
+
+    if (r->reg < V_REGISTERS_SIZE)
+        snprintf(reg, sizeof(reg), "v%x", r->reg);
+    else if (r->reg == TRACE_REGISTER_I)
+        strcpy(reg, "I");
+
+    if (format == JSON_FORMAT) {
+        size = snprintf(buf, MAX_DISAS_RECORD_SIZE,
+                "{\"cycle\":%lu,\"pc\":\"%04x\",\"instruction\":\"%04x\",\"op\":\"%s\"",
+                (unsigned long)r->cycle, r->pc, r->instruction, op_codes_strings[i.op_code]);
+        if (*reg)
+            size += snprintf(buf + size, MAX_DISAS_RECORD_SIZE - size, ",\"reg\":\"%s\",\"value\":%u", reg, r->value);
+        size += snprintf(buf + size, MAX_DISAS_RECORD_SIZE - size, "}\n");
+        return size;
+    }
+
+    // Without its line feed
+    size = format_instruction(line, r->pc, &i) - 1;
+    size = snprintf(buf, MAX_DISAS_RECORD_SIZE, "%12lu %.*s", (unsigned long)r->cycle, (int)size, line);
+    if (*reg)
+        size += snprintf(buf + size, MAX_DISAS_RECORD_SIZE - size, "%*s; %s = %x", size < 40 ? (int)(40 - size) : 1, "", reg, r->value);
+    size += snprintf(buf + size, MAX_DISAS_RECORD_SIZE - size, "\n");
+
+    return size;
+}
+
+// Address range as LOW-HIGH, in hexadecimal, or a single address
+bool parse_trace_range(const char *str, uint16_t *low, uint16_t *high)
+{
+    unsigned int l;
+    unsigned int h;
+    int end = 0;
+
+    if (str && sscanf(str, "%x-%x%n", &l, &h, &end) == 2 && !str[end] && l <= h && h <= UINT16_MAX) {
+        *low = l;
+        *high = h;
+        return false;
+    }
+
+    if (str && sscanf(str, "%x%n", &l, &end) == 1 && !str[end] && l <= UINT16_MAX) {
+        *low = *high = l;
+        return false;
+    }
+
+    dprintf(2, "%s : invalid address range\n", str ? str : "(null)");
+    return true;
+}
+
+// Comma separated mnemonics, every op code with one of them is added to op_codes
+bool parse_trace_op_codes(const char *str, uint64_t *op_codes)
+{
+    char *list = str ? strdup(str) : NULL;
+    char *save = NULL;
+
+    if (!list) {
+        dprintf(2, "missing op codes\n");
+        return true;
+    }
+
+    for (char *name = strtok_r(list, ",", &save); name; name = strtok_r(NULL, ",", &save)) {
+        bool found = false;
+
+        for (int op = 0; op < OP_CODES_SIZE; op++) {
+            if (!strcasecmp(name, op_codes_strings[op])) {
+                *op_codes |= 1ULL << op;
+                found = true;
+            }
+        }
+
+        if (!found) {
+            dprintf(2, "%s : unknown op code\n", name);
+            free(list);
+            return true;
+        }
+    }
+
+    free(list);
+    return false;
+}
@@ -0,0 +1,51 @@
+#include <string.h>
+
+#include "triple_buffer.h"
+
+#define TRIPLE_BUFFER_INDEX_MASK    0x3
+#define TRIPLE_BUFFER_FRESH         0x4
+
+void init_triple_buffer(triple_buffer_t *tb)
+{
+    memset(tb->frames, 0, sizeof(tb->frames));
+    tb->back = 0;
+    tb->published = 0;
+    tb->overwritten = 0;
+    atomic_init(&tb->middle, 1);
+    tb->front = 2;
+}
+
+frame_t *get_back_frame(triple_buffer_t *tb)
+{
+    return &tb->frames[tb->back];
+}
+
+void publish_back_frame(triple_buffer_t *tb)
+{
+    tb->frames[tb->back].id = ++tb->published;
+
+    uint_fast8_t old = atomic_exchange_explicit(
+        &tb->middle,
+        tb->back | TRIPLE_BUFFER_FRESH,
+        memory_order_acq_rel
+    );
+
+    tb->back = old & TRIPLE_BUFFER_INDEX_MASK;
+    if (old & TRIPLE_BUFFER_FRESH)
+        tb->overwritten++;
+}
+
+const frame_t *get_latest_frame(triple_buffer_t *tb, bool *fresh)
+{
+    bool is_fresh = atomic_load_explicit(&tb->middle, memory_order_relaxed) & TRIPLE_BUFFER_FRESH;
+
+    if (is_fresh) {
+        uint_fast8_t old = atomic_exchange_explicit(&tb->middle, tb->front, memory_order_acq_rel);
+        tb->front = old & TRIPLE_BUFFER_INDEX_MASK;
+    }
+
+    if (fresh)
+        *fresh = is_fresh;
+
+    return &tb->frames[tb->front];
+}
@@ -84,7 +84,44 @@ bool load_file_to_memory(const char *filepath, uint8_t memory[], uint16_t *prog_
     return false;
 }
 
-uint8_t generate_random_byte()
+/*
+ * Next value of a xorshift32 generator, its state is never 0.
+ * Each engine keeps its own state, so the same state draws the same values whatever else runs.
+ */
+uint32_t generate_random(uint32_t *state)
 {
-    return (uint8_t)(random() % 256);
-}
\ No newline at end of file
+    uint32_t x = *state;
+
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+
+    return x;
+}
+
+uint8_t generate_random_byte(uint32_t *state)
+{
+    return (uint8_t)(generate_random(state) >> 24);
+}
+
+bool parse_positive_int(const char *str, int *value)
+{
+    char *end = NULL;
+    long res;
+
+    if (!str) {
+        dprintf(2, "missing numeric value\n");
+        return true;
+    }
+
+    errno = 0;
+    res = strtol(str, &end, 10);
+    if (errno || end == str || *end || res <= 0 || res > INT32_MAX) {
+        dprintf(2, "%s : invalid positive number\n", str);
+        return true;
+    }
+
+    *value = (int)res;
+    return false;
+}
@@ -0,0 +1,218 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "verify.h"
+#include "disas.h"
+
+// Copy of e without any instrumentation, running the reference engine
+static void copy_reference_engine(chip8_engine_t *copy, const chip8_engine_t *e)
+{
+    copy_chip8_engine(copy, e);
+    copy->execution_engine = REFERENCE_ENGINE;
+    copy->predecoded = NULL;
+    copy->latency = NULL;
+    copy->trace = NULL;
+    copy->profiler = NULL;
+}
+
+// The verified engine as it is now, its predecoded instructions included as they may be what is wrong
+static void save_checkpoint(verifier_t *v, const chip8_engine_t *e)
+{
+    copy_chip8_engine(&v->checkpoint, e);
+    if (e->predecoded)
+        memcpy(v->checkpoint_predecoded, e->predecoded, MEMORY_SIZE * sizeof(predecoded_t));
+    v->checkpoint.predecoded = e->predecoded ? v->checkpoint_predecoded : NULL;
+
+    v->keys_count = 0;
+    v->next_check = e->cycles + v->interval;
+}
+
+bool init_verifier(verifier_t *v, const chip8_engine_t *e, uint64_t interval, int instance)
+{
+    memset(v, 0, sizeof(verifier_t));
+
+    v->interval = interval;
+    v->instance = instance;
+    v->keys_capacity = 64;
+    v->keys = malloc(v->keys_capacity * sizeof(verify_keys_t));
+    v->checkpoint_predecoded = malloc(MEMORY_SIZE * sizeof(predecoded_t));
+    if (!v->keys || !v->checkpoint_predecoded) {
+        dprintf(2, "malloc failed\n");
+        destroy_verifier(v);
+        return true;
+    }
+
+    copy_reference_engine(&v->shadow, e);
+    save_checkpoint(v, e);
+
+    return false;
+}
+
+void destroy_verifier(verifier_t *v)
+{
+    free(v->keys);
+    free(v->checkpoint_predecoded);
+    v->keys = NULL;
+    v->checkpoint_predecoded = NULL;
+}
+
+// Called once the keys of the frame are set, before running it
+void start_verify_frame(verifier_t *v, const chip8_engine_t *e)
+{
+    if (v->diverged)
+        return;
+
+    if (v->keys_count == v->keys_capacity) {
+        verify_keys_t *keys = realloc(v->keys, v->keys_capacity * 2 * sizeof(verify_keys_t));
+
+        // Without the keys the replay would be wrong, verification stops
+        if (!keys) {
+            dprintf(2, "Instance %d : realloc failed, verification stopped\n", v->instance);
+            v->diverged = true;
+            return;
+        }
+
+        v->keys = keys;
+        v->keys_capacity *= 2;
+    }
+
+    v->keys[v->keys_count++] = (verify_keys_t){.cycle = e->cycles, .keys = e->keyboard};
+}
+
+static uint16_t get_replay_keys(const verifier_t *v, uint64_t cycle, size_t *frame)
+{
+    while (*frame + 1 < v->keys_count && v->keys[*frame + 1].cycle <= cycle)
+        (*frame)++;
+
+    return v->keys_count ? v->keys[*frame].keys : 0;
+}
+
+// hash_chip8_state leaves the cycle count out, engines in lockstep must also be at the same cycle
+static bool is_same_state(const chip8_engine_t *a, const chip8_engine_t *b)
+{
+    return a->cycles == b->cycles && hash_chip8_state(a) == hash_chip8_state(b);
+}
+
+static void dump_engine(const char *name, const chip8_engine_t *e)
+{
+    dprintf(2, "%-10s pc %04x  I %04x  sp %x  delay %02x  sound %02x  cycle %lu\n", name, e->pc, e->i, e->sp,
+            get_timer(e, &e->delay), get_timer(e, &e->sound), (unsigned long)e->cycles);
+
+    dprintf(2, "%-10s", "");
+    for (int r = 0; r < V_REGISTERS_SIZE; r++)
+        dprintf(2, " v%x=%02x", r, e->v[r]);
+    dprintf(2, "\n%-10s stack", "");
+    for (int s = 0; s < STACK_SIZE; s++)
+        dprintf(2, " %04x", e->stack[s]);
+    dprintf(2, "\n");
+}
+
+static void dump_divergence(const verifier_t *v, const chip8_engine_t *e, const chip8_engine_t *reference, uint16_t pc, const instruction_t *i)
+{
+    char line[MAX_DISAS_RECORD_SIZE];
+    int listed = 0;
+
+    dprintf(2, "Instance %d : %s engine diverged from the reference after the dispatch at\n",
+            v->instance, execution_engines_strings[e->execution_engine]);
+    dprintf(2, "%.*s", (int)format_instruction(line, pc, i), line);
+
+    dump_engine(execution_engines_strings[e->execution_engine], e);
+    dump_engine("reference", reference);
+
+    for (int a = 0; a < MEMORY_SIZE && listed < MAX_VERIFY_DIFFERENCES; a++)
+        if (read_memory(e, a) != read_memory(reference, a) && ++listed)
+            dprintf(2, "memory %04x : %02x, reference %02x\n", a, read_memory(e, a), read_memory(reference, a));
+
+    listed = 0;
+    for (int y = 0; y < CHIP8_WINDOW_HEIGHT && listed < MAX_VERIFY_DIFFERENCES; y++)
+        if (memcmp(get_screen_row(e, y), get_screen_row(reference, y), CHIP8_WINDOW_WIDTH) && ++listed)
+            dprintf(2, "screen row %d differs\n", y);
+}
+
+/*
+ * Replay the verified engine from the checkpoint, dispatch by dispatch, with the reference catching up
+ * after each of them, until their states differ or the cycle of the failed comparison is reached.
+ */
+static void replay_divergence(const verifier_t *v, uint64_t until)
+{
+    chip8_engine_t *replay = malloc(sizeof(chip8_engine_t));
+    chip8_engine_t *reference = malloc(sizeof(chip8_engine_t));
+    predecoded_t *predecoded = malloc(MEMORY_SIZE * sizeof(predecoded_t));
+    size_t replay_frame = 0;
+    size_t reference_frame = 0;
+
+    if (!replay || !reference || !predecoded) {
+        dprintf(2, "malloc failed\n");
+        free(replay);
+        free(reference);
+        free(predecoded);
+        return;
+    }
+
+    copy_chip8_engine(replay, &v->checkpoint);
+    memcpy(predecoded, v->checkpoint_predecoded, MEMORY_SIZE * sizeof(predecoded_t));
+    replay->predecoded = v->checkpoint.predecoded ? predecoded : NULL;
+    replay->latency = NULL;
+    replay->trace = NULL;
+    replay->profiler = NULL;
+    copy_reference_engine(reference, &v->checkpoint);
+
+    while (replay->cycles < until) {
+        uint16_t pc = MEMORY_ADDRESS(replay->pc);
+        instruction_t i;
+
+        fetch_instruction(replay, pc, &i);
+
+        replay->keyboard = get_replay_keys(v, replay->cycles, &replay_frame);
+        update_chip8_engine(replay, false);
+        if (v->skip_idle && replay->pc == replay->idle_loop)
+            skip_idle_loop(replay);
+
+        while (reference->cycles < replay->cycles) {
+            reference->keyboard = get_replay_keys(v, reference->cycles, &reference_frame);
+            update_chip8_engine(reference, false);
+        }
+
+        if (!is_same_state(replay, reference)) {
+            dump_divergence(v, replay, reference, pc, &i);
+            break;
+        }
+    }
+
+    if (replay->cycles >= until)
+        dprintf(2, "Instance %d : divergence not reproduced from cycle %lu\n",
+                v->instance, (unsigned long)v->checkpoint.cycles);
+
+    free(replay);
+    free(reference);
+    free(predecoded);
+}
+
+/*
+ * Called once the frame is run : the shadow catches up with the keys of the frame,
+ * then both states are compared when the interval is elapsed.
+ */
+void verify_frame(verifier_t *v, const chip8_engine_t *e)
+{
+    if (v->diverged)
+        return;
+
+    v->shadow.keyboard = e->keyboard;
+    while (v->shadow.cycles < e->cycles)
+        update_chip8_engine(&v->shadow, false);
+
+    if (e->cycles < v->next_check)
+        return;
+
+    v->checks++;
+    if (is_same_state(e, &v->shadow)) {
+        save_checkpoint(v, e);
+        return;
+    }
+
+    v->diverged = true;
+    dprintf(2, "Instance %d : states differ at cycle %lu, replaying from cycle %lu\n",
+            v->instance, (unsigned long)e->cycles, (unsigned long)v->checkpoint.cycles);
+    replay_divergence(v, e->cycles);
+}
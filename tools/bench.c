@@ -0,0 +1,547 @@
+/*
+ * Micro and macro benchmarks of the emulator, built and run by make bench.
+ *
+ * Micro benchmarks time decoding, every op code handler, DXYN and 00E0 on their own, and the frame handoff
+ * and texture upload of the render path. Macro benchmarks run ROMs headless on every execution engine
+ * for a fixed cycle count, with scripted input.
+ * Every benchmark keeps the best of its repeats. Results are printed as a table and written as JSON with --out,
+ * compared with the results of a previous run given with --baseline.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <SDL2/SDL.h>
+
+#include "batch.h"
+#include "triple_buffer.h"
+
+#define BENCH_NAME_SIZE         64
+#define MAX_BENCH_RESULTS       256
+#define DEFAULT_BENCH_TIME_MS   100
+#define DEFAULT_BENCH_REPEATS   5
+#define DEFAULT_MACRO_CYCLES    2000000
+// Memory the handlers read and write, away from the ROM
+#define BENCH_I                 0x300
+
+typedef struct bench_result_s bench_result_t;
+typedef struct bench_s bench_t;
+typedef struct bench_case_s bench_case_t;
+typedef struct scripted_keys_s scripted_keys_t;
+
+struct bench_result_s {
+    char name[BENCH_NAME_SIZE];
+    uint64_t iterations;
+    double ns_per_op;
+    // Negative when the baseline has no result of this name
+    double baseline;
+};
+
+struct bench_s {
+    const char *filter;
+    long int time_ms;
+    int repeats;
+    uint64_t macro_cycles;
+    bench_result_t results[MAX_BENCH_RESULTS];
+    int results_count;
+    bench_result_t baseline[MAX_BENCH_RESULTS];
+    int baseline_count;
+};
+
+// What a micro benchmark runs : an engine with an instruction, or the render path
+struct bench_case_s {
+    chip8_engine_t *engine;
+    // Flat copy of the engine memory, for the decoder of the disassembler
+    const uint8_t *memory;
+    instruction_t instruction;
+    triple_buffer_t *frames;
+    SDL_Texture *texture;
+};
+
+// Keys held from frame first of every SCRIPT_PERIOD frames
+struct scripted_keys_s {
+    uint64_t first;
+    uint16_t keys;
+};
+
+#define SCRIPT_PERIOD 240
+
+// Pong paddles : 1 and 4 on the left, C and D on the right
+static const scripted_keys_t input_script[] = {
+        {0, 1 << 0x1},
+        {60, 1 << 0x4},
+        {120, 1 << 0xc},
+        {180, 1 << 0xd | 1 << 0x1},
+};
+
+// A representative instruction word per op code, registers v1 and v2
+static const uint16_t op_codes_words[OP_CODES_SIZE] = {
+        [CLEAR] = 0x00e0,
+        [RET] = 0x00ee,
+        [JMP_NNN] = 0x1200,
+        [CALL] = 0x2200,
+        [SKIP_X_KK] = 0x3105,
+        [SKIPN_X_KK] = 0x4105,
+        [SKIP_X_Y] = 0x5120,
+        [MVI_X_KK] = 0x6105,
+        [ADD_X_KK] = 0x7105,
+        [MOV_X_Y] = 0x8120,
+        [OR] = 0x8121,
+        [AND] = 0x8122,
+        [XOR] = 0x8123,
+        [ADD_X_Y] = 0x8124,
+        [SUB] = 0x8125,
+        [SHR] = 0x8126,
+        [SUBN] = 0x8127,
+        [SHL] = 0x812e,
+        [SKIPN_X_Y] = 0x9120,
+        [MVI_I_NNN] = 0xa300,
+        [JMP_V0_NNN] = 0xb200,
+        [RAND] = 0xc1ff,
+        [DISP] = 0xd125,
+        [SKIP_KEY] = 0xe19e,
+        [SKIPN_KEY] = 0xe1a1,
+        [MOV_X_DELAY] = 0xf107,
+        [MOV_KEY] = 0xf10a,
+        [MOV_DELAY_X] = 0xf115,
+        [MOV_SOUND] = 0xf118,
+        [ADD_I_X] = 0xf11e,
+        [SPRITE_POS] = 0xf129,
+        [MOVBCD] = 0xf133,
+        [MOVM_I_X] = 0xf555,
+        [MOVM_X_I] = 0xf565,
+        [UNKNOWN] = 0xffff,
+};
+
+static uint64_t get_time_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static bool is_selected(const bench_t *b, const char *name)
+{
+    return !b->filter || strstr(name, b->filter);
+}
+
+static void add_result(bench_t *b, const char *name, uint64_t iterations, double ns_per_op)
+{
+    bench_result_t *r;
+
+    if (b->results_count == MAX_BENCH_RESULTS)
+        return;
+
+    r = &b->results[b->results_count++];
+    snprintf(r->name, sizeof(r->name), "%s", name);
+    r->iterations = iterations;
+    r->ns_per_op = ns_per_op;
+    r->baseline = -1;
+
+    for (int k = 0; k < b->baseline_count; k++)
+        if (!strcmp(b->baseline[k].name, name))
+            r->baseline = b->baseline[k].ns_per_op;
+
+    printf("%-40s %14.2f ns", r->name, r->ns_per_op);
+    if (r->baseline > 0)
+        printf("  %+7.1f%%", 100 * (r->ns_per_op - r->baseline) / r->baseline);
+    printf("\n");
+}
+
+/*
+ * Double the iterations until a run lasts a tenth of the time given to each repeat,
+ * then scale them to that time and keep the fastest repeat.
+ */
+static void run_micro(bench_t *b, const char *name, void (*run)(bench_case_t *, uint64_t), bench_case_t *c)
+{
+    uint64_t iterations = 1;
+    uint64_t elapsed = 0;
+    uint64_t target = (uint64_t)b->time_ms * 1000000ULL;
+    double best = 0;
+
+    if (!is_selected(b, name))
+        return;
+
+    while (elapsed < target / 10) {
+        uint64_t start = get_time_ns();
+
+        iterations *= 2;
+        run(c, iterations);
+        elapsed = get_time_ns() - start;
+    }
+
+    iterations = iterations * target / (elapsed ? elapsed : 1) + 1;
+
+    for (int r = 0; r < b->repeats; r++) {
+        uint64_t start = get_time_ns();
+        double ns;
+
+        run(c, iterations);
+        ns = (double)(get_time_ns() - start) / iterations;
+        if (!r || ns < best)
+            best = ns;
+    }
+
+    add_result(b, name, iterations, best);
+}
+
+// Every even address of the memory, read from a flat buffer as by the disassembler
+static void run_read_next_instruction(bench_case_t *c, uint64_t iterations)
+{
+    volatile uint8_t sink = 0;
+    instruction_t i;
+
+    for (uint64_t n = 0; n < iterations; n++) {
+        read_next_instruction(c->memory, (n * 2) & (MEMORY_SIZE - 2), &i);
+        sink += i.op_code;
+    }
+}
+
+// The same addresses fetched from the paged memory of the engines
+static void run_fetch_instruction(bench_case_t *c, uint64_t iterations)
+{
+    const chip8_engine_t *e = c->engine;
+    volatile uint8_t sink = 0;
+    instruction_t i;
+
+    for (uint64_t n = 0; n < iterations; n++) {
+        fetch_instruction(e, (n * 2) & (MEMORY_SIZE - 2), &i);
+        sink += i.op_code;
+    }
+}
+
+// The stack, pc and I are reset before every call so CALL, RET and memory writes stay in bounds
+static void run_handler(bench_case_t *c, uint64_t iterations)
+{
+    chip8_engine_t *e = c->engine;
+    instruction_handler_t handler = e->executors[c->instruction.op_code];
+
+    for (uint64_t n = 0; n < iterations; n++) {
+        e->pc = INITIAL_PROGRAM_COUNTER;
+        e->sp = 1;
+        e->i = BENCH_I;
+        handler(e, &c->instruction);
+    }
+}
+
+static void run_publish(bench_case_t *c, uint64_t iterations)
+{
+    for (uint64_t n = 0; n < iterations; n++) {
+        copy_screen(c->engine, get_back_frame(c->frames)->pixels);
+        publish_back_frame(c->frames);
+        get_latest_frame(c->frames, NULL);
+    }
+}
+
+// Uploads the frame published by render/publish
+static void run_upload(bench_case_t *c, uint64_t iterations)
+{
+    const frame_t *frame = get_latest_frame(c->frames, NULL);
+
+    for (uint64_t n = 0; n < iterations; n++)
+        SDL_UpdateTexture(c->texture, NULL, frame->pixels, CHIP8_WINDOW_WIDTH * sizeof(uint8_t));
+}
+
+static void init_bench_engine(chip8_engine_t *e)
+{
+    init_chip8_engine(e);
+    e->cycles_per_tick = DEFAULT_INSTRUCTIONS_PER_FRAME;
+    e->keyboard = 1 << 0x1;
+    // Something to decode and to draw
+    for (int a = INITIAL_PROGRAM_COUNTER; a < MEMORY_SIZE; a++)
+        write_memory(e, a, (uint8_t)(a * 37 + 11));
+}
+
+static void bench_op_codes(bench_t *b, chip8_engine_t *e)
+{
+    uint8_t memory[MEMORY_SIZE];
+    bench_case_t c = {.engine = e, .memory = memory};
+    char name[BENCH_NAME_SIZE];
+
+    for (int a = 0; a < MEMORY_SIZE; a++)
+        memory[a] = read_memory(e, a);
+
+    run_micro(b, "decode/read_next_instruction", &run_read_next_instruction, &c);
+    run_micro(b, "decode/fetch_instruction", &run_fetch_instruction, &c);
+
+    for (int op = 0; op < OP_CODES_SIZE; op++) {
+        decode_instruction(op_codes_words[op], &c.instruction);
+        c.instruction.op_code = op_codes_table[c.instruction.instruction];
+        if (c.instruction.op_code != (op_code_t)op) {
+            dprintf(2, "Warning : %04x is not a %s instruction\n", op_codes_words[op], op_codes_strings[op]);
+            continue;
+        }
+
+        // Mnemonics are shared by several op codes, the word tells them apart
+        snprintf(name, sizeof(name), "op/%04x_%s", op_codes_words[op], op_codes_strings[op]);
+        run_micro(b, name, &run_handler, &c);
+    }
+}
+
+// Sprites of 1, 5 and 15 rows, byte aligned, unaligned, and wrapping around both edges
+static void bench_sprites(bench_t *b, chip8_engine_t *e)
+{
+    static const struct {
+        const char *name;
+        uint8_t x;
+        uint8_t y;
+    } positions[] = {{"aligned", 8, 4}, {"unaligned", 11, 4}, {"wrap", 60, 28}};
+    static const uint8_t heights[] = {1, 5, 15};
+    bench_case_t c = {.engine = e};
+    char name[BENCH_NAME_SIZE];
+
+    for (size_t p = 0; p < sizeof(positions) / sizeof(*positions); p++) {
+        for (size_t h = 0; h < sizeof(heights); h++) {
+            e->v[1] = positions[p].x;
+            e->v[2] = positions[p].y;
+            read_next_instruction((uint8_t[]){0xd1, 0x20 | heights[h]}, 0, &c.instruction);
+
+            snprintf(name, sizeof(name), "disp/h%u_%s", heights[h], positions[p].name);
+            run_micro(b, name, &run_handler, &c);
+        }
+    }
+
+    read_next_instruction((uint8_t[]){0x00, 0xe0}, 0, &c.instruction);
+    run_micro(b, "disp/clear", &run_handler, &c);
+}
+
+// Handing a frame over to the render thread, then uploading it as the display does
+static void bench_render(bench_t *b, chip8_engine_t *e)
+{
+    triple_buffer_t frames;
+    bench_case_t c = {.engine = e, .frames = &frames};
+    SDL_Window *window;
+    SDL_Renderer *renderer;
+
+    init_triple_buffer(&frames);
+    run_micro(b, "render/publish", &run_publish, &c);
+
+    if (!is_selected(b, "render/upload"))
+        return;
+
+    if (SDL_Init(SDL_INIT_VIDEO)
+        || !(window = SDL_CreateWindow("chip8 bench", 0, 0, WINDOW_WIDTH, WINDOW_HEIGHT, SDL_WINDOW_HIDDEN))) {
+        dprintf(2, "Warning : render/upload skipped : %s\n", SDL_GetError());
+        return;
+    }
+
+    renderer = SDL_CreateRenderer(window, -1, 0);
+    c.texture = renderer ? SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGB332, SDL_TEXTUREACCESS_STATIC,
+            CHIP8_WINDOW_WIDTH, CHIP8_WINDOW_HEIGHT) : NULL;
+
+    if (c.texture)
+        run_micro(b, "render/upload", &run_upload, &c);
+    else
+        dprintf(2, "Warning : render/upload skipped : %s\n", SDL_GetError());
+
+    SDL_DestroyTexture(c.texture);
+    SDL_DestroyRenderer(renderer);
+    SDL_DestroyWindow(window);
+    SDL_Quit();
+}
+
+static uint16_t get_scripted_keys(uint64_t frame)
+{
+    uint16_t keys = 0;
+
+    for (size_t k = 0; k < sizeof(input_script) / sizeof(*input_script); k++)
+        if (frame % SCRIPT_PERIOD >= input_script[k].first)
+            keys = input_script[k].keys;
+
+    return keys;
+}
+
+/*
+ * Frames as the batch workers run them, idle loops skipped, until cycles instructions are executed.
+ * The ROM is loaded and tuned from the ROM database as interpret does, RAND is seeded the same on every run.
+ */
+static bool run_macro(const char *rom, execution_engine_t engine, uint64_t cycles, uint64_t *frames, uint64_t *elapsed)
+{
+    batch_t batch;
+    uint64_t start;
+
+    srandom(0);
+    if (init_batch(&batch, &rom, 1, NULL, 1, 1))
+        return true;
+
+    if (set_batch_execution_engine(&batch, engine)) {
+        destroy_batch(&batch);
+        return true;
+    }
+
+    chip8_engine_t *e = &batch.engines[0];
+
+    *frames = 0;
+    start = get_time_ns();
+
+    while (e->cycles < cycles) {
+        e->keyboard = get_scripted_keys(*frames);
+        run_chip8_frame(e, false, NULL, NULL);
+        e->draw_flag = false;
+        (*frames)++;
+    }
+
+    *elapsed = get_time_ns() - start;
+    destroy_batch(&batch);
+
+    return false;
+}
+
+// Nanoseconds per emulated instruction, frames are reported alongside in nanoseconds per frame
+static bool bench_roms(bench_t *b, const char **roms, int roms_count)
+{
+    char name[BENCH_NAME_SIZE];
+
+    for (int r = 0; r < roms_count; r++) {
+        const char *basename = strrchr(roms[r], '/') ? strrchr(roms[r], '/') + 1 : roms[r];
+
+        for (int engine = 0; engine < EXECUTION_ENGINES_SIZE; engine++) {
+            double best_cycle = 0;
+            double best_frame = 0;
+            uint64_t frames = 0;
+
+            snprintf(name, sizeof(name), "macro/%s/%s", basename, execution_engines_strings[engine]);
+            if (!is_selected(b, name))
+                continue;
+
+            for (int repeat = 0; repeat < b->repeats; repeat++) {
+                uint64_t elapsed;
+
+                if (run_macro(roms[r], engine, b->macro_cycles, &frames, &elapsed))
+                    return true;
+
+                if (!repeat || (double)elapsed / b->macro_cycles < best_cycle) {
+                    best_cycle = (double)elapsed / b->macro_cycles;
+                    best_frame = (double)elapsed / frames;
+                }
+            }
+
+            add_result(b, name, b->macro_cycles, best_cycle);
+            snprintf(name, sizeof(name), "macro/%s/%s/frame", basename, execution_engines_strings[engine]);
+            add_result(b, name, frames, best_frame);
+        }
+    }
+
+    return false;
+}
+
+// Results of a previous --out, one benchmark per line
+static bool read_baseline(bench_t *b, const char *filepath)
+{
+    FILE *file = fopen(filepath, "r");
+    char line[512];
+
+    if (!file) {
+        perror(filepath);
+        return true;
+    }
+
+    while (fgets(line, sizeof(line), file) && b->baseline_count < MAX_BENCH_RESULTS) {
+        bench_result_t *r = &b->baseline[b->baseline_count];
+        char *ns = strstr(line, "\"ns_per_op\":");
+
+        if (sscanf(line, " {\"name\":\"%63[^\"]\"", r->name) == 1 && ns && sscanf(ns, "\"ns_per_op\":%lf", &r->ns_per_op) == 1)
+            b->baseline_count++;
+    }
+
+    fclose(file);
+    return false;
+}
+
+static bool write_results(const bench_t *b, const char *filepath)
+{
+    FILE *file = fopen(filepath, "w");
+
+    if (!file) {
+        perror(filepath);
+        return true;
+    }
+
+    fprintf(file, "{\"benchmarks\":[\n");
+    for (int k = 0; k < b->results_count; k++) {
+        const bench_result_t *r = &b->results[k];
+
+        fprintf(file, "{\"name\":\"%s\",\"iterations\":%lu,\"ns_per_op\":%.3f", r->name, (unsigned long)r->iterations, r->ns_per_op);
+        if (r->baseline > 0)
+            fprintf(file, ",\"baseline_ns_per_op\":%.3f,\"change_percent\":%.2f",
+                    r->baseline, 100 * (r->ns_per_op - r->baseline) / r->baseline);
+        fprintf(file, "}%s\n", k + 1 < b->results_count ? "," : "");
+    }
+    fprintf(file, "]}\n");
+
+    if (fclose(file)) {
+        perror(filepath);
+        return true;
+    }
+
+    return false;
+}
+
+static int usage(const char *prog_name)
+{
+    dprintf(2, \
+        "USAGE\n"
+        "\t%s [rom.ch8 ...] [--out FILE.json] [--baseline FILE.json] [--filter NAME] [--time MS] [--repeats N]\n"
+        "\t\t[--cycles N]\n"
+        "\tMacro benchmarks run Pong.ch8 unless ROMs are given, --filter keeps the benchmarks with NAME in their name\n"
+    , prog_name);
+
+    return 1;
+}
+
+int main(int ac, char **av)
+{
+    static bench_t b = {
+            .time_ms = DEFAULT_BENCH_TIME_MS,
+            .repeats = DEFAULT_BENCH_REPEATS,
+            .macro_cycles = DEFAULT_MACRO_CYCLES
+    };
+    static chip8_engine_t engine;
+    const char *roms[ac];
+    int roms_count = 0;
+    const char *out_path = NULL;
+
+    for (int i = 1; i < ac; i++) {
+        if (!strcmp(av[i], "--out") && av[i + 1])
+            out_path = av[++i];
+        else if (!strcmp(av[i], "--baseline") && av[i + 1]) {
+            if (read_baseline(&b, av[++i]))
+                return 1;
+        } else if (!strcmp(av[i], "--filter") && av[i + 1])
+            b.filter = av[++i];
+        else if (!strcmp(av[i], "--time") && av[i + 1])
+            b.time_ms = atol(av[++i]);
+        else if (!strcmp(av[i], "--repeats") && av[i + 1])
+            b.repeats = atoi(av[++i]);
+        else if (!strcmp(av[i], "--cycles") && av[i + 1])
+            b.macro_cycles = strtoull(av[++i], NULL, 10);
+        else if (av[i][0] == '-')
+            return usage(*av);
+        else
+            roms[roms_count++] = av[i];
+    }
+
+    if (b.time_ms < 1 || b.repeats < 1 || !b.macro_cycles)
+        return usage(*av);
+
+    if (!roms_count)
+        roms[roms_count++] = "Pong.ch8";
+
+    init_bench_engine(&engine);
+    bench_op_codes(&b, &engine);
+
+    init_bench_engine(&engine);
+    bench_sprites(&b, &engine);
+
+    init_bench_engine(&engine);
+    bench_render(&b, &engine);
+    destroy_chip8_engine(&engine);
+
+    if (bench_roms(&b, roms, roms_count))
+        return 1;
+
+    return out_path && write_results(&b, out_path);
+}
@@ -0,0 +1,165 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "chip8_engine.h"
+#include "op_codes.h"
+
+// Mismatches printed before giving up
+#define MAX_REPORTED_MISMATCHES 16
+
+typedef struct expected_op_code_s expected_op_code_t;
+
+struct expected_op_code_s {
+    uint16_t word;
+    op_code_t op_code;
+};
+
+/*
+ * Written from the instruction set rather than from classify_instruction_reference, so that a word
+ * misclassified there is caught even though op_codes_table is generated from it.
+ * Mostly the words around the gaps of each group.
+ */
+static const expected_op_code_t expected_op_codes[] = {
+        {0x0000, UNKNOWN},
+        {0x00e0, CLEAR},
+        {0x00ee, RET},
+        {0x00e1, UNKNOWN},
+        {0x00ef, UNKNOWN},
+        {0x01e0, UNKNOWN},
+        {0x0fee, UNKNOWN},
+        {0x0fff, UNKNOWN},
+        {0x1000, JMP_NNN},
+        {0x2fff, CALL},
+        {0x5120, SKIP_X_Y},
+        {0x8120, MOV_X_Y},
+        {0x8127, SUBN},
+        {0x8128, UNKNOWN},
+        {0x812d, UNKNOWN},
+        {0x812e, SHL},
+        {0x812f, UNKNOWN},
+        {0x9120, SKIPN_X_Y},
+        {0xbfff, JMP_V0_NNN},
+        {0xd120, DISP},
+        {0xe000, UNKNOWN},
+        {0xe09e, SKIP_KEY},
+        {0xe09f, UNKNOWN},
+        {0xe0a1, SKIPN_KEY},
+        {0xe0ff, UNKNOWN},
+        {0xefff, UNKNOWN},
+        {0xf000, UNKNOWN},
+        {0xf007, MOV_X_DELAY},
+        {0xf008, UNKNOWN},
+        {0xf00a, MOV_KEY},
+        {0xf015, MOV_DELAY_X},
+        {0xf016, UNKNOWN},
+        {0xf018, MOV_SOUND},
+        {0xf01e, ADD_I_X},
+        {0xf01f, UNKNOWN},
+        {0xf029, SPRITE_POS},
+        {0xf030, UNKNOWN},
+        {0xf033, MOVBCD},
+        {0xf055, MOVM_I_X},
+        {0xf065, MOVM_X_I},
+        {0xf066, UNKNOWN},
+        {0xf0ff, UNKNOWN},
+        {0xff65, MOVM_X_I},
+};
+
+/*
+ * Fields of word split by hand rather than by decode_instruction,
+ * classified by the reference decoder.
+ */
+static void decode_reference(uint16_t word, instruction_t *i)
+{
+    i->instruction = word;
+    i->u = word / 0x1000;
+    i->nnn = word % 0x1000;
+    i->x = word / 0x100 % 0x10;
+    i->y = word / 0x10 % 0x10;
+    i->n = word % 0x10;
+    i->kk = word % 0x100;
+    classify_instruction_reference(i);
+}
+
+static bool is_same_instruction(const instruction_t *a, const instruction_t *b)
+{
+    return a->instruction == b->instruction && a->u == b->u && a->nnn == b->nnn && a->x == b->x
+        && a->y == b->y && a->n == b->n && a->kk == b->kk && a->op_code == b->op_code;
+}
+
+static void report_mismatch(const char *path, const instruction_t *i, const instruction_t *expected)
+{
+    dprintf(2, "%04x : %s decodes %s u %x nnn %03x x %x y %x n %x kk %02x, reference %s u %x nnn %03x x %x y %x n %x kk %02x\n",
+            expected->instruction, path,
+            op_codes_strings[i->op_code], i->u, i->nnn, i->x, i->y, i->n, i->kk,
+            op_codes_strings[expected->op_code], expected->u, expected->nnn, expected->x, expected->y, expected->n, expected->kk);
+}
+
+static int check_expected_op_codes(void)
+{
+    int mismatches = 0;
+
+    for (size_t e = 0; e < sizeof(expected_op_codes) / sizeof(expected_op_codes[0]); e++) {
+        instruction_t i;
+
+        decode_reference(expected_op_codes[e].word, &i);
+        if (i.op_code != expected_op_codes[e].op_code) {
+            dprintf(2, "%04x : reference decodes %s, expected %s\n", expected_op_codes[e].word,
+                    op_codes_strings[i.op_code], op_codes_strings[expected_op_codes[e].op_code]);
+            mismatches++;
+        }
+    }
+
+    return mismatches;
+}
+
+/*
+ * Check the reference decoder on the expected op codes, then decode every instruction word
+ * through the paths the engines and the disassembler use, read_next_instruction over a buffer
+ * and fetch_instruction over the memory of an engine, and compare them with the reference decoder.
+ * Exits with 1 on any mismatch.
+ */
+int main(void)
+{
+    chip8_engine_t *e = malloc(sizeof(chip8_engine_t));
+    uint8_t buf[2];
+    int mismatches = check_expected_op_codes();
+
+    if (!e) {
+        dprintf(2, "malloc failed\n");
+        return 1;
+    }
+
+    init_chip8_engine(e);
+
+    for (long word = 0; word < OP_CODES_TABLE_SIZE; word++) {
+        instruction_t expected;
+        instruction_t read;
+        instruction_t fetched;
+
+        decode_reference((uint16_t)word, &expected);
+
+        buf[0] = word >> 8;
+        buf[1] = word & 0xff;
+        read_next_instruction(buf, 0, &read);
+
+        load_chip8_memory(e, INITIAL_PROGRAM_COUNTER, buf, sizeof(buf));
+        fetch_instruction(e, INITIAL_PROGRAM_COUNTER, &fetched);
+
+        if (!is_same_instruction(&read, &expected) && mismatches++ < MAX_REPORTED_MISMATCHES)
+            report_mismatch("read_next_instruction", &read, &expected);
+        if (!is_same_instruction(&fetched, &expected) && mismatches++ < MAX_REPORTED_MISMATCHES)
+            report_mismatch("fetch_instruction", &fetched, &expected);
+    }
+
+    destroy_chip8_engine(e);
+    free(e);
+
+    if (mismatches) {
+        dprintf(2, "%d mismatches with the reference decoder\n", mismatches);
+        return 1;
+    }
+
+    printf("%d instruction words decoded as the reference\n", OP_CODES_TABLE_SIZE);
+    return 0;
+}
@@ -0,0 +1,222 @@
+/*
+ * Fuzzing target of the decoder and executors, for libFuzzer and AFL persistent mode, see make fuzz.
+ *
+ * An input is a header, a key script and a ROM :
+ *   byte 0     quirk profile, modulo QUIRK_PROFILES_SIZE
+ *   byte 1     bits 0-1 : engine, REFERENCE_ENGINE through FUSED_ENGINE, or 3 to run all of them in lockstep
+ *              bits 2-5 : keys script length in 16 bits entries, one entry per frame, cycled
+ *   then       the keys script, then the ROM loaded at INITIAL_PROGRAM_COUNTER
+ * The ROM runs headless for FUZZ_CYCLES cycles. In lockstep, the fast engines must end every dispatch
+ * in the same state as the reference, any difference aborts.
+ *
+ * Engines are reset from a snapshot taken once, rather than initialized again for every input.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "chip8_engine.h"
+
+#define FUZZ_CYCLES             2000
+#define FUZZ_HEADER_SIZE        2
+#define FUZZ_LOCKSTEP           3
+#define MAX_FUZZ_INPUT_SIZE     (FUZZ_HEADER_SIZE + 15 * 2 + MAX_PROG_SIZE)
+
+typedef struct fuzz_input_s fuzz_input_t;
+
+struct fuzz_input_s {
+    quirk_profile_t quirk_profile;
+    int engine;
+    const uint8_t *keys;
+    int keys_count;
+    const uint8_t *rom;
+    size_t rom_size;
+};
+
+// One per execution engine, each keeps the predecoded array allocated once
+static chip8_engine_t engines[EXECUTION_ENGINES_SIZE];
+static chip8_engine_t snapshot;
+
+static void init_fuzz_engines(void)
+{
+    init_chip8_engine(&snapshot);
+
+    for (int n = 0; n < EXECUTION_ENGINES_SIZE; n++) {
+        init_chip8_engine(&engines[n]);
+        if (set_execution_engine(&engines[n], n))
+            abort();
+    }
+}
+
+static void reset_fuzz_engine(chip8_engine_t *e, const fuzz_input_t *in)
+{
+    predecoded_t *predecoded = e->predecoded;
+    execution_engine_t execution_engine = e->execution_engine;
+
+    copy_chip8_engine(e, &snapshot);
+    e->predecoded = predecoded;
+    e->execution_engine = execution_engine;
+    set_quirk_profile(e, in->quirk_profile);
+
+    load_chip8_memory(e, INITIAL_PROGRAM_COUNTER, in->rom, in->rom_size);
+    e->prog_size = in->rom_size;
+}
+
+static uint16_t get_fuzz_keys(const fuzz_input_t *in, const chip8_engine_t *e)
+{
+    if (!in->keys_count)
+        return 0;
+
+    const uint8_t *entry = in->keys + (e->cycles / e->cycles_per_tick % in->keys_count) * 2;
+
+    return entry[0] << 8 | entry[1];
+}
+
+// RAND draws from the random state of the snapshot, the same for every engine
+static void step_fuzz_engine(chip8_engine_t *e, const fuzz_input_t *in)
+{
+    e->keyboard = get_fuzz_keys(in, e);
+    update_chip8_engine(e, false);
+}
+
+static void check_lockstep(const chip8_engine_t *reference, const chip8_engine_t *e, uint16_t pc)
+{
+    const char *diverged = NULL;
+
+    if (reference->pc != e->pc)
+        diverged = "pc";
+    else if (reference->i != e->i)
+        diverged = "I";
+    else if (reference->sp != e->sp || memcmp(reference->stack, e->stack, sizeof(e->stack)))
+        diverged = "stack";
+    else if (memcmp(reference->v, e->v, sizeof(e->v)))
+        diverged = "V registers";
+    else if (get_timer(reference, &reference->delay) != get_timer(e, &e->delay)
+             || get_timer(reference, &reference->sound) != get_timer(e, &e->sound))
+        diverged = "timers";
+    for (int page = 0; !diverged && page < CHIP8_PAGES; page++)
+        if (memcmp(reference->pages[page]->bytes, e->pages[page]->bytes, CHIP8_PAGE_SIZE))
+            diverged = page < MEMORY_PAGES ? "memory" : "screen";
+
+    if (!diverged)
+        return;
+
+    dprintf(2, "%s engine diverged from the reference on %s, dispatch at %04x, cycle %lu\n",
+            execution_engines_strings[e->execution_engine], diverged, pc, (unsigned long)e->cycles);
+    abort();
+}
+
+/*
+ * Every dispatch of the fused engine is matched by the other engines executing as many cycles,
+ * their states are then compared.
+ */
+static void run_lockstep(const fuzz_input_t *in)
+{
+    chip8_engine_t *reference = &engines[REFERENCE_ENGINE];
+    chip8_engine_t *fused = &engines[FUSED_ENGINE];
+
+    for (int n = 0; n < EXECUTION_ENGINES_SIZE; n++)
+        reset_fuzz_engine(&engines[n], in);
+
+    while (fused->cycles < FUZZ_CYCLES) {
+        uint16_t pc = fused->pc;
+
+        step_fuzz_engine(fused, in);
+
+        for (int n = 0; n < FUSED_ENGINE; n++) {
+            while (engines[n].cycles < fused->cycles)
+                step_fuzz_engine(&engines[n], in);
+
+            if (n != REFERENCE_ENGINE)
+                check_lockstep(reference, &engines[n], pc);
+        }
+
+        check_lockstep(reference, fused, pc);
+    }
+}
+
+static void run_single(const fuzz_input_t *in)
+{
+    chip8_engine_t *e = &engines[in->engine];
+
+    reset_fuzz_engine(e, in);
+
+    while (e->cycles < FUZZ_CYCLES)
+        step_fuzz_engine(e, in);
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    static bool initialized = false;
+    fuzz_input_t in;
+
+    if (!initialized) {
+        init_fuzz_engines();
+        initialized = true;
+    }
+
+    if (size < FUZZ_HEADER_SIZE)
+        return 0;
+
+    in.quirk_profile = data[0] % QUIRK_PROFILES_SIZE;
+    in.engine = data[1] & 0x3;
+    in.keys_count = data[1] >> 2 & 0xf;
+    in.keys = data + FUZZ_HEADER_SIZE;
+
+    if (size < FUZZ_HEADER_SIZE + in.keys_count * 2u)
+        return 0;
+
+    in.rom = in.keys + in.keys_count * 2;
+    in.rom_size = size - FUZZ_HEADER_SIZE - in.keys_count * 2;
+    if (in.rom_size > MAX_PROG_SIZE)
+        in.rom_size = MAX_PROG_SIZE;
+
+    if (in.engine == FUZZ_LOCKSTEP)
+        run_lockstep(&in);
+    else
+        run_single(&in);
+
+    return 0;
+}
+
+#ifndef FUZZ_LIBFUZZER
+/*
+ * Without libFuzzer : with AFL, persistent mode reading inputs from stdin,
+ * otherwise run every file given, or stdin, once. This replays crashes and corpora.
+ */
+static size_t read_fuzz_input(FILE *file, uint8_t *buf)
+{
+    return fread(buf, 1, MAX_FUZZ_INPUT_SIZE, file);
+}
+
+int main(int ac, char **av)
+{
+    static uint8_t buf[MAX_FUZZ_INPUT_SIZE];
+
+#ifdef __AFL_LOOP
+    (void)ac;
+    (void)av;
+
+    while (__AFL_LOOP(10000))
+        LLVMFuzzerTestOneInput(buf, read_fuzz_input(stdin, buf));
+#else
+    if (ac < 2)
+        LLVMFuzzerTestOneInput(buf, read_fuzz_input(stdin, buf));
+
+    for (int n = 1; n < ac; n++) {
+        FILE *file = fopen(av[n], "rb");
+
+        if (!file) {
+            perror(av[n]);
+            return 1;
+        }
+
+        LLVMFuzzerTestOneInput(buf, read_fuzz_input(file, buf));
+        fclose(file);
+    }
+#endif
+
+    return 0;
+}
+#endif
@@ -0,0 +1,37 @@
+#include <stdio.h>
+
+#include "op_codes.h"
+
+#define ENTRIES_PER_LINE 16
+
+/*
+ * Print op_codes_table : the op code of every instruction word,
+ * classified once by the reference decoder.
+ */
+int main(void)
+{
+    instruction_t i;
+
+    printf(
+        "// Generated by tools/gen_op_codes_table.c from classify_instruction_reference, do not edit.\n\n"
+        "#include \"op_codes.h\"\n\n"
+        "const uint8_t op_codes_table[OP_CODES_TABLE_SIZE] = {\n"
+    );
+
+    for (long word = 0; word < OP_CODES_TABLE_SIZE; word++) {
+        decode_instruction((uint16_t)word, &i);
+        classify_instruction_reference(&i);
+
+        if (word % ENTRIES_PER_LINE == 0)
+            printf("    /* %04lx */", word);
+
+        printf(" %2d,", i.op_code);
+
+        if (word % ENTRIES_PER_LINE == ENTRIES_PER_LINE - 1)
+            printf("\n");
+    }
+
+    printf("};\n");
+
+    return 0;
+}